@@ -93,12 +93,10 @@ int classexport( int argc, char** argv )
   UClass* Class = UClass::StaticClass();
 
   // Load package
-  UPackage* Pkg = UPackage::StaticLoadPackage( PkgName );
+  FPackagePrefetcher Prefetcher;
+  UPackage* Pkg = LoadPackageWithPrefetch( PkgName, Prefetcher );
   if ( Pkg == NULL )
-  {
-    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist" );
     return ERR_MISSING_PKG;
-  }
 
   // Iterate and export all class scripts
   TArray<FExport>& ExportTable = Pkg->GetExportTable();
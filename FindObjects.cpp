@@ -0,0 +1,267 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * FindObjects.cpp - Searches every package's tables for objects or names
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <regex>
+#include <cctype>
+#include "lucc.h"
+
+/*-----------------------------------------------------------------------------
+ * Pattern matching
+ * Glob patterns (* and ?) by default, or regular expressions. Both ignore
+ * case, like package and object names do
+-----------------------------------------------------------------------------*/
+static bool GlobMatch( const char* Pattern, const char* Str )
+{
+  const char* Star = NULL;
+  const char* Retry = NULL;
+  while ( *Str )
+  {
+    if ( *Pattern == '*' )
+    {
+      Star = Pattern++;
+      Retry = Str;
+    }
+    else if ( *Pattern == '?' || tolower( (u8)*Pattern ) == tolower( (u8)*Str ) )
+    {
+      Pattern++;
+      Str++;
+    }
+    else if ( Star != NULL )
+    {
+      Pattern = Star + 1;
+      Str = ++Retry;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  while ( *Pattern == '*' )
+    Pattern++;
+  return *Pattern == '\0';
+}
+
+struct FFindPattern
+{
+  FFindPattern( const char* InPattern, bool bInRegex )
+    : Pattern( InPattern ), bRegex( bInRegex )
+  {
+    if ( bRegex )
+      Regex = std::regex( InPattern, std::regex::icase | std::regex::optimize );
+  }
+
+  bool Matches( const char* Str ) const
+  {
+    return bRegex ? std::regex_search( Str, Regex ) : GlobMatch( Pattern, Str );
+  }
+
+  const char* Pattern;
+  bool bRegex;
+  std::regex Regex;
+};
+
+/*-----------------------------------------------------------------------------
+ * find
+ * Only package tables are read, so whole games are searched in moments
+-----------------------------------------------------------------------------*/
+static bool HasWildcards( const char* Str )
+{
+  return strpbrk( Str, "*?" ) != NULL;
+}
+
+static bool PackageHasClass( const FIndexedPackage& Package, const char* ClassName )
+{
+  for ( u32 i = 0; i < Package.NumClassCounts; i++ )
+  {
+    const FIndexedClassCount& Count = GPackageIndex.ClassCounts[Package.FirstClassCount + i];
+    if ( stricmp( GPackageIndex.GetString( Count.ClassName ), ClassName ) == 0 )
+      return true;
+  }
+  return false;
+}
+
+int find( int argc, char** argv )
+{
+  int i = 0;
+  char* ClassName = NULL;
+  bool bRegex = false;
+  bool bNames = false;
+  char* Pattern = NULL;
+
+  // Argument parsing
+  while ( 1 )
+  {
+    if ( argc == 0 || i >= argc )
+    {
+    BadOpt:
+      printf( "find usage:\n" );
+      printf( "\tlucc [gopts] find [copts] <Pattern>\n\n" );
+
+      printf( "Command options:\n" );
+      printf( "\t-c \"<ClassName>\"    - Only finds objects of this (c)lass (may be a pattern)\n" );
+      printf( "\t-e                   - The pattern is a regular (e)xpression instead of a glob\n" );
+      printf( "\t-n                   - Searches the (n)ame tables instead of objects\n" );
+      printf( "\n" );
+      return ERR_BAD_ARGS;
+    }
+
+    if ( argv[i][0] == '-' )
+    {
+      switch ( argv[i][1] )
+      {
+      case 'c':
+        ClassName = argv[++i];
+        break;
+      case 'e':
+        bRegex = true;
+        break;
+      case 'n':
+        bNames = true;
+        break;
+      default:
+        GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
+        goto BadOpt;
+      }
+    }
+    else
+    {
+      Pattern = argv[i];
+      break;
+    }
+
+    i++;
+  }
+
+  if ( !GPackageIndex.OpenIfNeeded() )
+  {
+    GLogf( LOG_CRIT, "The package index could not be opened" );
+    return ERR_BAD_PATH;
+  }
+
+  FFindPattern* NamePattern = NULL;
+  FFindPattern* ClassPattern = NULL;
+  try
+  {
+    NamePattern = new FFindPattern( Pattern, bRegex );
+    if ( ClassName != NULL )
+      ClassPattern = new FFindPattern( ClassName, bRegex );
+  }
+  catch ( std::regex_error& Error )
+  {
+    GLogf( LOG_CRIT, "Bad regular expression; %s", Error.what() );
+    delete NamePattern;
+    return ERR_BAD_ARGS;
+  }
+
+  // Patterns that contain a dot are matched against group paths
+  bool bMatchPath = strchr( Pattern, '.' ) != NULL;
+
+  // A plain class name can skip packages that have no objects of that class
+  // without opening them
+  bool bPlainClass = ClassName != NULL && !bRegex && !HasWildcards( ClassName );
+
+  double StartTime = USystem::GetSeconds();
+  int NumPackages = (int)GPackageIndex.Header->NumPackages;
+  std::vector<FTextBuffer*> Results( NumPackages );
+  std::vector<int> NumMatches( NumPackages );
+  ParallelFor( NumPackages, [&]( int iPkg )
+  {
+    const FIndexedPackage& Package = GPackageIndex.Packages[iPkg];
+    if ( Package.Flags & INDEX_BadPackage )
+      return;
+    if ( bPlainClass && !bNames && !PackageHasClass( Package, ClassName ) )
+      return;
+
+    FPackageReader Reader;
+    if ( !Reader.Open( GPackageIndex.GetString( Package.Path ) ) )
+      return;
+
+    const char* PackageName = GPackageIndex.GetString( Package.Name );
+    FTextBuffer* Out = new FTextBuffer();
+    Results[iPkg] = Out;
+
+    if ( bNames )
+    {
+      for ( size_t j = 0; j < Reader.NameStarts.size(); j++ )
+      {
+        const char* Name = Reader.GetName( (int)j );
+        if ( !NamePattern->Matches( Name ) )
+          continue;
+
+        char Line[1024];
+        int Len = snprintf( Line, sizeof( Line ), "  %-40s %s\n", PackageName, Name );
+        Out->Write( Line, std::min( Len, (int)sizeof( Line ) - 1 ) );
+        NumMatches[iPkg]++;
+      }
+      return;
+    }
+
+    for ( size_t j = 0; j < Reader.Exports.size(); j++ )
+    {
+      int ObjRef = (int)j + 1;
+      const char* Class = Reader.GetClassName( ObjRef );
+      if ( ClassPattern != NULL && !ClassPattern->Matches( Class ) )
+        continue;
+
+      char ObjPath[1024];
+      Reader.GetObjectPath( ObjRef, ObjPath, sizeof( ObjPath ) );
+      if ( !NamePattern->Matches( bMatchPath ? ObjPath : Reader.GetObjectName( ObjRef ) ) )
+        continue;
+
+      char FullName[1024];
+      snprintf( FullName, sizeof( FullName ), "%s.%s", PackageName, ObjPath );
+
+      char Line[2048];
+      int Len = snprintf( Line, sizeof( Line ), "  %-48s %-20s %s\n", FullName, Class,
+        GPackageIndex.GetString( Package.Path ) );
+      Out->Write( Line, std::min( Len, (int)sizeof( Line ) - 1 ) );
+      NumMatches[iPkg]++;
+    }
+  });
+
+  // Results come out in package order no matter which thread found them
+  int TotalMatches = 0;
+  int MatchedPackages = 0;
+  for ( int j = 0; j < NumPackages; j++ )
+  {
+    if ( Results[j] == NULL )
+      continue;
+
+    if ( Results[j]->Len > 0 )
+      fwrite( Results[j]->Data, 1, Results[j]->Len, stdout );
+    if ( NumMatches[j] > 0 )
+      MatchedPackages++;
+    TotalMatches += NumMatches[j];
+    delete Results[j];
+  }
+
+  printf( "%i matches in %i packages (%i searched) in %.3f seconds\n", TotalMatches, MatchedPackages,
+    NumPackages, USystem::GetSeconds() - StartTime );
+
+  delete NamePattern;
+  delete ClassPattern;
+  return 0;
+}
@@ -23,6 +23,9 @@
  *========================================================================
 */
 
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include "lucc.h"
 
 /*-----------------------------------------------------------------------------
@@ -124,6 +127,183 @@ int DoFullPkgExport( UPackage* Pkg, char* Path, bool bUseGroupPath )
   return 0;
 }
 
+/*-----------------------------------------------------------------------------
+ * DoDependencyExport
+ * Exports every external asset a package references, from whatever package
+ * it lives in. Each package that assets were taken from has its own imports
+ * walked as well (detail textures, animated texture chains and so on), until
+ * nothing new turns up. Assets go into {Path}/{Package}/{AssetPath}/ so that
+ * names from different packages can't collide.
+ *
+ * libunr can only load packages one at a time, so every round of packages
+ * is read into the file cache on worker threads while the main thread loads
+ * and exports them in order.
+-----------------------------------------------------------------------------*/
+struct FDependencyPkg
+{
+  std::string Name;
+  std::unordered_set<std::string> Wanted;
+};
+
+static std::string MakeDependencyKey( const char* ClassName, const char* Group, const char* ObjName )
+{
+  std::string Key = ClassName;
+  Key += ':';
+  Key += Group;
+  Key += '.';
+  Key += ObjName;
+  for ( size_t i = 0; i < Key.size(); i++ )
+    Key[i] = (char)tolower( (u8)Key[i] );
+  return Key;
+}
+
+static void AddPackageDependencies( UPackage* Pkg, std::vector<FDependencyPkg>& Round,
+  std::unordered_map<std::string, size_t>& PkgMap, std::unordered_set<std::string>& Seen )
+{
+  TArray<FImport>& Imports = Pkg->GetImportTable();
+  for ( int i = 0; i < Imports.Size(); i++ )
+  {
+    FImport* Import = &Imports[i];
+    const char* ClassName = Pkg->ResolveNameFromIdx( Import->ClassName );
+
+    // Only assets fullpkgexport knows where to put (skipping classes)
+    u32 ClassHash = SuperFastHashString( ClassName );
+    int j;
+    for ( j = 1; j < NUM_ASSET_TYPES; j++ )
+      if ( ClassHash == AssetPaths[j].TypeHash )
+        break;
+
+    if ( j == NUM_ASSET_TYPES )
+      continue;
+
+    // Walk out to the package, remembering the group right above the object
+    const char* Group = "None";
+    const char* OuterName = NULL;
+    int Outer = Import->Package;
+    for ( int Depth = 0; Outer < 0; Depth++ )
+    {
+      FImport* OuterImport = &Imports[-Outer - 1];
+      if ( Depth == 1 )
+        Group = OuterName;
+      OuterName = Pkg->ResolveNameFromIdx( OuterImport->ObjectName );
+      Outer = OuterImport->Package;
+    }
+
+    if ( OuterName == NULL || Outer != 0 )
+      continue;
+
+    std::string PkgKey = OuterName;
+    for ( size_t k = 0; k < PkgKey.size(); k++ )
+      PkgKey[k] = (char)tolower( (u8)PkgKey[k] );
+
+    // Each asset is exported once, however many packages reference it
+    const char* ObjName = Pkg->ResolveNameFromIdx( Import->ObjectName );
+    std::string Key = MakeDependencyKey( ClassName, Group, ObjName );
+    if ( !Seen.insert( PkgKey + "/" + Key ).second )
+      continue;
+
+    std::unordered_map<std::string, size_t>::iterator It = PkgMap.find( PkgKey );
+    if ( It == PkgMap.end() )
+    {
+      It = PkgMap.insert( std::make_pair( PkgKey, Round.size() ) ).first;
+      Round.push_back( FDependencyPkg() );
+      Round.back().Name = OuterName;
+    }
+    Round[It->second].Wanted.insert( Key );
+  }
+}
+
+int DoDependencyExport( UPackage* MapPkg, char* Path )
+{
+  std::unordered_set<std::string> Seen;
+  std::unordered_map<std::string, size_t> PkgMap;
+  std::vector<FDependencyPkg> Round;
+  int NumExported = 0;
+  int NumMissing = 0;
+
+  AddPackageDependencies( MapPkg, Round, PkgMap, Seen );
+
+  while ( Round.size() > 0 )
+  {
+    std::vector<FDependencyPkg> NextRound;
+    std::unordered_map<std::string, size_t> NextPkgMap;
+
+    FPackagePrefetcher Prefetcher;
+    for ( size_t i = 0; i < Round.size(); i++ )
+      Prefetcher.AddPackage( Round[i].Name.c_str() );
+    Prefetcher.Start( GetNumThreads() );
+
+    for ( size_t i = 0; i < Round.size(); i++ )
+    {
+      FDependencyPkg& Dep = Round[i];
+      UPackage* Pkg = UPackage::StaticLoadPackage( Dep.Name.c_str() );
+      if ( Pkg == NULL )
+      {
+        GLogf( LOG_WARN, "Dependency package '%s' is missing (%d assets)", Dep.Name.c_str(), (int)Dep.Wanted.size() );
+        NumMissing += Dep.Wanted.size();
+        continue;
+      }
+
+      char PkgPath[4096];
+      snprintf( PkgPath, sizeof( PkgPath ), "%s/%s", Path, Dep.Name.c_str() );
+      if ( !USystem::MakeDir( PkgPath ) )
+      {
+        GLogf( LOG_ERR, "Could not create path '%s' for dependency export", PkgPath );
+        continue;
+      }
+
+      size_t NumFound = 0;
+      TArray<FExport>& Exports = Pkg->GetExportTable();
+      for ( int j = 0; j < Exports.Size() && NumFound < Dep.Wanted.size(); j++ )
+      {
+        FExport* Export = &Exports[j];
+        const char* ClassName = Pkg->ResolveNameFromObjRef( Export->Class );
+        const char* Group = Pkg->ResolveNameFromObjRef( Export->Group );
+        const char* ObjName = Pkg->ResolveNameFromIdx( Export->ObjectName );
+        if ( Dep.Wanted.find( MakeDependencyKey( ClassName, Group, ObjName ) ) == Dep.Wanted.end() )
+          continue;
+
+        NumFound++;
+
+        u32 ClassHash = SuperFastHashString( ClassName );
+        char* CurrentPath = NULL;
+        for ( int k = 1; k < NUM_ASSET_TYPES; k++ )
+        {
+          if ( ClassHash == AssetPaths[k].TypeHash )
+          {
+            CurrentPath = CreateAssetPath( AssetPaths[k], PkgPath );
+            break;
+          }
+        }
+
+        if ( CurrentPath == NULL )
+          continue;
+
+        UObject* Obj = UObject::StaticLoadObject( Pkg, Export, NULL, NULL, LOAD_Immediate );
+        if ( Obj != NULL && UExporter::ExportObject( Obj, CurrentPath, NULL ) )
+          NumExported++;
+      }
+
+      if ( NumFound < Dep.Wanted.size() )
+      {
+        GLogf( LOG_WARN, "%d assets referenced from package '%s' were not found in it",
+          (int)(Dep.Wanted.size() - NumFound), Dep.Name.c_str() );
+        NumMissing += Dep.Wanted.size() - NumFound;
+      }
+
+      if ( NumFound > 0 )
+        AddPackageDependencies( Pkg, NextRound, NextPkgMap, Seen );
+    }
+
+    Prefetcher.Wait();
+    Round.swap( NextRound );
+    PkgMap.swap( NextPkgMap );
+  }
+
+  GLogf( LOG_INFO, "Exported %d dependencies (%d missing)", NumExported, NumMissing );
+  return 0;
+}
+
 /*-----------------------------------------------------------------------------
  * fullpkgexport
  * This exports an entire package.
@@ -200,12 +380,10 @@ int fullpkgexport( int argc, char** argv )
   }
 
   // Load package
-  UPackage* Pkg = UPackage::StaticLoadPackage( PkgName );
+  FPackagePrefetcher Prefetcher;
+  UPackage* Pkg = LoadPackageWithPrefetch( PkgName, Prefetcher );
   if ( Pkg == NULL )
-  {
-    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist", PkgName );
     return ERR_MISSING_PKG;
-  }
 
   return DoFullPkgExport( Pkg, Path, bUseGroupPath );
 }
@@ -0,0 +1,185 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * GltfWriter.cpp - Helpers for writing binary glTF (.glb) files
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include "lucc.h"
+
+#define GLB_MAGIC      0x46546C67 // "glTF"
+#define GLB_VERSION    2
+#define GLB_CHUNK_JSON 0x4E4F534A // "JSON"
+#define GLB_CHUNK_BIN  0x004E4942 // "BIN\0"
+
+FGlbWriter::FGlbWriter()
+  : NumBufferViews( 0 ), NumAccessors( 0 )
+{
+}
+
+/*-----------------------------------------------------------------------------
+ * AllocBufferView
+ * Reserves space for a view at the end of the binary chunk, so that callers
+ * can write into it directly. The pointer is only good until the next view
+ * is added
+-----------------------------------------------------------------------------*/
+u8* FGlbWriter::AllocBufferView( size_t Size, int Target, int ByteStride, int* OutView )
+{
+  // Keep every view 4 byte aligned, as accessors require
+  while ( Bin.size() & 3 )
+    Bin.push_back( 0 );
+
+  size_t Offset = Bin.size();
+  Bin.resize( Offset + Size );
+
+  if ( NumBufferViews > 0 )
+    BufferViews.Write( "," );
+
+  BufferViews.Write( "{\"buffer\":0,\"byteOffset\":" );
+  BufferViews.WriteInt( Offset );
+  BufferViews.Write( ",\"byteLength\":" );
+  BufferViews.WriteInt( Size );
+  if ( ByteStride > 0 )
+  {
+    BufferViews.Write( ",\"byteStride\":" );
+    BufferViews.WriteInt( ByteStride );
+  }
+  if ( Target > 0 )
+  {
+    BufferViews.Write( ",\"target\":" );
+    BufferViews.WriteInt( Target );
+  }
+  BufferViews.Write( "}" );
+
+  *OutView = NumBufferViews++;
+  return Bin.data() + Offset;
+}
+
+/*-----------------------------------------------------------------------------
+ * AddBufferView
+ * Appends data straight to the binary chunk and returns its view index
+-----------------------------------------------------------------------------*/
+int FGlbWriter::AddBufferView( const void* Data, size_t Size, int Target, int ByteStride )
+{
+  int View;
+  u8* Dest = AllocBufferView( Size, Target, ByteStride, &View );
+  memcpy( Dest, Data, Size );
+  return View;
+}
+
+// Bounds have to be exact, so these use enough digits to round trip
+static void WriteJsonFloats( FTextBuffer& Out, const float* Values, int Num )
+{
+  char Buf[32];
+  Out.Write( "[" );
+  for ( int i = 0; i < Num; i++ )
+  {
+    if ( i > 0 )
+      Out.Write( "," );
+    Out.Write( Buf, snprintf( Buf, sizeof( Buf ), "%.9g", Values[i] ) );
+  }
+  Out.Write( "]" );
+}
+
+/*-----------------------------------------------------------------------------
+ * AddAccessor
+ * Min and Max are optional, but glTF requires them on positions. ByteOffset
+ * lets several accessors share one view
+-----------------------------------------------------------------------------*/
+int FGlbWriter::AddAccessor( int View, int ComponentType, int Count, const char* Type,
+  const float* Min, const float* Max, int NumComponents, bool bNormalized, size_t ByteOffset )
+{
+  if ( NumAccessors > 0 )
+    Accessors.Write( "," );
+
+  Accessors.Write( "{\"bufferView\":" );
+  Accessors.WriteInt( View );
+  if ( ByteOffset > 0 )
+  {
+    Accessors.Write( ",\"byteOffset\":" );
+    Accessors.WriteInt( ByteOffset );
+  }
+  Accessors.Write( ",\"componentType\":" );
+  Accessors.WriteInt( ComponentType );
+  Accessors.Write( ",\"count\":" );
+  Accessors.WriteInt( Count );
+  Accessors.Write( ",\"type\":\"" );
+  Accessors.Write( Type );
+  Accessors.Write( "\"" );
+  if ( bNormalized )
+    Accessors.Write( ",\"normalized\":true" );
+  if ( Min != NULL && Max != NULL )
+  {
+    Accessors.Write( ",\"min\":" );
+    WriteJsonFloats( Accessors, Min, NumComponents );
+    Accessors.Write( ",\"max\":" );
+    WriteJsonFloats( Accessors, Max, NumComponents );
+  }
+  Accessors.Write( "}" );
+
+  return NumAccessors++;
+}
+
+/*-----------------------------------------------------------------------------
+ * Save
+ * Extra holds the remaining top level JSON members (meshes, nodes, etc.)
+-----------------------------------------------------------------------------*/
+bool FGlbWriter::Save( const char* FileName, const char* Extra )
+{
+  FTextBuffer Json;
+  Json.Write( "{\"asset\":{\"version\":\"2.0\",\"generator\":\"lucc\"}" );
+  Json.Write( ",\"buffers\":[{\"byteLength\":" );
+  Json.WriteInt( Bin.size() );
+  Json.Write( "}],\"bufferViews\":[" );
+  Json.Write( BufferViews.Data, BufferViews.Len );
+  Json.Write( "],\"accessors\":[" );
+  Json.Write( Accessors.Data, Accessors.Len );
+  Json.Write( "]," );
+  Json.Write( Extra );
+  Json.Write( "}" );
+
+  // Both chunks must be 4 byte aligned
+  while ( Json.Len & 3 )
+    Json.Write( " " );
+  while ( Bin.size() & 3 )
+    Bin.push_back( 0 );
+
+  FILE* File = fopen( FileName, "wb" );
+  if ( File == NULL )
+  {
+    GLogf( LOG_ERR, "Failed to open '%s' for writing", FileName );
+    return false;
+  }
+
+  u32 Header[3] = { GLB_MAGIC, GLB_VERSION, (u32)(12 + 8 + Json.Len + 8 + Bin.size()) };
+  u32 JsonChunk[2] = { (u32)Json.Len, GLB_CHUNK_JSON };
+  u32 BinChunk[2] = { (u32)Bin.size(), GLB_CHUNK_BIN };
+
+  fwrite( Header, sizeof( Header ), 1, File );
+  fwrite( JsonChunk, sizeof( JsonChunk ), 1, File );
+  fwrite( Json.Data, 1, Json.Len, File );
+  fwrite( BinChunk, sizeof( BinChunk ), 1, File );
+  fwrite( Bin.data(), 1, Bin.size(), File );
+
+  bool bOk = ferror( File ) == 0;
+  fclose( File );
+  return bOk;
+}
@@ -0,0 +1,295 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * LevelBin.h - Binary level dump format and header-only reader
+ *
+ * This header has no libunr dependencies, so tools that only need to
+ * read level dumps can include it on its own.
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*-----------------------------------------------------------------------------
+ * File layout (little endian)
+ *   FLevelBinHeader
+ *   FLevelBinSection[NumSections]   - Offset table
+ *   Section data, every section starting on an 8 byte boundary
+ *
+ * Every section is a flat array of Count elements. Strings are referenced
+ * by their byte offset into the LBIN_Strings section.
+ *
+ * Actor properties are stored as columns: every property (or static array
+ * element) that is set on at least one actor gets an FLevelBinColumn, whose
+ * values for all actors are stored one after another in LBIN_ColumnData,
+ * along with a bitmap of which actors have a non-default value.
+ *
+ * Struct properties are flattened into one column per member, named
+ * "Struct.Member" (e.g. "MainScale.SheerRate", "MainScale.Scale"). Dynamic
+ * arrays and maps are not stored. Two classes may declare a property with the
+ * same name but a different type, in which case there is one column for each
+ * type under the same name.
+-----------------------------------------------------------------------------*/
+#define LBIN_MAGIC   0x4E49424C // "LBIN"
+#define LBIN_VERSION 1
+
+enum ELevelBinSection
+{
+  LBIN_Strings,      // char
+  LBIN_ActorClass,   // uint32_t string offset per actor
+  LBIN_ActorName,    // uint32_t string offset per actor
+  LBIN_Columns,      // FLevelBinColumn
+  LBIN_ColumnData,   // uint8_t
+  LBIN_Points,       // FLevelBinVector
+  LBIN_Vectors,      // FLevelBinVector
+  LBIN_Nodes,        // FLevelBinNode
+  LBIN_Surfs,        // FLevelBinSurf
+  LBIN_Verts,        // FLevelBinVert
+  LBIN_BrushPolys,   // FLevelBinPoly
+  LBIN_BrushVerts,   // FLevelBinVector
+  LBIN_MAX
+};
+
+enum ELevelBinValueType
+{
+  LBIN_Byte,      // uint8_t
+  LBIN_Int,       // int32_t
+  LBIN_Bool,      // uint8_t
+  LBIN_Float,     // float
+  LBIN_Name,      // uint32_t string offset
+  LBIN_String,    // uint32_t string offset
+  LBIN_Object,    // uint32_t string offset of Class'Package.Name', or ~0 for None
+  LBIN_Vector,    // FLevelBinVector
+  LBIN_Rotator,   // FLevelBinRotator
+};
+
+#pragma pack(push, 1)
+struct FLevelBinHeader
+{
+  uint32_t Magic;
+  uint32_t Version;
+  uint32_t NumSections;
+  uint32_t NumActors;
+};
+
+struct FLevelBinSection
+{
+  uint32_t Id;
+  uint32_t ElementSize;
+  uint64_t Offset;
+  uint64_t Count;
+};
+
+struct FLevelBinColumn
+{
+  uint32_t Name;         // String offset, static array elements are "Name(i)"
+  uint32_t Type;         // ELevelBinValueType
+  uint32_t ValueSize;
+  uint32_t Pad;
+  uint64_t DataOffset;   // NumActors * ValueSize bytes into LBIN_ColumnData
+  uint64_t MaskOffset;   // (NumActors + 7) / 8 bytes into LBIN_ColumnData
+};
+
+struct FLevelBinVector
+{
+  float X, Y, Z;
+};
+
+struct FLevelBinRotator
+{
+  int32_t Pitch, Yaw, Roll;
+};
+
+struct FLevelBinNode
+{
+  float Plane[4];
+  int32_t iVertPool;
+  int32_t iSurf;
+  int32_t iBack;
+  int32_t iFront;
+  int32_t iPlane;
+  uint8_t NumVertices;
+  uint8_t NodeFlags;
+  uint8_t iZone[2];
+};
+
+struct FLevelBinSurf
+{
+  uint32_t Texture;      // String offset of the texture path
+  uint32_t PolyFlags;
+  int32_t pBase;
+  int32_t vNormal;
+  int32_t vTextureU;
+  int32_t vTextureV;
+  int32_t iLightMap;
+  int32_t iBrushPoly;
+  int16_t PanU;
+  int16_t PanV;
+};
+
+struct FLevelBinVert
+{
+  int32_t pVertex;
+  int32_t iSide;
+};
+
+struct FLevelBinPoly
+{
+  int32_t iActor;        // Brush actor this polygon belongs to
+  uint32_t Texture;      // String offset of the texture path
+  uint32_t PolyFlags;
+  int32_t iLink;
+  FLevelBinVector Base;
+  FLevelBinVector Normal;
+  FLevelBinVector TextureU;
+  FLevelBinVector TextureV;
+  int16_t PanU;
+  int16_t PanV;
+  uint32_t FirstVertex;  // Index into LBIN_BrushVerts
+  uint32_t NumVertices;
+};
+#pragma pack(pop)
+
+/*-----------------------------------------------------------------------------
+ * FLevelBinReader
+ * Reads a level dump that is already in memory (e.g. a mapped file).
+ * Nothing is copied; all returned pointers point into the given data
+-----------------------------------------------------------------------------*/
+class FLevelBinReader
+{
+public:
+  FLevelBinReader()
+    : Data( NULL ), Size( 0 ), Header( NULL ), Sections( NULL )
+  {
+  }
+
+  bool Open( const void* InData, uint64_t InSize )
+  {
+    Data = (const uint8_t*)InData;
+    Size = InSize;
+    Header = (const FLevelBinHeader*)Data;
+
+    if ( Size < sizeof( FLevelBinHeader ) || Header->Magic != LBIN_MAGIC || Header->Version != LBIN_VERSION )
+      return false;
+
+    if ( Size < sizeof( FLevelBinHeader ) + (uint64_t)Header->NumSections * sizeof( FLevelBinSection ) )
+      return false;
+
+    Sections = (const FLevelBinSection*)(Data + sizeof( FLevelBinHeader ));
+    for ( uint32_t i = 0; i < Header->NumSections; i++ )
+    {
+      const FLevelBinSection& Sec = Sections[i];
+      if ( Sec.ElementSize == 0 || Sec.Offset > Size || Sec.Count > (Size - Sec.Offset) / Sec.ElementSize )
+        return false;
+    }
+
+    return true;
+  }
+
+  uint32_t NumActors() const
+  {
+    return Header->NumActors;
+  }
+
+  // Returns a section as an array of T, or NULL if it is missing
+  template <class T> const T* GetSection( uint32_t Id, uint64_t& OutCount ) const
+  {
+    for ( uint32_t i = 0; i < Header->NumSections; i++ )
+    {
+      if ( Sections[i].Id == Id && Sections[i].ElementSize == sizeof( T ) )
+      {
+        OutCount = Sections[i].Count;
+        return (const T*)(Data + Sections[i].Offset);
+      }
+    }
+
+    OutCount = 0;
+    return NULL;
+  }
+
+  const char* GetString( uint32_t Offset ) const
+  {
+    uint64_t Count;
+    const char* Strings = GetSection<char>( LBIN_Strings, Count );
+    return (Strings && Offset < Count) ? Strings + Offset : NULL;
+  }
+
+  const char* GetActorClass( uint32_t iActor ) const
+  {
+    uint64_t Count;
+    const uint32_t* Classes = GetSection<uint32_t>( LBIN_ActorClass, Count );
+    return (iActor < Count) ? GetString( Classes[iActor] ) : NULL;
+  }
+
+  const char* GetActorName( uint32_t iActor ) const
+  {
+    uint64_t Count;
+    const uint32_t* Names = GetSection<uint32_t>( LBIN_ActorName, Count );
+    return (iActor < Count) ? GetString( Names[iActor] ) : NULL;
+  }
+
+  // Finds a column by name, and by value type unless Type is ~0
+  const FLevelBinColumn* FindColumn( const char* Name, uint32_t Type = ~0u ) const
+  {
+    uint64_t Count;
+    const FLevelBinColumn* Columns = GetSection<FLevelBinColumn>( LBIN_Columns, Count );
+    for ( uint64_t i = 0; i < Count; i++ )
+    {
+      if ( Type != ~0u && Columns[i].Type != Type )
+        continue;
+
+      const char* ColName = GetString( Columns[i].Name );
+      if ( ColName && strcmp( ColName, Name ) == 0 )
+        return &Columns[i];
+    }
+    return NULL;
+  }
+
+  // Returns a pointer to an actor's value in a column, or NULL if that
+  // actor uses the default value
+  const void* GetValue( const FLevelBinColumn* Column, uint32_t iActor ) const
+  {
+    uint64_t Count;
+    const uint8_t* ColumnData = GetSection<uint8_t>( LBIN_ColumnData, Count );
+    if ( ColumnData == NULL || iActor >= Header->NumActors )
+      return NULL;
+
+    uint64_t MaskSize = (Header->NumActors + 7) / 8;
+    uint64_t DataSize = (uint64_t)Header->NumActors * Column->ValueSize;
+    if ( Column->MaskOffset > Count || MaskSize > Count - Column->MaskOffset ||
+         Column->DataOffset > Count || DataSize > Count - Column->DataOffset )
+      return NULL;
+
+    if ( !(ColumnData[Column->MaskOffset + (iActor >> 3)] & (1 << (iActor & 7))) )
+      return NULL;
+
+    return ColumnData + Column->DataOffset + (uint64_t)iActor * Column->ValueSize;
+  }
+
+private:
+  const uint8_t* Data;
+  uint64_t Size;
+  const FLevelBinHeader* Header;
+  const FLevelBinSection* Sections;
+};
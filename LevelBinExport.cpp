@@ -0,0 +1,425 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * LevelBinExport.cpp - Exports a level to the binary format in LevelBin.h
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "lucc.h"
+#include "LevelBin.h"
+
+/*-----------------------------------------------------------------------------
+ * levelexport binary helpers
+-----------------------------------------------------------------------------*/
+struct FStringPool
+{
+  std::unordered_map<std::string, u32> Offsets;
+  std::vector<char> Data;
+
+  u32 Add( const char* Str )
+  {
+    auto It = Offsets.find( Str );
+    if ( It != Offsets.end() )
+      return It->second;
+
+    u32 Offset = (u32)Data.size();
+    Data.insert( Data.end(), Str, Str + strlen( Str ) + 1 );
+    Offsets[Str] = Offset;
+    return Offset;
+  }
+};
+
+struct FBinColumn
+{
+  u32 Name;
+  u32 Type;
+  u32 ValueSize;
+  std::vector<u8> Values;
+  std::vector<u8> Mask;
+};
+
+struct FBinSection
+{
+  u32 Id;
+  u32 ElementSize;
+  u64 Count;
+  const void* Data;
+};
+
+static u32 AddObjectRef( FStringPool& Pool, FTextBuffer& Tmp, UObject* Obj, UPackage* MapPkg )
+{
+  if ( Obj == NULL )
+    return MAX_UINT32;
+
+  Tmp.Len = 0;
+  WriteObjectRef( Tmp, Obj, MapPkg );
+  Tmp.Write( "", 1 );
+  return Pool.Add( Tmp.Data );
+}
+
+static FLevelBinVector ToBinVector( FVector& Vec )
+{
+  FLevelBinVector Out = { Vec.X, Vec.Y, Vec.Z };
+  return Out;
+}
+
+// Maps a property to a column value type; returns false if it has none
+static bool GetColumnType( UProperty* Prop, u32& OutType, u32& OutSize )
+{
+  switch ( Prop->PropertyType )
+  {
+  case PROP_Byte:    OutType = LBIN_Byte;    OutSize = 1; return true;
+  case PROP_Int:     OutType = LBIN_Int;     OutSize = 4; return true;
+  case PROP_Bool:    OutType = LBIN_Bool;    OutSize = 1; return true;
+  case PROP_Float:   OutType = LBIN_Float;   OutSize = 4; return true;
+  case PROP_Name:    OutType = LBIN_Name;    OutSize = 4; return true;
+  case PROP_String:  OutType = LBIN_String;  OutSize = 4; return true;
+  case PROP_Object:
+  case PROP_Class:   OutType = LBIN_Object;  OutSize = 4; return true;
+  case PROP_Vector:  OutType = LBIN_Vector;  OutSize = sizeof( FLevelBinVector ); return true;
+  case PROP_Rotator: OutType = LBIN_Rotator; OutSize = sizeof( FLevelBinRotator ); return true;
+  default:
+    return false;
+  }
+}
+
+static void GetColumnValue( UProperty* Prop, u8* Value, u8* Out, FStringPool& Pool, FTextBuffer& Tmp, UPackage* MapPkg )
+{
+  u32 Offset;
+  switch ( Prop->PropertyType )
+  {
+  case PROP_Byte:
+    *Out = *Value;
+    break;
+  case PROP_Bool:
+    *Out = *(bool*)Value ? 1 : 0;
+    break;
+  case PROP_Int:
+  case PROP_Float:
+    memcpy( Out, Value, 4 );
+    break;
+  case PROP_Name:
+    Offset = Pool.Add( ((FName*)Value)->Data() );
+    memcpy( Out, &Offset, 4 );
+    break;
+  case PROP_String:
+    Offset = Pool.Add( (*(FString**)Value) ? (*(FString**)Value)->Data() : "" );
+    memcpy( Out, &Offset, 4 );
+    break;
+  case PROP_Object:
+  case PROP_Class:
+    Offset = AddObjectRef( Pool, Tmp, *(UObject**)Value, MapPkg );
+    memcpy( Out, &Offset, 4 );
+    break;
+  case PROP_Vector:
+  {
+    FLevelBinVector Vec = ToBinVector( *(FVector*)Value );
+    memcpy( Out, &Vec, sizeof( Vec ) );
+    break;
+  }
+  case PROP_Rotator:
+  {
+    FRotator* Rot = (FRotator*)Value;
+    FLevelBinRotator BinRot = { Rot->Pitch, Rot->Yaw, Rot->Roll };
+    memcpy( Out, &BinRot, sizeof( BinRot ) );
+    break;
+  }
+  }
+}
+
+/*-----------------------------------------------------------------------------
+ * FBinColumnSet
+ * Collects the property columns of all actors. Struct properties are
+ * flattened into one column per member ("MainScale.SheerRate"). Columns are
+ * keyed by name and type, since two classes may declare properties with the
+ * same name but different types
+-----------------------------------------------------------------------------*/
+struct FBinColumnSet
+{
+  FBinColumnSet( FStringPool& InPool, FTextBuffer& InTmp, UPackage* InMapPkg, u32 InNumActors )
+    : Pool( InPool ), Tmp( InTmp ), MapPkg( InMapPkg ), NumActors( InNumActors )
+  {
+  }
+
+  void AddStruct( UStruct* Struct, const std::string& Prefix, u8* Value, u8* Default, u32 iActor )
+  {
+    for ( UStruct* It = Struct; It != NULL; It = It->SuperField )
+    {
+      for ( UField* Field = It->Children; Field != NULL; Field = Field->Next )
+      {
+        UProperty* Prop = SafeCast<UProperty>( Field );
+        if ( Prop == NULL || Prop->Offset == MAX_UINT32 || Prop->Outer != It )
+          continue;
+
+        AddProperty( Prop, Prefix, Value, Default, iActor );
+      }
+    }
+  }
+
+  void AddProperty( UProperty* Prop, const std::string& Prefix, u8* Base, u8* DefaultBase, u32 iActor )
+  {
+    u32 Type = 0, ValueSize = 0;
+    bool bStruct = (Prop->PropertyType == PROP_Struct);
+    if ( !bStruct && !GetColumnType( Prop, Type, ValueSize ) )
+      return;
+
+    for ( int i = 0; i < Prop->ArrayDim; i++ )
+    {
+      u32 Offset = Prop->Offset + (i * Prop->ElementSize);
+      u8* Value = Base + Offset;
+      u8* Default = DefaultBase ? DefaultBase + Offset : NULL;
+
+      std::string ColName = Prefix + Prop->Name.Data();
+      if ( Prop->ArrayDim > 1 )
+        ColName += "(" + std::to_string( i ) + ")";
+
+      if ( bStruct )
+      {
+        AddStruct( ((UStructProperty*)Prop)->Struct, ColName + ".", Value, Default, iActor );
+        continue;
+      }
+
+      if ( IsPropertyDefault( Prop, Value, Default ) )
+        continue;
+
+      std::string Key = ColName + ":" + std::to_string( Type ) + ":" + std::to_string( ValueSize );
+      auto ColIt = Indices.find( Key );
+      if ( ColIt == Indices.end() )
+      {
+        FBinColumn NewColumn;
+        NewColumn.Name = Pool.Add( ColName.c_str() );
+        NewColumn.Type = Type;
+        NewColumn.ValueSize = ValueSize;
+        NewColumn.Values.resize( (size_t)NumActors * ValueSize );
+        NewColumn.Mask.resize( (NumActors + 7) / 8 );
+        ColIt = Indices.insert( std::make_pair( Key, Columns.size() ) ).first;
+        Columns.push_back( NewColumn );
+      }
+
+      FBinColumn& Column = Columns[ColIt->second];
+      GetColumnValue( Prop, Value, &Column.Values[(size_t)iActor * Column.ValueSize], Pool, Tmp, MapPkg );
+      Column.Mask[iActor >> 3] |= 1 << (iActor & 7);
+    }
+  }
+
+  FStringPool& Pool;
+  FTextBuffer& Tmp;
+  UPackage* MapPkg;
+  u32 NumActors;
+  std::vector<FBinColumn> Columns;
+  std::unordered_map<std::string, size_t> Indices;
+};
+
+/*-----------------------------------------------------------------------------
+ * ExportLevelBin
+ * Writes actors as property columns, plus the level's BSP and every brush
+ * polygon as flat arrays (see LevelBin.h for the layout). Actor indices in
+ * the file refer to the actors that passed the filter
+-----------------------------------------------------------------------------*/
+bool ExportLevelBin( ULevel* Level, FActorFilter* Filter, const char* FileName )
+{
+  UPackage* MapPkg = Level->Pkg;
+  bool bWriteBrushes = (Filter == NULL || !Filter->bSkipBrushGeometry);
+  TArray<AActor*> Actors;
+  FilterActors( Level, Filter, Actors );
+
+  u32 NumActors = Actors.Size();
+
+  FStringPool Pool;
+  FTextBuffer Tmp;
+  std::vector<u32> ActorClass( NumActors, MAX_UINT32 );
+  std::vector<u32> ActorName( NumActors, MAX_UINT32 );
+  FBinColumnSet ColumnSet( Pool, Tmp, MapPkg, NumActors );
+  std::vector<FLevelBinPoly> BrushPolys;
+  std::vector<FLevelBinVector> BrushVerts;
+
+  // Actors and their property columns
+  for ( u32 iActor = 0; iActor < NumActors; iActor++ )
+  {
+    AActor* Actor = Actors[iActor];
+    UClass* Class = Actor->Class;
+    ActorClass[iActor] = Pool.Add( Class->Name.Data() );
+    ActorName[iActor] = Pool.Add( Actor->Name.Data() );
+    ColumnSet.AddStruct( Class, "", (u8*)Actor, (u8*)Class->Default, iActor );
+
+    // Brush geometry
+    if ( bWriteBrushes && Actor->IsA( ABrush::StaticClass() ) )
+    {
+      UModel* Brush = ((ABrush*)Actor)->Brush;
+      if ( Brush == NULL || Brush->Polys == NULL )
+        continue;
+
+      TArray<FPoly>& Polys = Brush->Polys->Element;
+      for ( int i = 0; i < Polys.Size(); i++ )
+      {
+        FPoly& Poly = Polys[i];
+        FLevelBinPoly BinPoly;
+        BinPoly.iActor = iActor;
+        BinPoly.Texture = AddObjectRef( Pool, Tmp, Poly.Texture, MapPkg );
+        BinPoly.PolyFlags = Poly.PolyFlags;
+        BinPoly.iLink = Poly.iLink;
+        BinPoly.Base = ToBinVector( Poly.Base );
+        BinPoly.Normal = ToBinVector( Poly.Normal );
+        BinPoly.TextureU = ToBinVector( Poly.TextureU );
+        BinPoly.TextureV = ToBinVector( Poly.TextureV );
+        BinPoly.PanU = Poly.PanU;
+        BinPoly.PanV = Poly.PanV;
+        BinPoly.FirstVertex = (u32)BrushVerts.size();
+        BinPoly.NumVertices = Poly.NumVertices;
+        for ( int j = 0; j < Poly.NumVertices; j++ )
+          BrushVerts.push_back( ToBinVector( Poly.Vertex[j] ) );
+        BrushPolys.push_back( BinPoly );
+      }
+    }
+  }
+
+  // Lay the column data out back to back
+  std::vector<FBinColumn>& Columns = ColumnSet.Columns;
+  std::vector<FLevelBinColumn> BinColumns( Columns.size() );
+  std::vector<u8> ColumnData;
+  for ( size_t i = 0; i < Columns.size(); i++ )
+  {
+    FBinColumn& Column = Columns[i];
+    FLevelBinColumn& BinColumn = BinColumns[i];
+    BinColumn.Name = Column.Name;
+    BinColumn.Type = Column.Type;
+    BinColumn.ValueSize = Column.ValueSize;
+    BinColumn.Pad = 0;
+    BinColumn.DataOffset = ColumnData.size();
+    ColumnData.insert( ColumnData.end(), Column.Values.begin(), Column.Values.end() );
+    BinColumn.MaskOffset = ColumnData.size();
+    ColumnData.insert( ColumnData.end(), Column.Mask.begin(), Column.Mask.end() );
+  }
+
+  // BSP
+  std::vector<FLevelBinVector> Points, Vectors;
+  std::vector<FLevelBinNode> Nodes;
+  std::vector<FLevelBinSurf> Surfs;
+  std::vector<FLevelBinVert> Verts;
+  UModel* Model = Level->Model;
+  if ( Model != NULL )
+  {
+    for ( int i = 0; i < Model->Points.Size(); i++ )
+      Points.push_back( ToBinVector( Model->Points[i] ) );
+
+    for ( int i = 0; i < Model->Vectors.Size(); i++ )
+      Vectors.push_back( ToBinVector( Model->Vectors[i] ) );
+
+    for ( int i = 0; i < Model->Nodes.Size(); i++ )
+    {
+      FBspNode& Node = Model->Nodes[i];
+      FLevelBinNode BinNode;
+      BinNode.Plane[0] = Node.Plane.X;
+      BinNode.Plane[1] = Node.Plane.Y;
+      BinNode.Plane[2] = Node.Plane.Z;
+      BinNode.Plane[3] = Node.Plane.W;
+      BinNode.iVertPool = Node.iVertPool;
+      BinNode.iSurf = Node.iSurf;
+      BinNode.iBack = Node.iBack;
+      BinNode.iFront = Node.iFront;
+      BinNode.iPlane = Node.iPlane;
+      BinNode.NumVertices = Node.NumVertices;
+      BinNode.NodeFlags = Node.NodeFlags;
+      BinNode.iZone[0] = Node.iZone[0];
+      BinNode.iZone[1] = Node.iZone[1];
+      Nodes.push_back( BinNode );
+    }
+
+    for ( int i = 0; i < Model->Surfs.Size(); i++ )
+    {
+      FBspSurf& Surf = Model->Surfs[i];
+      FLevelBinSurf BinSurf;
+      BinSurf.Texture = AddObjectRef( Pool, Tmp, Surf.Texture, MapPkg );
+      BinSurf.PolyFlags = Surf.PolyFlags;
+      BinSurf.pBase = Surf.pBase;
+      BinSurf.vNormal = Surf.vNormal;
+      BinSurf.vTextureU = Surf.vTextureU;
+      BinSurf.vTextureV = Surf.vTextureV;
+      BinSurf.iLightMap = Surf.iLightMap;
+      BinSurf.iBrushPoly = Surf.iBrushPoly;
+      BinSurf.PanU = Surf.PanU;
+      BinSurf.PanV = Surf.PanV;
+      Surfs.push_back( BinSurf );
+    }
+
+    for ( int i = 0; i < Model->Verts.Size(); i++ )
+    {
+      FLevelBinVert BinVert = { Model->Verts[i].pVertex, Model->Verts[i].iSide };
+      Verts.push_back( BinVert );
+    }
+  }
+
+  FBinSection Sections[] =
+  {
+    { LBIN_Strings,     1,                          Pool.Data.size(),  Pool.Data.data() },
+    { LBIN_ActorClass,  sizeof( u32 ),              ActorClass.size(), ActorClass.data() },
+    { LBIN_ActorName,   sizeof( u32 ),              ActorName.size(),  ActorName.data() },
+    { LBIN_Columns,     sizeof( FLevelBinColumn ),  BinColumns.size(), BinColumns.data() },
+    { LBIN_ColumnData,  1,                          ColumnData.size(), ColumnData.data() },
+    { LBIN_Points,      sizeof( FLevelBinVector ),  Points.size(),     Points.data() },
+    { LBIN_Vectors,     sizeof( FLevelBinVector ),  Vectors.size(),    Vectors.data() },
+    { LBIN_Nodes,       sizeof( FLevelBinNode ),    Nodes.size(),      Nodes.data() },
+    { LBIN_Surfs,       sizeof( FLevelBinSurf ),    Surfs.size(),      Surfs.data() },
+    { LBIN_Verts,       sizeof( FLevelBinVert ),    Verts.size(),      Verts.data() },
+    { LBIN_BrushPolys,  sizeof( FLevelBinPoly ),    BrushPolys.size(), BrushPolys.data() },
+    { LBIN_BrushVerts,  sizeof( FLevelBinVector ),  BrushVerts.size(), BrushVerts.data() },
+  };
+  const u32 NumSections = sizeof( Sections ) / sizeof( Sections[0] );
+
+  // Build the offset table
+  FLevelBinHeader Header = { LBIN_MAGIC, LBIN_VERSION, NumSections, NumActors };
+  FLevelBinSection Table[NumSections];
+  u64 Offset = sizeof( Header ) + sizeof( Table );
+  for ( u32 i = 0; i < NumSections; i++ )
+  {
+    Offset = (Offset + 7) & ~7ULL;
+    Table[i].Id = Sections[i].Id;
+    Table[i].ElementSize = Sections[i].ElementSize;
+    Table[i].Offset = Offset;
+    Table[i].Count = Sections[i].Count;
+    Offset += Sections[i].Count * Sections[i].ElementSize;
+  }
+
+  FILE* File = fopen( FileName, "wb" );
+  if ( File == NULL )
+  {
+    GLogf( LOG_ERR, "Failed to open '%s' for writing", FileName );
+    return false;
+  }
+
+  static const u8 Padding[8] = { 0 };
+  fwrite( &Header, sizeof( Header ), 1, File );
+  fwrite( Table, sizeof( Table ), 1, File );
+  u64 Written = sizeof( Header ) + sizeof( Table );
+  for ( u32 i = 0; i < NumSections; i++ )
+  {
+    fwrite( Padding, 1, Table[i].Offset - Written, File );
+    fwrite( Sections[i].Data, Sections[i].ElementSize, Sections[i].Count, File );
+    Written = Table[i].Offset + Sections[i].Count * Sections[i].ElementSize;
+  }
+
+  bool bOk = ferror( File ) == 0;
+  fclose( File );
+  return bOk;
+}
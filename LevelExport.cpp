@@ -26,11 +26,55 @@
 #include "lucc.h"
 
 int DoFullPkgExport( UPackage* Pkg, char* Path, bool bUseGroupPath );
+int DoDependencyExport( UPackage* MapPkg, char* Path );
+
+/*-----------------------------------------------------------------------------
+ * FActorFilter
+-----------------------------------------------------------------------------*/
+FActorFilter::FActorFilter()
+  : bUseBox( false ), bSkipBrushGeometry( false )
+{
+}
+
+bool FActorFilter::Matches( AActor* Actor )
+{
+  if ( bUseBox )
+  {
+    FVector& Loc = Actor->Location;
+    if ( Loc.X < BoxMin.X || Loc.Y < BoxMin.Y || Loc.Z < BoxMin.Z ||
+         Loc.X > BoxMax.X || Loc.Y > BoxMax.Y || Loc.Z > BoxMax.Z )
+      return false;
+  }
+
+  if ( Classes.Size() == 0 )
+    return true;
+
+  // Match the class itself or any class it inherits from
+  for ( UStruct* Struct = Actor->Class; Struct != NULL; Struct = Struct->SuperField )
+    for ( int i = 0; i < Classes.Size(); i++ )
+      if ( stricmp( Struct->Name.Data(), Classes[i] ) == 0 )
+        return true;
+
+  return false;
+}
+
+void FilterActors( ULevel* Level, FActorFilter* Filter, TArray<AActor*>& OutActors )
+{
+  for ( int i = 0; i < Level->Actors.Size(); i++ )
+  {
+    AActor* Actor = Level->Actors[i];
+    if ( Actor != NULL && (Filter == NULL || Filter->Matches( Actor )) )
+      OutActors.PushBack( Actor );
+  }
+}
 
 int levelexport( int argc, char** argv )
 {
   int i = 0;
   bool bExportMyLevelAssets = false;
+  bool bExportDependencies = false;
+  char* LevelType = NULL;
+  FActorFilter Filter;
 
   // Argument parsing
   while ( 1 )
@@ -44,6 +88,19 @@ int levelexport( int argc, char** argv )
       printf( "Command options:\n" );
       printf( "\t-p \"<ExportPath>\"   - Specifies a folder (p)ath to export to\n" );
       printf( "\t-m                    - Exports all (m)yLevel assets as well as a t3d file\n" );
+      printf( "\t-d                    - Exports every asset the map uses from other packages (d)ependencies\n" );
+      printf( "\t-t \"<LevelFormat>\"   - Specifies a level (t)ype to export to (default to t3d)\n" );
+      printf( "\t   Level Formats:\n" );
+      printf( "\t   \"t3d\"  - Unreal Text Format, as written by the editor\n" );
+      printf( "\t   \"t3dstream\" - Unreal Text Format, streamed out by lucc itself\n" );
+      printf( "\t   \"t3dcheck\"  - Writes both of the above and compares them\n" );
+      printf( "\t   \"bin\"  - lucc binary level format (see LevelBin.h)\n" );
+      printf( "\t   \"obj\"  - BSP world geometry as Waveform Obj\n" );
+      printf( "\t   \"glb\"  - BSP world geometry as binary glTF\n" );
+      printf( "\t-c \"<Class,...>\"    - Only exports actors of these (c)lasses or their subclasses\n" );
+      printf( "\t-b \"<Box>\"          - Only exports actors inside a (b)ox given as\n" );
+      printf( "\t                        \"MinX,MinY,MinZ,MaxX,MaxY,MaxZ\"\n" );
+      printf( "\t-n                    - Does (n)ot export brush geometry\n" );
       printf( "\n" );
       return ERR_BAD_ARGS;
     }
@@ -66,6 +123,28 @@ int levelexport( int argc, char** argv )
       case 'm':
         bExportMyLevelAssets = true;
         break;
+      case 'd':
+        bExportDependencies = true;
+        break;
+      case 't':
+        LevelType = argv[++i];
+        break;
+      case 'c':
+        for ( char* Class = strtok( argv[++i], "," ); Class != NULL; Class = strtok( NULL, "," ) )
+          Filter.Classes.PushBack( Class );
+        break;
+      case 'b':
+        if ( sscanf( argv[++i], "%f,%f,%f,%f,%f,%f", &Filter.BoxMin.X, &Filter.BoxMin.Y, &Filter.BoxMin.Z,
+             &Filter.BoxMax.X, &Filter.BoxMax.Y, &Filter.BoxMax.Z ) != 6 )
+        {
+          GLogf( LOG_WARN, "Bad box '%s'", argv[i] );
+          goto BadOpt;
+        }
+        Filter.bUseBox = true;
+        break;
+      case 'n':
+        Filter.bSkipBrushGeometry = true;
+        break;
       default:
         GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
         goto BadOpt;
@@ -80,10 +159,30 @@ int levelexport( int argc, char** argv )
     i++;
   }
 
+  if ( LevelType == NULL )
+    LevelType = (char*)"t3d";
+
+  if ( stricmp( LevelType, "t3d" ) != 0 && stricmp( LevelType, "t3dstream" ) != 0 &&
+       stricmp( LevelType, "t3dcheck" ) != 0 && stricmp( LevelType, "bin" ) != 0 &&
+       stricmp( LevelType, "obj" ) != 0 && stricmp( LevelType, "glb" ) != 0 )
+  {
+    GLogf( LOG_CRIT, "Unknown level format '%s'", LevelType );
+    goto BadOpt;
+  }
+
+  // The editor's exporter always writes the whole level, and the geometry
+  // formats only have the BSP, no actors
+  if ( (Filter.Classes.Size() > 0 || Filter.bUseBox || Filter.bSkipBrushGeometry) &&
+       stricmp( LevelType, "t3dstream" ) != 0 && stricmp( LevelType, "bin" ) != 0 )
+  {
+    GLogf( LOG_CRIT, "Options -c, -b and -n need the \"t3dstream\" or \"bin\" format" );
+    goto BadOpt;
+  }
+
   if ( Path[0] == '\0' )
     strcat( Path, "../Maps/" );
 
-  if ( bExportMyLevelAssets )
+  if ( bExportMyLevelAssets || bExportDependencies )
     strcat( Path, PkgName );
 
   if ( !USystem::MakeDir( Path ) )
@@ -94,22 +193,86 @@ int levelexport( int argc, char** argv )
   }
 
   // Load package
-  UPackage* Pkg = UPackage::StaticLoadPackage( PkgName );
+  FPackagePrefetcher Prefetcher;
+  UPackage* Pkg = LoadPackageWithPrefetch( PkgName, Prefetcher );
   if ( Pkg == NULL )
-  {
-    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist", PkgName );
     return ERR_MISSING_PKG;
-  }
 
   GLogf( LOG_INFO, "Running levelexport on package '%s' to '%s'", PkgName, Path );
 
   // Load level object and export
   ULevel* Level = (ULevel*)UObject::StaticLoadObject( Pkg, "MyLevel", ULevel::StaticClass(), NULL );
-  ULevelExporter::ExportObject( Level, Path, NULL );
+  if ( Level == NULL )
+  {
+    GLogf( LOG_CRIT, "Failed to load level from package '%s'", PkgName );
+    return ERR_BAD_OBJECT;
+  }
+
+  char FileName[4096];
+  if ( stricmp( LevelType, "bin" ) == 0 )
+  {
+    snprintf( FileName, sizeof( FileName ), "%s/%s.lbin", Path, PkgName );
+    if ( !ExportLevelBin( Level, &Filter, FileName ) )
+      return ERR_EXPORT_FAILED;
+  }
+  else if ( stricmp( LevelType, "obj" ) == 0 || stricmp( LevelType, "glb" ) == 0 )
+  {
+    snprintf( FileName, sizeof( FileName ), "%s/%s.%s", Path, PkgName, LevelType );
+    if ( !ExportLevelGeometry( Level, FileName, stricmp( LevelType, "glb" ) == 0 ) )
+      return ERR_EXPORT_FAILED;
+  }
+  else if ( stricmp( LevelType, "t3dstream" ) == 0 )
+  {
+    snprintf( FileName, sizeof( FileName ), "%s/%s.t3d", Path, PkgName );
+    if ( !ExportLevelT3D( Level, &Filter, FileName ) )
+      return ERR_EXPORT_FAILED;
+  }
+  else if ( stricmp( LevelType, "t3dcheck" ) == 0 )
+  {
+    // The editor's exporter picks its own file name, so it gets a folder of
+    // its own to find the file in afterwards
+    char CheckPath[4096];
+    TArray<char*> Names;
+    snprintf( CheckPath, sizeof( CheckPath ), "%s/T3DCheck", Path );
+    if ( !USystem::MakeDir( CheckPath ) )
+    {
+      GLogf( LOG_CRIT, "Failed to create output folder '%s'", CheckPath );
+      return ERR_BAD_PATH;
+    }
+
+    ULevelExporter::ExportObject( Level, CheckPath, NULL );
+    FindPackageFiles( CheckPath, ".t3d", Names );
+    if ( Names.Size() != 1 )
+    {
+      GLogf( LOG_CRIT, "Expected one .t3d file from ULevelExporter in '%s', found %i", CheckPath, (int)Names.Size() );
+      return ERR_EXPORT_FAILED;
+    }
+
+    char ExpectedFile[4096];
+    snprintf( ExpectedFile, sizeof( ExpectedFile ), "%s/%s.t3d", CheckPath, Names[0] );
+    snprintf( FileName, sizeof( FileName ), "%s/%s.t3d", Path, PkgName );
+    for ( int j = 0; j < Names.Size(); j++ )
+      free( Names[j] );
+
+    if ( !ExportLevelT3D( Level, NULL, FileName ) )
+      return ERR_EXPORT_FAILED;
+
+    if ( !CompareT3DFiles( ExpectedFile, FileName ) )
+      return ERR_EXPORT_FAILED;
+
+    GLogf( LOG_INFO, "T3D output matches ULevelExporter" );
+  }
+  else
+  {
+    ULevelExporter::ExportObject( Level, Path, NULL );
+  }
 
   if ( bExportMyLevelAssets )
     DoFullPkgExport( Pkg, Path, false );
 
+  if ( bExportDependencies )
+    DoDependencyExport( Pkg, Path );
+
   return 0;
 }
 
@@ -0,0 +1,522 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * LevelGeomExport.cpp - Exports a level's BSP geometry to .obj or .glb
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <math.h>
+#include <vector>
+#include <unordered_map>
+#include "lucc.h"
+
+// Surface flags that mean a surface is never drawn
+#define SURF_Invisible 0x00000001
+#define SURF_Portal    0x04000000
+
+/*-----------------------------------------------------------------------------
+ * FGeomVertex
+ * Positions and normals are converted from Unreal's left handed Z up space
+ * to the right handed Y up space used by .obj and .glb by swapping Y and Z
+-----------------------------------------------------------------------------*/
+struct FGeomVertex
+{
+  float Pos[3];
+  float Normal[3];
+  float UV[2];
+};
+
+/*-----------------------------------------------------------------------------
+ * FVertexWelder
+ * Merges vertices that are within a small distance of each other and have
+ * the same normal and texture coordinates. Vertices are bucketed in a hash
+ * grid with cells the size of the weld distance, so a lookup only has to
+ * check the 27 cells around a position
+-----------------------------------------------------------------------------*/
+#define WELD_DISTANCE 0.01f
+#define WELD_NORMAL   0.999f
+#define WELD_UV       0.0001f
+
+class FVertexWelder
+{
+public:
+  std::vector<FGeomVertex> Verts;
+
+  u32 Add( const FGeomVertex& Vert )
+  {
+    int Cell[3];
+    for ( int i = 0; i < 3; i++ )
+      Cell[i] = (int)floorf( Vert.Pos[i] / WELD_DISTANCE );
+
+    for ( int X = -1; X <= 1; X++ )
+    {
+      for ( int Y = -1; Y <= 1; Y++ )
+      {
+        for ( int Z = -1; Z <= 1; Z++ )
+        {
+          auto Range = Grid.equal_range( HashCell( Cell[0] + X, Cell[1] + Y, Cell[2] + Z ) );
+          for ( auto It = Range.first; It != Range.second; ++It )
+            if ( IsSame( Verts[It->second], Vert ) )
+              return It->second;
+        }
+      }
+    }
+
+    u32 Index = (u32)Verts.size();
+    Verts.push_back( Vert );
+    Grid.insert( std::make_pair( HashCell( Cell[0], Cell[1], Cell[2] ), Index ) );
+    return Index;
+  }
+
+private:
+  std::unordered_multimap<u64, u32> Grid;
+
+  static u64 HashCell( int X, int Y, int Z )
+  {
+    return ((u64)(u32)X * 73856093ULL) ^ ((u64)(u32)Y * 19349663ULL) ^ ((u64)(u32)Z * 83492791ULL);
+  }
+
+  static bool IsSame( const FGeomVertex& A, const FGeomVertex& B )
+  {
+    float DX = A.Pos[0] - B.Pos[0];
+    float DY = A.Pos[1] - B.Pos[1];
+    float DZ = A.Pos[2] - B.Pos[2];
+    if ( DX*DX + DY*DY + DZ*DZ > WELD_DISTANCE * WELD_DISTANCE )
+      return false;
+
+    float Dot = A.Normal[0]*B.Normal[0] + A.Normal[1]*B.Normal[1] + A.Normal[2]*B.Normal[2];
+    if ( Dot < WELD_NORMAL )
+      return false;
+
+    return fabsf( A.UV[0] - B.UV[0] ) <= WELD_UV && fabsf( A.UV[1] - B.UV[1] ) <= WELD_UV;
+  }
+};
+
+/*-----------------------------------------------------------------------------
+ * OptimizeVertexCache
+ * Tom Forsyth's linear-speed vertex cache optimisation. Triangles are picked
+ * greedily by a score that favours vertices that were used recently and
+ * vertices that have few triangles left to draw
+-----------------------------------------------------------------------------*/
+#define VCACHE_SIZE 32
+
+static float VertexScore( int CachePos, int NumTrisLeft )
+{
+  if ( NumTrisLeft == 0 )
+    return -1.0f;
+
+  float Score = 0.0f;
+  if ( CachePos >= 0 )
+  {
+    // The last triangle's vertices get a fixed score so it is not reused right away
+    if ( CachePos < 3 )
+      Score = 0.75f;
+    else
+      Score = powf( 1.0f - (float)(CachePos - 3) / (VCACHE_SIZE - 3), 1.5f );
+  }
+
+  return Score + 2.0f / sqrtf( (float)NumTrisLeft );
+}
+
+void OptimizeVertexCache( u32* Indices, int NumIndices )
+{
+  int NumTris = NumIndices / 3;
+  if ( NumTris == 0 )
+    return;
+
+  // Work on compact local vertex numbers so the cost only depends on the
+  // size of this index list
+  std::unordered_map<u32, int> LocalIndices;
+  std::vector<u32> GlobalIndices;
+  std::vector<int> Local( NumIndices );
+  for ( int i = 0; i < NumIndices; i++ )
+  {
+    auto It = LocalIndices.find( Indices[i] );
+    if ( It == LocalIndices.end() )
+    {
+      It = LocalIndices.insert( std::make_pair( Indices[i], (int)GlobalIndices.size() ) ).first;
+      GlobalIndices.push_back( Indices[i] );
+    }
+    Local[i] = It->second;
+  }
+  int NumVerts = GlobalIndices.size();
+
+  std::vector<int> TrisLeft( NumVerts, 0 );
+  std::vector<int> CachePos( NumVerts, -1 );
+  std::vector<float> VertScore( NumVerts );
+  std::vector<int> AdjStart( NumVerts + 1, 0 );
+  std::vector<int> Adj( NumIndices );
+  std::vector<float> TriScore( NumTris );
+  std::vector<bool> bEmitted( NumTris, false );
+  std::vector<u32> Output;
+  Output.reserve( NumIndices );
+
+  // Build vertex to triangle adjacency
+  for ( int i = 0; i < NumIndices; i++ )
+    TrisLeft[Local[i]]++;
+
+  for ( int i = 0; i < NumVerts; i++ )
+  {
+    AdjStart[i + 1] = AdjStart[i] + TrisLeft[i];
+    VertScore[i] = VertexScore( -1, TrisLeft[i] );
+  }
+
+  std::vector<int> AdjFill( AdjStart.begin(), AdjStart.end() - 1 );
+  for ( int i = 0; i < NumIndices; i++ )
+    Adj[AdjFill[Local[i]]++] = i / 3;
+
+  for ( int i = 0; i < NumTris; i++ )
+    TriScore[i] = VertScore[Local[i*3]] + VertScore[Local[i*3+1]] + VertScore[Local[i*3+2]];
+
+  int Cache[VCACHE_SIZE + 3];
+  int CacheSize = 0;
+  int NextScan = 0;
+
+  for ( int Emitted = 0; Emitted < NumTris; Emitted++ )
+  {
+    // Best triangle touching the cache, or the next unemitted one
+    int BestTri = -1;
+    float BestScore = -1.0f;
+    for ( int i = 0; i < CacheSize; i++ )
+    {
+      int Vert = Cache[i];
+      for ( int j = AdjStart[Vert]; j < AdjStart[Vert + 1]; j++ )
+      {
+        int Tri = Adj[j];
+        if ( !bEmitted[Tri] && TriScore[Tri] > BestScore )
+        {
+          BestScore = TriScore[Tri];
+          BestTri = Tri;
+        }
+      }
+    }
+
+    if ( BestTri < 0 )
+    {
+      while ( bEmitted[NextScan] )
+        NextScan++;
+      BestTri = NextScan;
+    }
+
+    bEmitted[BestTri] = true;
+    int* Tri = &Local[BestTri * 3];
+    Output.push_back( GlobalIndices[Tri[0]] );
+    Output.push_back( GlobalIndices[Tri[1]] );
+    Output.push_back( GlobalIndices[Tri[2]] );
+
+    // Move the triangle's vertices to the front of the cache
+    int NewCache[VCACHE_SIZE + 3];
+    int NewSize = 0;
+    for ( int i = 0; i < 3; i++ )
+    {
+      NewCache[NewSize++] = Tri[i];
+      TrisLeft[Tri[i]]--;
+    }
+    for ( int i = 0; i < CacheSize; i++ )
+      if ( Cache[i] != Tri[0] && Cache[i] != Tri[1] && Cache[i] != Tri[2] )
+        NewCache[NewSize++] = Cache[i];
+
+    // Update scores for everything that was or still is in the cache
+    for ( int i = 0; i < NewSize; i++ )
+    {
+      int Vert = NewCache[i];
+      CachePos[Vert] = (i < VCACHE_SIZE) ? i : -1;
+      VertScore[Vert] = VertexScore( CachePos[Vert], TrisLeft[Vert] );
+    }
+    for ( int i = 0; i < NewSize; i++ )
+    {
+      int Vert = NewCache[i];
+      for ( int j = AdjStart[Vert]; j < AdjStart[Vert + 1]; j++ )
+      {
+        int T = Adj[j];
+        if ( !bEmitted[T] )
+          TriScore[T] = VertScore[Local[T*3]] + VertScore[Local[T*3+1]] + VertScore[Local[T*3+2]];
+      }
+    }
+
+    CacheSize = (NewSize < VCACHE_SIZE) ? NewSize : VCACHE_SIZE;
+    memcpy( Cache, NewCache, CacheSize * sizeof( int ) );
+  }
+
+  memcpy( Indices, Output.data(), NumIndices * sizeof( u32 ) );
+}
+
+/*-----------------------------------------------------------------------------
+ * Geometry gathering
+-----------------------------------------------------------------------------*/
+struct FGeomGroup
+{
+  UTexture* Texture;
+  std::vector<u32> Indices;
+};
+
+static void ToOutputSpace( const FVector& In, float* Out )
+{
+  Out[0] = In.X;
+  Out[1] = In.Z;
+  Out[2] = In.Y;
+}
+
+static float Dot( const FVector& A, const FVector& B )
+{
+  return A.X*B.X + A.Y*B.Y + A.Z*B.Z;
+}
+
+// Collects every visible BSP node as triangles, grouped by texture
+static void GatherLevelGeometry( UModel* Model, FVertexWelder& Welder, std::vector<FGeomGroup>& Groups )
+{
+  std::unordered_map<UTexture*, size_t> GroupIndices;
+
+  for ( int i = 0; i < Model->Nodes.Size(); i++ )
+  {
+    FBspNode& Node = Model->Nodes[i];
+    if ( Node.NumVertices < 3 || Node.iSurf < 0 )
+      continue;
+
+    FBspSurf& Surf = Model->Surfs[Node.iSurf];
+    if ( Surf.PolyFlags & (SURF_Invisible | SURF_Portal) )
+      continue;
+
+    auto GroupIt = GroupIndices.find( Surf.Texture );
+    if ( GroupIt == GroupIndices.end() )
+    {
+      FGeomGroup NewGroup;
+      NewGroup.Texture = Surf.Texture;
+      GroupIt = GroupIndices.insert( std::make_pair( Surf.Texture, Groups.size() ) ).first;
+      Groups.push_back( NewGroup );
+    }
+    FGeomGroup& Group = Groups[GroupIt->second];
+
+    FVector& Base = Model->Points[Surf.pBase];
+    FVector& Normal = Model->Vectors[Surf.vNormal];
+    FVector& TexU = Model->Vectors[Surf.vTextureU];
+    FVector& TexV = Model->Vectors[Surf.vTextureV];
+    float USize = (Surf.Texture && Surf.Texture->USize > 0) ? (float)Surf.Texture->USize : 1.0f;
+    float VSize = (Surf.Texture && Surf.Texture->VSize > 0) ? (float)Surf.Texture->VSize : 1.0f;
+
+    u32 NodeVerts[256];
+    for ( int j = 0; j < Node.NumVertices; j++ )
+    {
+      FVector& Point = Model->Points[Model->Verts[Node.iVertPool + j].pVertex];
+      FVector Delta( Point.X - Base.X, Point.Y - Base.Y, Point.Z - Base.Z );
+
+      FGeomVertex Vert;
+      ToOutputSpace( Point, Vert.Pos );
+      ToOutputSpace( Normal, Vert.Normal );
+      Vert.UV[0] = (Dot( Delta, TexU ) + Surf.PanU) / USize;
+      Vert.UV[1] = (Dot( Delta, TexV ) + Surf.PanV) / VSize;
+      NodeVerts[j] = Welder.Add( Vert );
+    }
+
+    // Nodes are convex, so a fan covers them
+    for ( int j = 2; j < Node.NumVertices; j++ )
+    {
+      Group.Indices.push_back( NodeVerts[0] );
+      Group.Indices.push_back( NodeVerts[j - 1] );
+      Group.Indices.push_back( NodeVerts[j] );
+    }
+  }
+}
+
+static const char* GetTextureName( UTexture* Texture )
+{
+  return Texture ? Texture->Name.Data() : "None";
+}
+
+/*-----------------------------------------------------------------------------
+ * Writers
+-----------------------------------------------------------------------------*/
+static bool WriteObj( const char* FileName, FVertexWelder& Welder, std::vector<FGeomGroup>& Groups )
+{
+  FILE* File = fopen( FileName, "wb" );
+  if ( File == NULL )
+  {
+    GLogf( LOG_ERR, "Failed to open '%s' for writing", FileName );
+    return false;
+  }
+
+  {
+    FTextBuffer Out( File );
+    Out.Write( "# Exported by lucc\n" );
+
+    std::vector<FGeomVertex>& Verts = Welder.Verts;
+    for ( size_t i = 0; i < Verts.size(); i++ )
+    {
+      Out.Write( "v " );
+      Out.WriteFloat( Verts[i].Pos[0] );
+      Out.Write( " " );
+      Out.WriteFloat( Verts[i].Pos[1] );
+      Out.Write( " " );
+      Out.WriteFloat( Verts[i].Pos[2] );
+      Out.Write( "\nvt " );
+      Out.WriteFloat( Verts[i].UV[0] );
+      Out.Write( " " );
+      Out.WriteFloat( 1.0f - Verts[i].UV[1] );
+      Out.Write( "\nvn " );
+      Out.WriteFloat( Verts[i].Normal[0] );
+      Out.Write( " " );
+      Out.WriteFloat( Verts[i].Normal[1] );
+      Out.Write( " " );
+      Out.WriteFloat( Verts[i].Normal[2] );
+      Out.Write( "\n" );
+    }
+
+    for ( size_t i = 0; i < Groups.size(); i++ )
+    {
+      Out.Write( "g " );
+      Out.Write( GetTextureName( Groups[i].Texture ) );
+      Out.Write( "\nusemtl " );
+      Out.Write( GetTextureName( Groups[i].Texture ) );
+      Out.Write( "\n" );
+
+      std::vector<u32>& Indices = Groups[i].Indices;
+      for ( size_t j = 0; j < Indices.size(); j += 3 )
+      {
+        Out.Write( "f" );
+        for ( int k = 0; k < 3; k++ )
+        {
+          i64 Idx = Indices[j + k] + 1;
+          Out.Write( " " );
+          Out.WriteInt( Idx );
+          Out.Write( "/" );
+          Out.WriteInt( Idx );
+          Out.Write( "/" );
+          Out.WriteInt( Idx );
+        }
+        Out.Write( "\n" );
+      }
+    }
+  }
+
+  bool bOk = ferror( File ) == 0;
+  fclose( File );
+  return bOk;
+}
+
+static bool WriteGlb( const char* FileName, FVertexWelder& Welder, std::vector<FGeomGroup>& Groups )
+{
+  std::vector<FGeomVertex>& Verts = Welder.Verts;
+  FGlbWriter Glb;
+
+  float Min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+  float Max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  for ( size_t i = 0; i < Verts.size(); i++ )
+  {
+    for ( int j = 0; j < 3; j++ )
+    {
+      if ( Verts[i].Pos[j] < Min[j] ) Min[j] = Verts[i].Pos[j];
+      if ( Verts[i].Pos[j] > Max[j] ) Max[j] = Verts[i].Pos[j];
+    }
+  }
+
+  std::vector<float> Positions( Verts.size() * 3 );
+  std::vector<float> Normals( Verts.size() * 3 );
+  std::vector<float> UVs( Verts.size() * 2 );
+  for ( size_t i = 0; i < Verts.size(); i++ )
+  {
+    memcpy( &Positions[i*3], Verts[i].Pos, sizeof( float ) * 3 );
+    memcpy( &Normals[i*3], Verts[i].Normal, sizeof( float ) * 3 );
+    memcpy( &UVs[i*2], Verts[i].UV, sizeof( float ) * 2 );
+  }
+
+  // Vertex attributes are shared by every primitive
+  int PosView = Glb.AddBufferView( Positions.data(), Positions.size() * sizeof( float ), GLTF_ARRAY_BUFFER );
+  int NormView = Glb.AddBufferView( Normals.data(), Normals.size() * sizeof( float ), GLTF_ARRAY_BUFFER );
+  int UVView = Glb.AddBufferView( UVs.data(), UVs.size() * sizeof( float ), GLTF_ARRAY_BUFFER );
+  int PosAcc = Glb.AddAccessor( PosView, GLTF_FLOAT, Verts.size(), "VEC3", Min, Max, 3 );
+  int NormAcc = Glb.AddAccessor( NormView, GLTF_FLOAT, Verts.size(), "VEC3" );
+  int UVAcc = Glb.AddAccessor( UVView, GLTF_FLOAT, Verts.size(), "VEC2" );
+
+  FTextBuffer Json;
+  FTextBuffer Materials;
+  Json.Write( "\"meshes\":[{\"name\":\"Level\",\"primitives\":[" );
+  for ( size_t i = 0; i < Groups.size(); i++ )
+  {
+    std::vector<u32>& Indices = Groups[i].Indices;
+    int IdxView = Glb.AddBufferView( Indices.data(), Indices.size() * sizeof( u32 ), GLTF_ELEMENT_ARRAY_BUFFER );
+    int IdxAcc = Glb.AddAccessor( IdxView, GLTF_UNSIGNED_INT, Indices.size(), "SCALAR" );
+
+    if ( i > 0 )
+    {
+      Json.Write( "," );
+      Materials.Write( "," );
+    }
+    Json.Write( "{\"attributes\":{\"POSITION\":" );
+    Json.WriteInt( PosAcc );
+    Json.Write( ",\"NORMAL\":" );
+    Json.WriteInt( NormAcc );
+    Json.Write( ",\"TEXCOORD_0\":" );
+    Json.WriteInt( UVAcc );
+    Json.Write( "},\"indices\":" );
+    Json.WriteInt( IdxAcc );
+    Json.Write( ",\"material\":" );
+    Json.WriteInt( i );
+    Json.Write( "}" );
+
+    Materials.Write( "{\"name\":" );
+    Materials.WriteJsonString( GetTextureName( Groups[i].Texture ) );
+    Materials.Write( "}" );
+  }
+  Json.Write( "]}],\"materials\":[" );
+  Json.Write( Materials.Data, Materials.Len );
+  Json.Write( "],\"nodes\":[{\"mesh\":0}],\"scenes\":[{\"nodes\":[0]}],\"scene\":0" );
+  Json.Write( "", 1 );
+
+  return Glb.Save( FileName, Json.Data );
+}
+
+/*-----------------------------------------------------------------------------
+ * ExportLevelGeometry
+ * Exports the rendered world geometry (the BSP, not the brushes that built
+ * it) as one mesh with a primitive per texture
+-----------------------------------------------------------------------------*/
+bool ExportLevelGeometry( ULevel* Level, const char* FileName, bool bGlb )
+{
+  UModel* Model = Level->Model;
+  if ( Model == NULL )
+  {
+    GLogf( LOG_ERR, "Level has no BSP to export" );
+    return false;
+  }
+
+  FVertexWelder Welder;
+  std::vector<FGeomGroup> Groups;
+  GatherLevelGeometry( Model, Welder, Groups );
+
+  size_t NumTris = 0;
+  for ( size_t i = 0; i < Groups.size(); i++ )
+  {
+    OptimizeVertexCache( Groups[i].Indices.data(), Groups[i].Indices.size() );
+    NumTris += Groups[i].Indices.size() / 3;
+  }
+
+  // glTF doesn't allow a mesh without primitives
+  if ( NumTris == 0 )
+  {
+    GLogf( LOG_ERR, "Level has no visible BSP surfaces to export" );
+    return false;
+  }
+
+  GLogf( LOG_INFO, "Exporting %i vertices and %i triangles in %i texture groups",
+    (int)Welder.Verts.size(), (int)NumTris, (int)Groups.size() );
+
+  return bGlb ? WriteGlb( FileName, Welder, Groups ) : WriteObj( FileName, Welder, Groups );
+}
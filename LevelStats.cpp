@@ -0,0 +1,482 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * LevelStats.cpp - Reports actor, BSP, zone and memory stats for a level
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "lucc.h"
+
+/*-----------------------------------------------------------------------------
+ * Stats gathering
+-----------------------------------------------------------------------------*/
+struct FClassCount
+{
+  UClass* Class;
+  int Count;
+};
+
+struct FTextureUse
+{
+  UTexture* Texture;
+  int NumSurfs;
+  u64 Size;
+};
+
+struct FZoneStats
+{
+  const char* Name;
+  int NumNodes;
+  int NumSurfs;
+  u64 LightTexels;
+};
+
+enum EMemCategory
+{
+  MEM_Actors,
+  MEM_Bsp,
+  MEM_Brushes,
+  MEM_Lightmaps,
+  MEM_Textures,
+  MEM_MAX
+};
+
+static const char* MemCategoryNames[MEM_MAX] =
+{
+  "Actors", "BSP", "Brushes", "Lightmaps", "Textures"
+};
+
+struct FLevelStats
+{
+  int NumActors;
+  std::vector<FClassCount> Classes;
+
+  int NumNodes, NumSurfs, NumVerts, NumPoints, NumVectors, NumPolys;
+  int NumBrushes, NumBrushPolys;
+
+  std::vector<FZoneStats> Zones;
+  int NumLightmaps;
+  u64 LightTexels;
+  u64 LightBytes;
+  int MaxLightU, MaxLightV;
+
+  std::vector<FTextureUse> Textures;
+  u64 Mem[MEM_MAX];
+};
+
+// P8 textures with a full mip chain take 4/3 of the top mip, plus a palette
+u64 EstimateTextureSize( UTexture* Texture )
+{
+  return ((u64)Texture->USize * Texture->VSize * 4) / 3 + 256 * 4;
+}
+
+static void AddTextureUse( std::unordered_map<UTexture*, size_t>& TexMap,
+  std::vector<FTextureUse>& Textures, UTexture* Texture, bool bSurf )
+{
+  if ( Texture == NULL )
+    return;
+
+  std::unordered_map<UTexture*, size_t>::iterator It = TexMap.find( Texture );
+  if ( It == TexMap.end() )
+  {
+    FTextureUse Use;
+    Use.Texture = Texture;
+    Use.NumSurfs = 0;
+    Use.Size = EstimateTextureSize( Texture );
+    It = TexMap.insert( std::make_pair( Texture, Textures.size() ) ).first;
+    Textures.push_back( Use );
+  }
+
+  if ( bSurf )
+    Textures[It->second].NumSurfs++;
+}
+
+static void GatherLevelStats( ULevel* Level, FLevelStats& Stats )
+{
+  memset( Stats.Mem, 0, sizeof( Stats.Mem ) );
+  Stats.NumActors = 0;
+  Stats.NumBrushes = Stats.NumBrushPolys = 0;
+
+  std::unordered_map<UClass*, size_t> ClassMap;
+  std::unordered_map<UTexture*, size_t> TexMap;
+
+  // Actors, and the brushes among them
+  for ( int i = 0; i < Level->Actors.Size(); i++ )
+  {
+    AActor* Actor = Level->Actors[i];
+    if ( Actor == NULL )
+      continue;
+
+    Stats.NumActors++;
+    Stats.Mem[MEM_Actors] += Actor->Class->StructSize;
+
+    std::unordered_map<UClass*, size_t>::iterator It = ClassMap.find( Actor->Class );
+    if ( It == ClassMap.end() )
+    {
+      FClassCount Count = { Actor->Class, 0 };
+      It = ClassMap.insert( std::make_pair( Actor->Class, Stats.Classes.size() ) ).first;
+      Stats.Classes.push_back( Count );
+    }
+    Stats.Classes[It->second].Count++;
+
+    if ( Actor->IsA( ABrush::StaticClass() ) )
+    {
+      UModel* Brush = ((ABrush*)Actor)->Brush;
+      if ( Brush == NULL || Brush->Polys == NULL )
+        continue;
+
+      TArray<FPoly>& Polys = Brush->Polys->Element;
+      Stats.NumBrushes++;
+      Stats.NumBrushPolys += Polys.Size();
+      Stats.Mem[MEM_Brushes] += Polys.Size() * sizeof( FPoly );
+
+      for ( int j = 0; j < Polys.Size(); j++ )
+        AddTextureUse( TexMap, Stats.Textures, Polys[j].Texture, false );
+    }
+  }
+
+  // World BSP
+  UModel* Model = Level->Model;
+  Stats.NumNodes = Model->Nodes.Size();
+  Stats.NumSurfs = Model->Surfs.Size();
+  Stats.NumVerts = Model->Verts.Size();
+  Stats.NumPoints = Model->Points.Size();
+  Stats.NumVectors = Model->Vectors.Size();
+  Stats.NumPolys = (Model->Polys != NULL) ? Model->Polys->Element.Size() : 0;
+  Stats.Mem[MEM_Bsp] = Stats.NumNodes * sizeof( FBspNode ) + Stats.NumSurfs * sizeof( FBspSurf ) +
+    Stats.NumVerts * sizeof( FVert ) + (Stats.NumPoints + Stats.NumVectors) * sizeof( FVector ) +
+    Stats.NumPolys * sizeof( FPoly );
+
+  for ( int i = 0; i < Stats.NumSurfs; i++ )
+    AddTextureUse( TexMap, Stats.Textures, Model->Surfs[i].Texture, true );
+
+  // Zones; zone 0 is everything not inside of a ZoneInfo
+  int NumZones = (Model->NumZones > 0) ? Model->NumZones : 1;
+  Stats.Zones.resize( NumZones );
+  for ( int i = 0; i < NumZones; i++ )
+  {
+    UObject* ZoneActor = Model->Zones[i].ZoneActor;
+    Stats.Zones[i].Name = (ZoneActor != NULL) ? ZoneActor->Name.Data() : "LevelInfo";
+    Stats.Zones[i].NumNodes = 0;
+    Stats.Zones[i].NumSurfs = 0;
+    Stats.Zones[i].LightTexels = 0;
+  }
+
+  // Lightmaps, counted towards the zone of the first node using a surface
+  Stats.NumLightmaps = Model->LightMap.Size();
+  Stats.LightTexels = 0;
+  Stats.LightBytes = Model->LightBits.Size();
+  Stats.MaxLightU = Stats.MaxLightV = 0;
+  for ( int i = 0; i < Stats.NumLightmaps; i++ )
+  {
+    FLightMapIndex& Index = Model->LightMap[i];
+    Stats.LightTexels += (u64)Index.UClamp * Index.VClamp;
+    if ( Index.UClamp * Index.VClamp > Stats.MaxLightU * Stats.MaxLightV )
+    {
+      Stats.MaxLightU = Index.UClamp;
+      Stats.MaxLightV = Index.VClamp;
+    }
+  }
+  Stats.Mem[MEM_Lightmaps] = Stats.NumLightmaps * sizeof( FLightMapIndex ) + Stats.LightBytes;
+
+  std::vector<bool> SurfSeen( Stats.NumSurfs, false );
+  for ( int i = 0; i < Stats.NumNodes; i++ )
+  {
+    FBspNode& Node = Model->Nodes[i];
+    int iZone = Node.iZone[1];
+    if ( iZone >= NumZones )
+      iZone = 0;
+
+    Stats.Zones[iZone].NumNodes++;
+    if ( Node.iSurf < 0 || Node.iSurf >= Stats.NumSurfs || SurfSeen[Node.iSurf] )
+      continue;
+
+    SurfSeen[Node.iSurf] = true;
+    Stats.Zones[iZone].NumSurfs++;
+
+    int iLightMap = Model->Surfs[Node.iSurf].iLightMap;
+    if ( iLightMap >= 0 && iLightMap < Stats.NumLightmaps )
+    {
+      FLightMapIndex& Index = Model->LightMap[iLightMap];
+      Stats.Zones[iZone].LightTexels += (u64)Index.UClamp * Index.VClamp;
+    }
+  }
+
+  for ( size_t i = 0; i < Stats.Textures.size(); i++ )
+    Stats.Mem[MEM_Textures] += Stats.Textures[i].Size;
+
+  // Biggest first
+  std::sort( Stats.Classes.begin(), Stats.Classes.end(),
+    []( const FClassCount& A, const FClassCount& B ) { return A.Count > B.Count; } );
+  std::sort( Stats.Textures.begin(), Stats.Textures.end(),
+    []( const FTextureUse& A, const FTextureUse& B ) { return A.Size > B.Size; } );
+}
+
+/*-----------------------------------------------------------------------------
+ * Stats output
+-----------------------------------------------------------------------------*/
+static void WriteStatsText( FTextBuffer& Out, const char* MapName, FLevelStats& Stats, int MaxTextures )
+{
+  char Line[512];
+
+  snprintf( Line, sizeof( Line ), "Level stats for '%s'\n\n", MapName );
+  Out.Write( Line );
+
+  snprintf( Line, sizeof( Line ), "Actors: %d\n", Stats.NumActors );
+  Out.Write( Line );
+  for ( size_t i = 0; i < Stats.Classes.size(); i++ )
+  {
+    snprintf( Line, sizeof( Line ), "  %-32s %6d\n", Stats.Classes[i].Class->Name.Data(), Stats.Classes[i].Count );
+    Out.Write( Line );
+  }
+
+  snprintf( Line, sizeof( Line ), "\nBSP:\n"
+    "  Nodes    %8d\n  Surfaces %8d\n  Verts    %8d\n  Points   %8d\n  Vectors  %8d\n  Polys    %8d\n"
+    "  Brushes  %8d (%d polys)\n",
+    Stats.NumNodes, Stats.NumSurfs, Stats.NumVerts, Stats.NumPoints, Stats.NumVectors, Stats.NumPolys,
+    Stats.NumBrushes, Stats.NumBrushPolys );
+  Out.Write( Line );
+
+  snprintf( Line, sizeof( Line ), "\nZones: %d\n", (int)Stats.Zones.size() );
+  Out.Write( Line );
+  for ( size_t i = 0; i < Stats.Zones.size(); i++ )
+  {
+    FZoneStats& Zone = Stats.Zones[i];
+    snprintf( Line, sizeof( Line ), "  %2d %-24s %6d nodes %6d surfs %10llu lightmap texels\n",
+      (int)i, Zone.Name, Zone.NumNodes, Zone.NumSurfs, (unsigned long long)Zone.LightTexels );
+    Out.Write( Line );
+  }
+
+  snprintf( Line, sizeof( Line ), "\nLightmaps: %d (%llu texels, %llu bytes, largest %dx%d)\n",
+    Stats.NumLightmaps, (unsigned long long)Stats.LightTexels, (unsigned long long)Stats.LightBytes,
+    Stats.MaxLightU, Stats.MaxLightV );
+  Out.Write( Line );
+
+  u64 TotalMem = 0;
+  Out.Write( "\nEstimated memory:\n" );
+  for ( int i = 0; i < MEM_MAX; i++ )
+  {
+    snprintf( Line, sizeof( Line ), "  %-10s %10.1f KB\n", MemCategoryNames[i], Stats.Mem[i] / 1024.0 );
+    Out.Write( Line );
+    TotalMem += Stats.Mem[i];
+  }
+  snprintf( Line, sizeof( Line ), "  %-10s %10.1f KB\n", "Total", TotalMem / 1024.0 );
+  Out.Write( Line );
+
+  snprintf( Line, sizeof( Line ), "\nHeaviest textures (%d referenced):\n", (int)Stats.Textures.size() );
+  Out.Write( Line );
+  for ( int i = 0; i < (int)Stats.Textures.size() && i < MaxTextures; i++ )
+  {
+    FTextureUse& Use = Stats.Textures[i];
+    snprintf( Line, sizeof( Line ), "  %-40s %4dx%-4d %8.1f KB %6d surfs\n",
+      Use.Texture->Name.Data(), Use.Texture->USize, Use.Texture->VSize, Use.Size / 1024.0, Use.NumSurfs );
+    Out.Write( Line );
+  }
+}
+
+static void WriteStatsJson( FTextBuffer& Out, const char* MapName, FLevelStats& Stats, int MaxTextures )
+{
+  char Line[512];
+
+  Out.Write( "{\n  \"map\": " );
+  Out.WriteJsonString( MapName );
+
+  Out.Write( ",\n  \"actors\": { \"total\": " );
+  Out.WriteInt( Stats.NumActors );
+  Out.Write( ", \"classes\": {" );
+  for ( size_t i = 0; i < Stats.Classes.size(); i++ )
+  {
+    Out.Write( (i == 0) ? "\n    " : ",\n    " );
+    Out.WriteJsonString( Stats.Classes[i].Class->Name.Data() );
+    Out.Write( ": " );
+    Out.WriteInt( Stats.Classes[i].Count );
+  }
+  Out.Write( "\n  } },\n" );
+
+  snprintf( Line, sizeof( Line ), "  \"bsp\": { \"nodes\": %d, \"surfs\": %d, \"verts\": %d, \"points\": %d, "
+    "\"vectors\": %d, \"polys\": %d, \"brushes\": %d, \"brushPolys\": %d },\n",
+    Stats.NumNodes, Stats.NumSurfs, Stats.NumVerts, Stats.NumPoints, Stats.NumVectors, Stats.NumPolys,
+    Stats.NumBrushes, Stats.NumBrushPolys );
+  Out.Write( Line );
+
+  Out.Write( "  \"zones\": [" );
+  for ( size_t i = 0; i < Stats.Zones.size(); i++ )
+  {
+    FZoneStats& Zone = Stats.Zones[i];
+    Out.Write( (i == 0) ? "\n    { \"name\": " : ",\n    { \"name\": " );
+    Out.WriteJsonString( Zone.Name );
+    snprintf( Line, sizeof( Line ), ", \"nodes\": %d, \"surfs\": %d, \"lightTexels\": %llu }",
+      Zone.NumNodes, Zone.NumSurfs, (unsigned long long)Zone.LightTexels );
+    Out.Write( Line );
+  }
+  Out.Write( "\n  ],\n" );
+
+  snprintf( Line, sizeof( Line ), "  \"lightmaps\": { \"count\": %d, \"texels\": %llu, \"bytes\": %llu, "
+    "\"largest\": [%d, %d] },\n", Stats.NumLightmaps, (unsigned long long)Stats.LightTexels,
+    (unsigned long long)Stats.LightBytes, Stats.MaxLightU, Stats.MaxLightV );
+  Out.Write( Line );
+
+  u64 TotalMem = 0;
+  Out.Write( "  \"memory\": {" );
+  for ( int i = 0; i < MEM_MAX; i++ )
+  {
+    snprintf( Line, sizeof( Line ), "%s\n    \"%s\": %llu", (i == 0) ? "" : ",",
+      MemCategoryNames[i], (unsigned long long)Stats.Mem[i] );
+    Out.Write( Line );
+    TotalMem += Stats.Mem[i];
+  }
+  snprintf( Line, sizeof( Line ), ",\n    \"Total\": %llu\n  },\n", (unsigned long long)TotalMem );
+  Out.Write( Line );
+
+  Out.Write( "  \"textures\": [" );
+  for ( int i = 0; i < (int)Stats.Textures.size() && i < MaxTextures; i++ )
+  {
+    FTextureUse& Use = Stats.Textures[i];
+    Out.Write( (i == 0) ? "\n    { \"name\": " : ",\n    { \"name\": " );
+    Out.WriteJsonString( Use.Texture->Name.Data() );
+    Out.Write( ", \"package\": " );
+    Out.WriteJsonString( Use.Texture->Pkg->Name.Data() );
+    snprintf( Line, sizeof( Line ), ", \"width\": %d, \"height\": %d, \"bytes\": %llu, \"surfs\": %d }",
+      Use.Texture->USize, Use.Texture->VSize, (unsigned long long)Use.Size, Use.NumSurfs );
+    Out.Write( Line );
+  }
+  Out.Write( "\n  ]\n}\n" );
+}
+
+/*-----------------------------------------------------------------------------
+ * levelstats
+-----------------------------------------------------------------------------*/
+int levelstats( int argc, char** argv )
+{
+  int i = 0;
+  char* Format = NULL;
+  char* OutFile = NULL;
+  int MaxTextures = 10;
+
+  // Argument parsing
+  while ( 1 )
+  {
+    if ( argc == 0 || i > argc )
+    {
+    BadOpt:
+      printf( "levelstats usage:\n" );
+      printf( "\tlucc [gopts] levelstats [copts] <Map Name>\n\n" );
+
+      printf( "Command options:\n" );
+      printf( "\t-f \"<Format>\"        - Specifies the output (f)ormat, \"text\" (default) or \"json\"\n" );
+      printf( "\t-o \"<File>\"          - Writes the report to a file instead of the console (o)utput\n" );
+      printf( "\t-n <Count>           - Lists this (n)umber of textures (default 10)\n" );
+      printf( "\n" );
+      return ERR_BAD_ARGS;
+    }
+
+    if ( argv[i][0] == '-' )
+    {
+      switch ( argv[i][1] )
+      {
+      case 'f':
+        Format = argv[++i];
+        break;
+      case 'o':
+        OutFile = argv[++i];
+        break;
+      case 'n':
+        MaxTextures = atoi( argv[++i] );
+        break;
+      default:
+        GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
+        goto BadOpt;
+      }
+    }
+    else
+    {
+      PkgName = argv[i];
+      break;
+    }
+
+    i++;
+  }
+
+  bool bJson = false;
+  if ( Format != NULL )
+  {
+    if ( stricmp( Format, "json" ) == 0 )
+      bJson = true;
+    else if ( stricmp( Format, "text" ) != 0 )
+    {
+      GLogf( LOG_CRIT, "Unknown output format '%s'", Format );
+      goto BadOpt;
+    }
+  }
+
+  // Load package
+  FPackagePrefetcher Prefetcher;
+  UPackage* Pkg = LoadPackageWithPrefetch( PkgName, Prefetcher );
+  if ( Pkg == NULL )
+    return ERR_MISSING_PKG;
+
+  ULevel* Level = (ULevel*)UObject::StaticLoadObject( Pkg, "MyLevel", ULevel::StaticClass(), NULL );
+  if ( Level == NULL || Level->Model == NULL )
+  {
+    GLogf( LOG_CRIT, "Failed to load level from package '%s'", PkgName );
+    return ERR_BAD_OBJECT;
+  }
+
+  FLevelStats Stats;
+  GatherLevelStats( Level, Stats );
+
+  FILE* File = stdout;
+  if ( OutFile != NULL )
+  {
+    // Relative to our original working directory
+    char FileName[4096];
+#ifdef _WIN32
+    if ( strchr( OutFile, ':' ) != NULL )
+      strcpy( FileName, OutFile );
+    else
+#endif
+      snprintf( FileName, sizeof( FileName ), "%s/%s", wd, OutFile );
+
+    File = fopen( FileName, "wb" );
+    if ( File == NULL )
+    {
+      GLogf( LOG_CRIT, "Failed to open '%s' for writing", FileName );
+      return ERR_BAD_PATH;
+    }
+  }
+
+  {
+    FTextBuffer Out( File );
+    if ( bJson )
+      WriteStatsJson( Out, PkgName, Stats, MaxTextures );
+    else
+      WriteStatsText( Out, PkgName, Stats, MaxTextures );
+  }
+
+  if ( File != stdout )
+    fclose( File );
+
+  return 0;
+}
+
@@ -23,6 +23,7 @@
  *========================================================================
 */
 
+#include <math.h>
 #include "lucc.h"
 
 bool bLeftMouseHeld;
@@ -30,6 +31,202 @@ bool bRightMouseHeld;
 
 int MouseSpeed = 100;
 
+/*-----------------------------------------------------------------------------
+ * levelviewer benchmark helpers
+-----------------------------------------------------------------------------*/
+#define BENCH_TIMESTEP   (1.0/60.0)
+#define BENCH_CAMSPEED   512.0f
+#define BENCH_MAX_KEYS   64
+#define RAD_TO_UROT      10430.3783f // 65536 rotation units per turn
+
+struct FCameraKey
+{
+  FVector Location;
+  FRotator Rotation;
+};
+
+// Reads a camera path with one "X Y Z Pitch Yaw Roll" key per line
+static int LoadCameraPath( const char* FileName, FCameraKey* Keys, int MaxKeys )
+{
+  FILE* File = fopen( FileName, "r" );
+  if ( File == NULL )
+    return 0;
+
+  char Line[256];
+  int NumKeys = 0;
+  while ( NumKeys < MaxKeys && fgets( Line, sizeof( Line ), File ) != NULL )
+  {
+    FCameraKey& Key = Keys[NumKeys];
+    if ( sscanf( Line, "%f %f %f %i %i %i", &Key.Location.X, &Key.Location.Y, &Key.Location.Z,
+         &Key.Rotation.Pitch, &Key.Rotation.Yaw, &Key.Rotation.Roll ) == 6 )
+      NumKeys++;
+  }
+
+  fclose( File );
+  return NumKeys;
+}
+
+static float SegmentLength( FCameraKey& From, FCameraKey& To )
+{
+  float DX = To.Location.X - From.Location.X;
+  float DY = To.Location.Y - From.Location.Y;
+  float DZ = To.Location.Z - From.Location.Z;
+  return sqrtf( DX*DX + DY*DY + DZ*DZ );
+}
+
+// Builds a path through an even sample of the level's (non-brush) actors,
+// with each key looking towards the next one
+static int GenerateCameraPath( ULevel* Level, FCameraKey* Keys, int MaxKeys )
+{
+  TArray<AActor*> Candidates;
+  for ( int i = 0; i < Level->Actors.Size(); i++ )
+  {
+    AActor* Actor = Level->Actors[i];
+    if ( Actor != NULL && !Actor->IsA( ABrush::StaticClass() ) )
+      Candidates.PushBack( Actor );
+  }
+
+  int NumKeys = Candidates.Size();
+  if ( NumKeys > MaxKeys )
+    NumKeys = MaxKeys;
+
+  for ( int i = 0; i < NumKeys; i++ )
+    Keys[i].Location = Candidates[(i * Candidates.Size()) / NumKeys]->Location;
+
+  for ( int i = 0; i < NumKeys; i++ )
+  {
+    FVector& From = Keys[i].Location;
+    FVector& To = Keys[(i + 1) % NumKeys].Location;
+    float DX = To.X - From.X;
+    float DY = To.Y - From.Y;
+    float DZ = To.Z - From.Z;
+
+    Keys[i].Rotation.Pitch = (int)(atan2f( DZ, sqrtf( DX*DX + DY*DY ) ) * RAD_TO_UROT);
+    Keys[i].Rotation.Yaw   = (int)(atan2f( DY, DX ) * RAD_TO_UROT);
+    Keys[i].Rotation.Roll  = 0;
+  }
+
+  return NumKeys;
+}
+
+// Moves the camera along the path at a constant speed, looping at the end
+static void SampleCameraPath( FCameraKey* Keys, int NumKeys, float Distance, FVector& OutLoc, FRotator& OutRot )
+{
+  float PathLength = 0.0f;
+  for ( int i = 0; i < NumKeys; i++ )
+    PathLength += SegmentLength( Keys[i], Keys[(i + 1) % NumKeys] );
+
+  OutLoc = Keys[0].Location;
+  OutRot = Keys[0].Rotation;
+  if ( PathLength <= 0.0f )
+    return;
+
+  Distance = fmodf( Distance, PathLength );
+  for ( int i = 0; i < NumKeys; i++ )
+  {
+    FCameraKey& From = Keys[i];
+    FCameraKey& To = Keys[(i + 1) % NumKeys];
+    float Length = SegmentLength( From, To );
+
+    if ( Distance <= Length && Length > 0.0f )
+    {
+      float Alpha = Distance / Length;
+      OutLoc.X = From.Location.X + (To.Location.X - From.Location.X) * Alpha;
+      OutLoc.Y = From.Location.Y + (To.Location.Y - From.Location.Y) * Alpha;
+      OutLoc.Z = From.Location.Z + (To.Location.Z - From.Location.Z) * Alpha;
+      OutRot = From.Rotation;
+      return;
+    }
+
+    Distance -= Length;
+  }
+}
+
+static int CompareDouble( const void* A, const void* B )
+{
+  double DA = *(const double*)A;
+  double DB = *(const double*)B;
+  return (DA < DB) ? -1 : (DA > DB) ? 1 : 0;
+}
+
+static double Percentile( double* Sorted, int Num, double Pct )
+{
+  int Idx = (int)(Pct * (Num - 1) + 0.5);
+  return Sorted[Idx];
+}
+
+// Sorts the frame times in place and prints a summary of them
+static void PrintFrameReport( ULevel* Level, const char* Mode, double* FrameTimes, int NumFrames, double TotalTime )
+{
+  qsort( FrameTimes, NumFrames, sizeof( double ), CompareDouble );
+
+  UModel* Model = Level->Model;
+  printf( "levelviewer %s: %s\n", Mode, PkgName );
+  printf( "\tFrames:      %i (%.3f s, %.2f fps)\n", NumFrames, TotalTime, NumFrames / TotalTime );
+  printf( "\tFrame (ms):  min %.3f  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+    FrameTimes[0], Percentile( FrameTimes, NumFrames, 0.50 ), Percentile( FrameTimes, NumFrames, 0.90 ),
+    Percentile( FrameTimes, NumFrames, 0.99 ), FrameTimes[NumFrames - 1] );
+  printf( "\tActors:      %i\n", (int)Level->Actors.Size() );
+  if ( Model != NULL )
+  {
+    printf( "\tBSP nodes:   %i\n", (int)Model->Nodes.Size() );
+    printf( "\tBSP surfs:   %i\n", (int)Model->Surfs.Size() );
+  }
+}
+
+/*-----------------------------------------------------------------------------
+ * RunBenchmark
+ * Flies the camera along a path with a fixed timestep for a set number of
+ * frames and reports how long each engine tick (and thus render) took
+-----------------------------------------------------------------------------*/
+static int RunBenchmark( ULevel* Level, const char* CamPathFile, int NumFrames )
+{
+  FCameraKey Keys[BENCH_MAX_KEYS];
+  int NumKeys;
+
+  if ( CamPathFile != NULL )
+  {
+    NumKeys = LoadCameraPath( CamPathFile, Keys, BENCH_MAX_KEYS );
+    if ( NumKeys == 0 )
+    {
+      GLogf( LOG_CRIT, "Failed to read camera path '%s'", CamPathFile );
+      return ERR_BAD_PATH;
+    }
+  }
+  else
+  {
+    NumKeys = GenerateCameraPath( Level, Keys, BENCH_MAX_KEYS );
+    if ( NumKeys == 0 )
+    {
+      Keys[0].Location = FVector( 0, 0, 0 );
+      Keys[0].Rotation = FRotator( 0, 0, 0 );
+      NumKeys = 1;
+    }
+  }
+
+  GLogf( LOG_INFO, "Running benchmark for %i frames over %i camera keys", NumFrames, NumKeys );
+
+  APlayerPawn* Player = GEngine->Client->CurrentViewport->Actor;
+  double* FrameTimes = new double[NumFrames];
+  double StartTime = USystem::GetSeconds();
+
+  for ( int Frame = 0; Frame < NumFrames; Frame++ )
+  {
+    float Distance = (float)(Frame * BENCH_TIMESTEP) * BENCH_CAMSPEED;
+    SampleCameraPath( Keys, NumKeys, Distance, Player->Location, Player->Rotation );
+
+    double FrameStart = USystem::GetSeconds();
+    GEngine->Tick( (float)BENCH_TIMESTEP );
+    FrameTimes[Frame] = (USystem::GetSeconds() - FrameStart) * 1000.0;
+  }
+
+  double TotalTime = USystem::GetSeconds() - StartTime;
+  PrintFrameReport( Level, "benchmark", FrameTimes, NumFrames, TotalTime );
+
+  delete[] FrameTimes;
+  return 0;
+}
+
 void CameraMove( EInputKey Key, float DeltaTime, bool bKeyDown )
 {
   switch ( Key )
@@ -94,8 +291,261 @@ void CameraMouseMove( float DeltaTime, int DeltaX, int DeltaY )
   }
 }
 
+/*-----------------------------------------------------------------------------
+ * levelviewer input recording
+ * Inputs going through CameraMove/CameraMouseMove can be recorded to a file
+ * and replayed later against a fixed timestep.
+ *
+ * File layout (little endian):
+ *   char[4]  Magic ("LVIN")
+ *   u32      Version
+ *   float[3] Camera location, i32[3] Camera rotation at start
+ *   Events until end of file, each being
+ *     varint  Microseconds since the previous event
+ *     u8      Event type (INPUT_*)
+ *     float   DeltaTime given to the input handler
+ *     INPUT_KeyUp/KeyDown: u8 Key
+ *     INPUT_Mouse:         zigzag varint DeltaX, zigzag varint DeltaY
+-----------------------------------------------------------------------------*/
+#define INPUT_MAGIC   "LVIN"
+#define INPUT_VERSION 1
+
+enum EInputEventType
+{
+  INPUT_KeyUp,
+  INPUT_KeyDown,
+  INPUT_Mouse,
+};
+
+struct FInputEvent
+{
+  double Time;
+  u8 Type;
+  u8 Key;
+  int DeltaX;
+  int DeltaY;
+  float DeltaTime;
+};
+
+static FILE* InputRecordFile = NULL;
+static double InputRecordStart = 0.0;
+static double InputRecordLast = 0.0;
+
+static void WriteVarInt( FILE* File, u64 Value )
+{
+  u8 Buf[10];
+  int Len = 0;
+  do
+  {
+    Buf[Len] = Value & 0x7f;
+    Value >>= 7;
+    if ( Value )
+      Buf[Len] |= 0x80;
+    Len++;
+  } while ( Value );
+
+  fwrite( Buf, 1, Len, File );
+}
+
+static u64 ReadVarInt( u8*& Ptr, u8* End )
+{
+  u64 Value = 0;
+  for ( int Shift = 0; Ptr < End && Shift < 64; Shift += 7 )
+  {
+    u8 Byte = *Ptr++;
+    Value |= (u64)(Byte & 0x7f) << Shift;
+    if ( !(Byte & 0x80) )
+      break;
+  }
+  return Value;
+}
+
+static void WriteEventHeader( u8 Type, float DeltaTime )
+{
+  double Now = USystem::GetSeconds() - InputRecordStart;
+  u64 Micros = (u64)((Now - InputRecordLast) * 1000000.0);
+  InputRecordLast += Micros / 1000000.0;
+
+  WriteVarInt( InputRecordFile, Micros );
+  fwrite( &Type, 1, 1, InputRecordFile );
+  fwrite( &DeltaTime, sizeof( float ), 1, InputRecordFile );
+}
+
+static void RecordCameraMove( EInputKey Key, float DeltaTime, bool bKeyDown )
+{
+  u8 KeyByte = (u8)Key;
+  WriteEventHeader( bKeyDown ? INPUT_KeyDown : INPUT_KeyUp, DeltaTime );
+  fwrite( &KeyByte, 1, 1, InputRecordFile );
+
+  CameraMove( Key, DeltaTime, bKeyDown );
+}
+
+static void RecordCameraMouseMove( float DeltaTime, int DeltaX, int DeltaY )
+{
+  WriteEventHeader( INPUT_Mouse, DeltaTime );
+  WriteVarInt( InputRecordFile, ((u32)DeltaX << 1) ^ (u32)(DeltaX >> 31) );
+  WriteVarInt( InputRecordFile, ((u32)DeltaY << 1) ^ (u32)(DeltaY >> 31) );
+
+  CameraMouseMove( DeltaTime, DeltaX, DeltaY );
+}
+
+static bool StartInputRecord( const char* FileName, FVector& CameraLoc, FRotator& CameraRot )
+{
+  InputRecordFile = fopen( FileName, "wb" );
+  if ( InputRecordFile == NULL )
+    return false;
+
+  u32 Version = INPUT_VERSION;
+  fwrite( INPUT_MAGIC, 1, 4, InputRecordFile );
+  fwrite( &Version, sizeof( u32 ), 1, InputRecordFile );
+  fwrite( &CameraLoc.X, sizeof( float ), 1, InputRecordFile );
+  fwrite( &CameraLoc.Y, sizeof( float ), 1, InputRecordFile );
+  fwrite( &CameraLoc.Z, sizeof( float ), 1, InputRecordFile );
+  fwrite( &CameraRot.Pitch, sizeof( int ), 1, InputRecordFile );
+  fwrite( &CameraRot.Yaw, sizeof( int ), 1, InputRecordFile );
+  fwrite( &CameraRot.Roll, sizeof( int ), 1, InputRecordFile );
+
+  InputRecordStart = USystem::GetSeconds();
+  InputRecordLast = 0.0;
+  return true;
+}
+
+// Reads every event of a recording; returns the number of events or -1
+static int LoadInputRecord( const char* FileName, FVector& CameraLoc, FRotator& CameraRot, FInputEvent*& OutEvents )
+{
+  FILE* File = fopen( FileName, "rb" );
+  if ( File == NULL )
+    return -1;
+
+  fseek( File, 0, SEEK_END );
+  long FileSize = ftell( File );
+  fseek( File, 0, SEEK_SET );
+  if ( FileSize < 0 )
+  {
+    fclose( File );
+    return -1;
+  }
+
+  u8* Data = new u8[FileSize];
+  bool bRead = fread( Data, 1, FileSize, File ) == (size_t)FileSize;
+  fclose( File );
+
+  const int HeaderSize = 8 + 3*sizeof( float ) + 3*sizeof( int );
+  u32 Version = 0;
+  if ( bRead && FileSize >= HeaderSize )
+    memcpy( &Version, Data + 4, sizeof( u32 ) );
+
+  if ( !bRead || FileSize < HeaderSize || memcmp( Data, INPUT_MAGIC, 4 ) != 0 || Version != INPUT_VERSION )
+  {
+    delete[] Data;
+    return -1;
+  }
+
+  u8* Ptr = Data + 8;
+  u8* End = Data + FileSize;
+  memcpy( &CameraLoc.X, Ptr, sizeof( float ) ); Ptr += sizeof( float );
+  memcpy( &CameraLoc.Y, Ptr, sizeof( float ) ); Ptr += sizeof( float );
+  memcpy( &CameraLoc.Z, Ptr, sizeof( float ) ); Ptr += sizeof( float );
+  memcpy( &CameraRot.Pitch, Ptr, sizeof( int ) ); Ptr += sizeof( int );
+  memcpy( &CameraRot.Yaw, Ptr, sizeof( int ) ); Ptr += sizeof( int );
+  memcpy( &CameraRot.Roll, Ptr, sizeof( int ) ); Ptr += sizeof( int );
+
+  // Every event is at least 6 bytes, which bounds the event count
+  OutEvents = new FInputEvent[(End - Ptr) / 6 + 1];
+  int NumEvents = 0;
+  u64 Micros = 0;
+  while ( Ptr < End )
+  {
+    FInputEvent& Event = OutEvents[NumEvents];
+    Micros += ReadVarInt( Ptr, End );
+    if ( End - Ptr < 1 + (int)sizeof( float ) )
+      break;
+
+    Event.Time = Micros / 1000000.0;
+    Event.Type = *Ptr++;
+    memcpy( &Event.DeltaTime, Ptr, sizeof( float ) );
+    Ptr += sizeof( float );
+
+    if ( Event.Type == INPUT_Mouse )
+    {
+      u32 ZX = (u32)ReadVarInt( Ptr, End );
+      u32 ZY = (u32)ReadVarInt( Ptr, End );
+      Event.DeltaX = (int)(ZX >> 1) ^ -(int)(ZX & 1);
+      Event.DeltaY = (int)(ZY >> 1) ^ -(int)(ZY & 1);
+    }
+    else if ( Ptr < End )
+    {
+      Event.Key = *Ptr++;
+    }
+    else
+    {
+      break;
+    }
+
+    NumEvents++;
+  }
+
+  delete[] Data;
+  return NumEvents;
+}
+
+/*-----------------------------------------------------------------------------
+ * RunInputReplay
+ * Feeds recorded inputs back through the camera handlers. Each event is
+ * applied at the start of the fixed timestep frame its timestamp falls in,
+ * so a replay always produces the same frames
+-----------------------------------------------------------------------------*/
+static int RunInputReplay( ULevel* Level, const char* FileName )
+{
+  APlayerPawn* Player = GEngine->Client->CurrentViewport->Actor;
+  FInputEvent* Events = NULL;
+  int NumEvents = LoadInputRecord( FileName, Player->Location, Player->Rotation, Events );
+  if ( NumEvents < 0 )
+  {
+    GLogf( LOG_CRIT, "Failed to read input recording '%s'", FileName );
+    return ERR_BAD_PATH;
+  }
+
+  double Duration = (NumEvents > 0) ? Events[NumEvents - 1].Time : 0.0;
+  int NumFrames = (int)(Duration / BENCH_TIMESTEP) + 1;
+  GLogf( LOG_INFO, "Replaying %i input events over %i frames", NumEvents, NumFrames );
+
+  double* FrameTimes = new double[NumFrames];
+  double StartTime = USystem::GetSeconds();
+  int NextEvent = 0;
+
+  for ( int Frame = 0; Frame < NumFrames; Frame++ )
+  {
+    double FrameEnd = (Frame + 1) * BENCH_TIMESTEP;
+    for ( ; NextEvent < NumEvents && Events[NextEvent].Time < FrameEnd; NextEvent++ )
+    {
+      FInputEvent& Event = Events[NextEvent];
+      if ( Event.Type == INPUT_Mouse )
+        CameraMouseMove( Event.DeltaTime, Event.DeltaX, Event.DeltaY );
+      else
+        CameraMove( (EInputKey)Event.Key, Event.DeltaTime, Event.Type == INPUT_KeyDown );
+    }
+
+    double FrameStart = USystem::GetSeconds();
+    GEngine->Tick( (float)BENCH_TIMESTEP );
+    FrameTimes[Frame] = (USystem::GetSeconds() - FrameStart) * 1000.0;
+  }
+
+  double TotalTime = USystem::GetSeconds() - StartTime;
+  PrintFrameReport( Level, "replay", FrameTimes, NumFrames, TotalTime );
+
+  delete[] FrameTimes;
+  delete[] Events;
+  return 0;
+}
+
 int levelviewer( int argc, char** argv )
 {
+  int NumBenchFrames = 0;
+  char* CamPathFile = NULL;
+  char* RecordFile = NULL;
+  char* ReplayFile = NULL;
+
   // Argument parsing
   int i = 0;
   while ( 1 )
@@ -103,15 +553,40 @@ int levelviewer( int argc, char** argv )
     if ( argc == 0 || i > argc )
     {
     BadOpt:
-      printf( "level usage:\n" );
-      printf( "\tlucc [gopts] levelviewer <Package Name>\n\n" );
+      printf( "levelviewer usage:\n" );
+      printf( "\tlucc [gopts] levelviewer [copts] <Package Name>\n\n" );
+
+      printf( "Command options:\n" );
+      printf( "\t-b \"<NumFrames>\"    - Runs a (b)enchmark for a number of frames and exits\n" );
+      printf( "\t-c \"<CameraPath>\"   - Specifies a (c)amera path for the benchmark\n" );
+      printf( "\t-r \"<InputFile>\"    - (R)ecords camera inputs to a file\n" );
+      printf( "\t-y \"<InputFile>\"    - Replays recorded camera inputs and exits\n" );
+      printf( "\n" );
       return ERR_BAD_ARGS;
     }
 
     if ( argv[i][0] == '-' )
     {
-      GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
-      goto BadOpt;
+      switch ( argv[i][1] )
+      {
+      case 'b':
+        NumBenchFrames = strtol( argv[++i], NULL, 0 );
+        if ( NumBenchFrames <= 0 )
+          goto BadOpt;
+        break;
+      case 'c':
+        CamPathFile = argv[++i];
+        break;
+      case 'r':
+        RecordFile = argv[++i];
+        break;
+      case 'y':
+        ReplayFile = argv[++i];
+        break;
+      default:
+        GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
+        goto BadOpt;
+      }
     }
     else
     {
@@ -122,6 +597,22 @@ int levelviewer( int argc, char** argv )
     i++;
   }
 
+  // A benchmark and a replay are both a whole session
+  if ( NumBenchFrames > 0 && ReplayFile != NULL )
+  {
+    GLogf( LOG_WARN, "Options -b and -y can't be used together" );
+    goto BadOpt;
+  }
+
+  double LoadStart = USystem::GetSeconds();
+
+  // Start reading the level's package and everything it depends on before
+  // anything else, so it happens in the background while the engine starts up
+  FPackagePrefetcher Prefetcher;
+  UPackage* Entry = LoadPackageWithPrefetch( PkgName, Prefetcher );
+  if ( Entry == NULL )
+    return ERR_MISSING_PKG;
+
   // Initialize engine
   GEngine = (UEngine*)UEngine::StaticClass()->CreateObject();
   if ( !GEngine->Init() )
@@ -140,11 +631,6 @@ int levelviewer( int argc, char** argv )
   Camera->Acceleration = FVector( 100, 100, 0 );
   Viewport->Possess( Camera );
 
-  // Bind inputs to CameraMove
-  GEngine->Client->BindKeyInput( IK_LeftMouse, CameraMove );
-  GEngine->Client->BindKeyInput( IK_RightMouse, CameraMove );
-  GEngine->Client->BindMouseInput( CameraMouseMove );
-
   // Load packages
   UPackage* Engine = UPackage::StaticLoadPackage( "Engine" );
 
@@ -152,16 +638,16 @@ int levelviewer( int argc, char** argv )
   UFont* MedFont = (UFont*)UObject::StaticLoadObject( Engine, "MedFont", UFont::StaticClass(), NULL );
 
   // Load level
-  UPackage* Entry = UPackage::StaticLoadPackage( PkgName );
   ULevel* MyLevel = (ULevel*)UObject::StaticLoadObject( Entry, "MyLevel", ULevel::StaticClass(), NULL );
+  if ( MyLevel == NULL )
+  {
+    GLogf( LOG_CRIT, "Failed to load level from package '%s'", PkgName );
+    return ERR_BAD_OBJECT;
+  }
   GEngine->Level = MyLevel;
+  GLogf( LOG_INFO, "Level loaded in %.3f s", USystem::GetSeconds() - LoadStart );
 
-  FBoxInt2D TextPosX( 8, 8, 256, 256 );
-  FBoxInt2D TextPosY( 8, 20, 256, 256 );
-  FBoxInt2D TextPosZ( 8, 32, 256, 256 );
-  FBoxInt2D TextPosPitch( 8, 44, 256, 256 );
-  FBoxInt2D TextPosYaw( 8, 56, 256, 256 );
-  FBoxInt2D TextPosRoll( 8, 68, 256, 256 );
+  FTextOverlay Overlay( 8, 8, 12 );
 
   // Cube properties
   FVector Loc( 0, 0, 0 );
@@ -173,10 +659,43 @@ int levelviewer( int argc, char** argv )
   FVector& CameraLoc = GEngine->Client->CurrentViewport->Actor->Location;
   FRotator& CameraRot = GEngine->Client->CurrentViewport->Actor->Rotation;
 
+  if ( NumBenchFrames > 0 )
+    return RunBenchmark( MyLevel, CamPathFile, NumBenchFrames );
+
+  if ( ReplayFile != NULL )
+    return RunInputReplay( MyLevel, ReplayFile );
+
+  // Bind inputs to CameraMove
+  if ( RecordFile != NULL )
+  {
+    if ( !StartInputRecord( RecordFile, CameraLoc, CameraRot ) )
+    {
+      GLogf( LOG_CRIT, "Failed to open input recording '%s'", RecordFile );
+      return ERR_BAD_PATH;
+    }
+
+    GEngine->Client->BindKeyInput( IK_LeftMouse, RecordCameraMove );
+    GEngine->Client->BindKeyInput( IK_RightMouse, RecordCameraMove );
+    GEngine->Client->BindMouseInput( RecordCameraMouseMove );
+  }
+  else
+  {
+    GEngine->Client->BindKeyInput( IK_LeftMouse, CameraMove );
+    GEngine->Client->BindKeyInput( IK_RightMouse, CameraMove );
+    GEngine->Client->BindMouseInput( CameraMouseMove );
+  }
+
   // Start ticking
   double LastTime = USystem::GetSeconds();
   double CurrentTime = 0;
   double FrameNum = 0.0;
+  double TickTime = 0.0;
+  double HudTime = 0.0;
+  SetCountAllocs( true );
+  u64 LastAllocs = GetNumAllocs();
+  u64 FrameAllocs = 0;
+  bool bFirstFrame = true;
+  bool bPrefetchLogged = false;
   while ( 1 )
   {
     CurrentTime = USystem::GetSeconds();
@@ -189,22 +708,48 @@ int levelviewer( int argc, char** argv )
     if ( FrameNum > 1.0 )
       FrameNum = 0.0;
 
-    // Camera debug
-    FString CameraX = "Camera.X: " + FString( CameraLoc.X );
-    FString CameraY = "Camera.Y: " + FString( CameraLoc.Y );
-    FString CameraZ = "Camera.Z: " + FString( CameraLoc.Z );
-    FString CameraPitch = "Camera.Pitch: " + FString( CameraRot.Pitch );
-    FString CameraYaw   = "Camera.Yaw:   " + FString( CameraRot.Yaw );
-    FString CameraRoll  = "Camera.Roll:  " + FString( CameraRot.Roll );
-    GEngine->Render->DrawText( MedFont, TextPosX, CameraX );
-    GEngine->Render->DrawText( MedFont, TextPosY, CameraY );
-    GEngine->Render->DrawText( MedFont, TextPosZ, CameraZ );
-    GEngine->Render->DrawText( MedFont, TextPosPitch, CameraPitch );
-    GEngine->Render->DrawText( MedFont, TextPosYaw, CameraYaw );
-    GEngine->Render->DrawText( MedFont, TextPosRoll, CameraRoll );
+    // Camera and perf debug
+    Overlay.Begin();
+    Overlay.Line( "Camera.X: " ).Float( CameraLoc.X, 2 );
+    Overlay.Line( "Camera.Y: " ).Float( CameraLoc.Y, 2 );
+    Overlay.Line( "Camera.Z: " ).Float( CameraLoc.Z, 2 );
+    Overlay.Line( "Camera.Pitch: " ).Int( CameraRot.Pitch );
+    Overlay.Line( "Camera.Yaw:   " ).Int( CameraRot.Yaw );
+    Overlay.Line( "Camera.Roll:  " ).Int( CameraRot.Roll );
+    Overlay.Line( "Frame: " ).Float( (float)(DeltaTime * 1000.0), 2 ).Text( " ms" );
+    Overlay.Line( "Tick:  " ).Float( (float)(TickTime * 1000.0), 2 ).Text( " ms" );
+    Overlay.Line( "HUD:   " ).Float( (float)(HudTime * 1000.0), 3 ).Text( " ms" );
+    Overlay.Line( "Allocs/frame: " ).Int( (i64)FrameAllocs );
+
+    double HudStart = USystem::GetSeconds();
+    Overlay.Draw( MedFont );
+    HudTime = USystem::GetSeconds() - HudStart;
 
     // Tick tock
+    double TickStart = USystem::GetSeconds();
     GEngine->Tick( (float)DeltaTime );
+    TickTime = USystem::GetSeconds() - TickStart;
+
+    if ( bFirstFrame )
+    {
+      GLogf( LOG_INFO, "Time to first frame: %.3f s", USystem::GetSeconds() - LoadStart );
+      bFirstFrame = false;
+    }
+
+    if ( !bPrefetchLogged && Prefetcher.IsDone() )
+    {
+      GLogf( LOG_INFO, "Read %i dependent packages in %.3f s",
+        Prefetcher.NumFiles(), Prefetcher.GetFinishTime() );
+      bPrefetchLogged = true;
+    }
+
+    u64 Allocs = GetNumAllocs();
+    FrameAllocs = Allocs - LastAllocs;
+    LastAllocs = Allocs;
+
+    // Keep the recording intact if the viewer gets closed
+    if ( InputRecordFile != NULL )
+      fflush( InputRecordFile );
 
     LastTime = CurrentTime;
   }
@@ -0,0 +1,151 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * MappedFile.cpp - Read-only memory mapped files
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#ifndef _WIN32
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+#include "lucc.h"
+
+/*-----------------------------------------------------------------------------
+ * FMappedFile
+-----------------------------------------------------------------------------*/
+FMappedFile::FMappedFile()
+  : Data( NULL ), Size( 0 )
+#ifdef _WIN32
+  , File( INVALID_HANDLE_VALUE ), Mapping( NULL )
+#endif
+{
+}
+
+FMappedFile::~FMappedFile()
+{
+  Close();
+}
+
+bool FMappedFile::Open( const char* FileName )
+{
+  Close();
+
+#ifdef _WIN32
+  File = CreateFileA( FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+    FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+  if ( File == INVALID_HANDLE_VALUE )
+    return false;
+
+  LARGE_INTEGER FileSize;
+  if ( !GetFileSizeEx( File, &FileSize ) )
+  {
+    Close();
+    return false;
+  }
+
+  Size = (size_t)FileSize.QuadPart;
+  if ( Size == 0 )
+    return true;
+
+  Mapping = CreateFileMappingA( File, NULL, PAGE_READONLY, 0, 0, NULL );
+  if ( Mapping == NULL )
+  {
+    Close();
+    return false;
+  }
+
+  Data = (const u8*)MapViewOfFile( Mapping, FILE_MAP_READ, 0, 0, 0 );
+  if ( Data == NULL )
+  {
+    Close();
+    return false;
+  }
+#else
+  int Fd = open( FileName, O_RDONLY );
+  if ( Fd < 0 )
+    return false;
+
+  struct stat Stat;
+  if ( fstat( Fd, &Stat ) != 0 )
+  {
+    close( Fd );
+    return false;
+  }
+
+  Size = (size_t)Stat.st_size;
+  if ( Size > 0 )
+  {
+    void* Map = mmap( NULL, Size, PROT_READ, MAP_SHARED, Fd, 0 );
+    if ( Map == MAP_FAILED )
+    {
+      close( Fd );
+      Size = 0;
+      return false;
+    }
+    Data = (const u8*)Map;
+  }
+
+  // The mapping keeps its own reference to the file
+  close( Fd );
+#endif
+
+  return true;
+}
+
+void FMappedFile::Close()
+{
+#ifdef _WIN32
+  if ( Data != NULL )
+    UnmapViewOfFile( Data );
+  if ( Mapping != NULL )
+    CloseHandle( Mapping );
+  if ( File != INVALID_HANDLE_VALUE )
+    CloseHandle( File );
+  Mapping = NULL;
+  File = INVALID_HANDLE_VALUE;
+#else
+  if ( Data != NULL )
+    munmap( (void*)Data, Size );
+#endif
+
+  Data = NULL;
+  Size = 0;
+}
+
+void FMappedFile::Touch()
+{
+#ifndef _WIN32
+  if ( Data != NULL )
+  {
+    madvise( (void*)Data, Size, MADV_SEQUENTIAL );
+    madvise( (void*)Data, Size, MADV_WILLNEED );
+  }
+#endif
+
+  // Reading one byte of every page faults the whole file in without
+  // copying any of it
+  volatile u8 Sum = 0;
+  for ( size_t i = 0; i < Size; i += MAPPED_PAGE_SIZE )
+    Sum += Data[i];
+}
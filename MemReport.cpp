@@ -0,0 +1,436 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * MemReport.cpp - Reports memory used by live objects
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "lucc.h"
+
+/*-----------------------------------------------------------------------------
+ * Object sizes
+ * An object's size is its class's instance size, plus heap memory it owns
+ * through TArray and FString properties, plus known native data (mesh,
+ * model and texture data that isn't exposed as properties)
+-----------------------------------------------------------------------------*/
+template <class T> static inline u64 ArrayBytes( const TArray<T>& Array )
+{
+  return Array.capacity() * sizeof( T );
+}
+
+static u64 GetPropertyHeapBytes( UStruct* Struct, u8* Base )
+{
+  u64 Bytes = 0;
+  for ( UStruct* It = Struct; It != NULL; It = It->SuperField )
+  {
+    for ( UField* Field = It->Children; Field != NULL; Field = Field->Next )
+    {
+      UProperty* Prop = SafeCast<UProperty>( Field );
+      if ( !Prop || Prop->Outer != It || Prop->Offset == MAX_UINT32 )
+        continue;
+
+      for ( int i = 0; i < Prop->ArrayDim; i++ )
+      {
+        u8* Value = Base + Prop->Offset + i * Prop->ElementSize;
+        if ( Prop->PropertyType == PROP_Array )
+        {
+          // Script arrays are stored as pointers to TArrays. Every TArray
+          // has the same layout, so the byte count can be read through any
+          // element type
+          TArray<u8>* Array = *(TArray<u8>**)Value;
+          if ( Array != NULL )
+            Bytes += sizeof( TArray<u8> ) + Array->capacity();
+        }
+        else if ( Prop->PropertyType == PROP_String )
+        {
+          FString* Str = *(FString**)Value;
+          if ( Str != NULL )
+            Bytes += sizeof( FString ) + Str->capacity() + 1;
+        }
+        else if ( Prop->PropertyType == PROP_Struct )
+        {
+          Bytes += GetPropertyHeapBytes( ((UStructProperty*)Prop)->Struct, Value );
+        }
+      }
+    }
+  }
+  return Bytes;
+}
+
+static u64 GetNativeHeapBytes( UObject* Obj )
+{
+  if ( Obj->IsA( UTexture::StaticClass() ) )
+    return EstimateTextureSize( (UTexture*)Obj );
+
+  if ( Obj->IsA( UMesh::StaticClass() ) )
+  {
+    UMesh* Mesh = (UMesh*)Obj;
+    u64 Bytes = ArrayBytes( Mesh->Verts ) + ArrayBytes( Mesh->Tris ) +
+      ArrayBytes( Mesh->AnimSeqs ) + ArrayBytes( Mesh->Textures );
+
+    if ( Obj->IsA( ULodMesh::StaticClass() ) )
+    {
+      ULodMesh* LodMesh = (ULodMesh*)Obj;
+      Bytes += ArrayBytes( LodMesh->Wedges ) + ArrayBytes( LodMesh->Faces ) +
+        ArrayBytes( LodMesh->SpecialFaces ) + ArrayBytes( LodMesh->RemapAnimVerts );
+    }
+    return Bytes;
+  }
+
+  if ( Obj->IsA( UModel::StaticClass() ) )
+  {
+    UModel* Model = (UModel*)Obj;
+    return ArrayBytes( Model->Vectors ) + ArrayBytes( Model->Points ) + ArrayBytes( Model->Nodes ) +
+      ArrayBytes( Model->Surfs ) + ArrayBytes( Model->Verts ) + ArrayBytes( Model->LightMap ) +
+      ArrayBytes( Model->LightBits );
+  }
+
+  if ( Obj->IsA( UPolys::StaticClass() ) )
+    return ArrayBytes( ((UPolys*)Obj)->Element );
+
+  return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Snapshots
+ * Totals per class and package, saved as text so that two runs can be
+ * compared. Each line is "<kind> <name> <count> <bytes>"
+-----------------------------------------------------------------------------*/
+struct FMemTotal
+{
+  u64 Count;
+  u64 Bytes;
+};
+
+typedef std::unordered_map<std::string, FMemTotal> FMemTotals;
+
+static bool SaveSnapshot( const char* FileName, FMemTotals& Classes, FMemTotals& Packages )
+{
+  FILE* File = fopen( FileName, "wb" );
+  if ( File == NULL )
+  {
+    GLogf( LOG_CRIT, "Failed to open '%s' for writing", FileName );
+    return false;
+  }
+
+  fprintf( File, "# lucc memreport snapshot\n" );
+  for ( FMemTotals::iterator It = Classes.begin(); It != Classes.end(); ++It )
+    fprintf( File, "class %s %llu %llu\n", It->first.c_str(),
+      (unsigned long long)It->second.Count, (unsigned long long)It->second.Bytes );
+  for ( FMemTotals::iterator It = Packages.begin(); It != Packages.end(); ++It )
+    fprintf( File, "package %s %llu %llu\n", It->first.c_str(),
+      (unsigned long long)It->second.Count, (unsigned long long)It->second.Bytes );
+
+  bool bOk = ferror( File ) == 0;
+  fclose( File );
+  return bOk;
+}
+
+static bool LoadSnapshot( const char* FileName, FMemTotals& Classes, FMemTotals& Packages )
+{
+  FILE* File = fopen( FileName, "rb" );
+  if ( File == NULL )
+  {
+    GLogf( LOG_CRIT, "Failed to open snapshot '%s'", FileName );
+    return false;
+  }
+
+  char Line[1024];
+  char Kind[16];
+  char Name[512];
+  unsigned long long Count, Bytes;
+  while ( fgets( Line, sizeof( Line ), File ) != NULL )
+  {
+    if ( sscanf( Line, "%15s %511s %llu %llu", Kind, Name, &Count, &Bytes ) != 4 )
+      continue;
+
+    FMemTotal Total = { Count, Bytes };
+    if ( strcmp( Kind, "class" ) == 0 )
+      Classes[Name] = Total;
+    else if ( strcmp( Kind, "package" ) == 0 )
+      Packages[Name] = Total;
+  }
+
+  fclose( File );
+  return true;
+}
+
+static void PrintDiff( const char* Title, FMemTotals& Old, FMemTotals& New, int MaxRows )
+{
+  struct FDiffRow
+  {
+    const char* Name;
+    FMemTotal Old;
+    FMemTotal New;
+    i64 Delta;
+  };
+
+  std::vector<FDiffRow> Rows;
+  FMemTotal Zero = { 0, 0 };
+  for ( FMemTotals::iterator It = New.begin(); It != New.end(); ++It )
+  {
+    FMemTotals::iterator Found = Old.find( It->first );
+    FDiffRow Row = { It->first.c_str(), (Found != Old.end()) ? Found->second : Zero, It->second, 0 };
+    Row.Delta = (i64)Row.New.Bytes - (i64)Row.Old.Bytes;
+    if ( Row.Delta != 0 || Row.New.Count != Row.Old.Count )
+      Rows.push_back( Row );
+  }
+  for ( FMemTotals::iterator It = Old.begin(); It != Old.end(); ++It )
+  {
+    if ( New.find( It->first ) == New.end() )
+    {
+      FDiffRow Row = { It->first.c_str(), It->second, Zero, -(i64)It->second.Bytes };
+      Rows.push_back( Row );
+    }
+  }
+
+  std::sort( Rows.begin(), Rows.end(), []( const FDiffRow& A, const FDiffRow& B )
+  {
+    i64 AbsA = (A.Delta < 0) ? -A.Delta : A.Delta;
+    i64 AbsB = (B.Delta < 0) ? -B.Delta : B.Delta;
+    if ( AbsA != AbsB )
+      return AbsA > AbsB;
+    return strcmp( A.Name, B.Name ) < 0;
+  });
+
+  printf( "\n%s changes:\n", Title );
+  printf( "  %-40s %9s %9s %12s %12s %12s\n", "Name", "Old #", "New #", "Old KB", "New KB", "Delta KB" );
+  for ( int i = 0; i < (int)Rows.size() && i < MaxRows; i++ )
+  {
+    FDiffRow& Row = Rows[i];
+    printf( "  %-40s %9llu %9llu %12.1f %12.1f %+12.1f\n", Row.Name,
+      (unsigned long long)Row.Old.Count, (unsigned long long)Row.New.Count,
+      Row.Old.Bytes / 1024.0, Row.New.Bytes / 1024.0, Row.Delta / 1024.0 );
+  }
+  if ( Rows.size() == 0 )
+    printf( "  (none)\n" );
+}
+
+static void PrintTotals( const char* Title, FMemTotals& Totals, int MaxRows )
+{
+  std::vector<FMemTotals::iterator> Rows;
+  for ( FMemTotals::iterator It = Totals.begin(); It != Totals.end(); ++It )
+    Rows.push_back( It );
+
+  std::sort( Rows.begin(), Rows.end(), []( const FMemTotals::iterator& A, const FMemTotals::iterator& B )
+  {
+    if ( A->second.Bytes != B->second.Bytes )
+      return A->second.Bytes > B->second.Bytes;
+    return A->first < B->first;
+  });
+
+  printf( "\n%s:\n", Title );
+  printf( "  %-40s %9s %12s\n", "Name", "Objects", "KB" );
+  for ( int i = 0; i < (int)Rows.size() && i < MaxRows; i++ )
+    printf( "  %-40s %9llu %12.1f\n", Rows[i]->first.c_str(),
+      (unsigned long long)Rows[i]->second.Count, Rows[i]->second.Bytes / 1024.0 );
+}
+
+/*-----------------------------------------------------------------------------
+ * memreport
+ * Loads a package (or a map's level) and reports the memory used by every
+ * object that is alive afterwards, engine objects included
+-----------------------------------------------------------------------------*/
+int memreport( int argc, char** argv )
+{
+  int i = 0;
+  int MaxRows = 20;
+  char* SaveName = NULL;
+  char* DiffName = NULL;
+
+  // Argument parsing
+  while ( 1 )
+  {
+    if ( argc == 0 || i > argc )
+    {
+    BadOpt:
+      printf( "memreport usage:\n" );
+      printf( "\tlucc [gopts] memreport [copts] <Package or Map Name>\n\n" );
+
+      printf( "Command options:\n" );
+      printf( "\t-n <Count>           - Sets the (n)umber of rows in each list (default 20)\n" );
+      printf( "\t-o \"<FileName>\"     - Saves a snapshot of the totals to a file (o)utput\n" );
+      printf( "\t-d \"<FileName>\"     - Shows the (d)ifference to a saved snapshot\n" );
+      printf( "\n" );
+      return ERR_BAD_ARGS;
+    }
+
+    if ( argv[i][0] == '-' )
+    {
+      switch ( argv[i][1] )
+      {
+      case 'n':
+        MaxRows = atoi( argv[++i] );
+        break;
+      case 'o':
+        SaveName = argv[++i];
+        break;
+      case 'd':
+        DiffName = argv[++i];
+        break;
+      default:
+        GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
+        goto BadOpt;
+      }
+    }
+    else
+    {
+      PkgName = argv[i];
+      break;
+    }
+
+    i++;
+  }
+
+  // Load package
+  FPackagePrefetcher Prefetcher;
+  UPackage* Pkg = LoadPackageWithPrefetch( PkgName, Prefetcher );
+  if ( Pkg == NULL )
+    return ERR_MISSING_PKG;
+
+  // Maps load their level (and everything it references), other packages
+  // load every export
+  TArray<FExport>& Exports = Pkg->GetExportTable();
+  bool bIsMap = false;
+  for ( int i = 0; i < Exports.Size(); i++ )
+  {
+    if ( stricmp( Pkg->ResolveNameFromIdx( Exports[i].ObjectName ), "MyLevel" ) == 0 )
+    {
+      bIsMap = true;
+      break;
+    }
+  }
+
+  double StartTime = USystem::GetSeconds();
+  if ( bIsMap )
+  {
+    if ( UObject::StaticLoadObject( Pkg, "MyLevel", ULevel::StaticClass(), NULL ) == NULL )
+    {
+      GLogf( LOG_CRIT, "Failed to load level from package '%s'", PkgName );
+      return ERR_BAD_OBJECT;
+    }
+  }
+  else
+  {
+    for ( int i = 0; i < Exports.Size(); i++ )
+    {
+      const char* ObjName = Pkg->ResolveNameFromIdx( Exports[i].ObjectName );
+      if ( strnicmp( ObjName, "None", 4 ) != 0 )
+        UObject::StaticLoadObject( Pkg, &Exports[i], NULL, NULL, LOAD_Immediate );
+    }
+  }
+  GLogf( LOG_INFO, "Loaded '%s' in %.2f seconds", PkgName, USystem::GetSeconds() - StartTime );
+
+  // Size every live object; this only reads, so it can be spread out
+  TArray<UObject*>& Pool = UObject::ObjectPool;
+  std::vector<u64> Sizes( Pool.Size() );
+  std::vector<u64> HeapSizes( Pool.Size() );
+  ParallelFor( Pool.Size(), [&]( int iObj )
+  {
+    UObject* Obj = Pool[iObj];
+    if ( Obj == NULL || Obj->Class == NULL )
+      return;
+
+    HeapSizes[iObj] = GetPropertyHeapBytes( Obj->Class, (u8*)Obj ) + GetNativeHeapBytes( Obj );
+    Sizes[iObj] = Obj->Class->StructSize + HeapSizes[iObj];
+  });
+
+  FMemTotals Classes;
+  FMemTotals Packages;
+  std::vector<int> Largest;
+  u64 TotalBytes = 0;
+  u64 TotalHeap = 0;
+  u64 NumObjects = 0;
+  for ( int i = 0; i < Pool.Size(); i++ )
+  {
+    UObject* Obj = Pool[i];
+    if ( Obj == NULL || Obj->Class == NULL )
+      continue;
+
+    std::string ClassName = (Obj->Class->Pkg != NULL) ? Obj->Class->Pkg->Name.Data() : "";
+    ClassName += '.';
+    ClassName += Obj->Class->Name.Data();
+
+    FMemTotal& ClassTotal = Classes[ClassName];
+    ClassTotal.Count++;
+    ClassTotal.Bytes += Sizes[i];
+
+    FMemTotal& PkgTotal = Packages[(Obj->Pkg != NULL) ? Obj->Pkg->Name.Data() : "(none)"];
+    PkgTotal.Count++;
+    PkgTotal.Bytes += Sizes[i];
+
+    TotalBytes += Sizes[i];
+    TotalHeap += HeapSizes[i];
+    NumObjects++;
+    Largest.push_back( i );
+  }
+
+  int NumLargest = std::min( (int)Largest.size(), MaxRows );
+  std::partial_sort( Largest.begin(), Largest.begin() + NumLargest, Largest.end(),
+    [&]( int A, int B ) { return Sizes[A] > Sizes[B]; } );
+
+  printf( "Memory report for '%s'\n", PkgName );
+  printf( "  %llu objects, %.1f KB in total (%.1f KB of it heap data)\n",
+    (unsigned long long)NumObjects, TotalBytes / 1024.0, TotalHeap / 1024.0 );
+
+  PrintTotals( "Classes", Classes, MaxRows );
+  PrintTotals( "Packages", Packages, MaxRows );
+
+  printf( "\nLargest objects:\n" );
+  printf( "  %-40s %-24s %12s %12s\n", "Name", "Class", "KB", "Heap KB" );
+  for ( int i = 0; i < NumLargest; i++ )
+  {
+    UObject* Obj = Pool[Largest[i]];
+    char FullName[512];
+    snprintf( FullName, sizeof( FullName ), "%s.%s", (Obj->Pkg != NULL) ? Obj->Pkg->Name.Data() : "", Obj->Name.Data() );
+    printf( "  %-40s %-24s %12.1f %12.1f\n", FullName, Obj->Class->Name.Data(),
+      Sizes[Largest[i]] / 1024.0, HeapSizes[Largest[i]] / 1024.0 );
+  }
+
+  if ( DiffName != NULL )
+  {
+    char FileName[4096];
+    snprintf( FileName, sizeof( FileName ), "%s/%s", wd, DiffName );
+
+    FMemTotals OldClasses;
+    FMemTotals OldPackages;
+    if ( !LoadSnapshot( FileName, OldClasses, OldPackages ) )
+      return ERR_BAD_PATH;
+
+    PrintDiff( "Class", OldClasses, Classes, MaxRows );
+    PrintDiff( "Package", OldPackages, Packages, MaxRows );
+  }
+
+  if ( SaveName != NULL )
+  {
+    char FileName[4096];
+    snprintf( FileName, sizeof( FileName ), "%s/%s", wd, SaveName );
+    if ( !SaveSnapshot( FileName, Classes, Packages ) )
+      return ERR_BAD_PATH;
+  }
+
+  return 0;
+}
+
@@ -33,6 +33,9 @@ int meshexport( int argc, char** argv )
   bool bDoGroupPathExport = false;
   char* MeshType = NULL;
   int FrameNum = -1;
+  bool bAllFrames = false;
+  char* Sequences = NULL;
+  bool bQuantize = false;
 
   // Argument parsing
   while ( 1 )
@@ -49,10 +52,14 @@ int meshexport( int argc, char** argv )
       printf( "\t-c                    - Let path point to a folder UCC can see\n" );
       printf( "\t-g                    - Exports objects to folders based on (g)roup\n" );
       printf( "\t-f \"<FrameNum>\"     - Specifies a (f)rame number to export (for .obj)\n" );
+      printf( "\t-a                    - Exports (a)ll frames, one .obj file each\n" );
+      printf( "\t-q \"<Seq,...>\"      - Exports all frames of the given animation se(q)uences (for .obj)\n" );
       printf( "\t-t \"<MeshFormat>\"   - Specifies a mesh (t)ype to export to (default to u3d)\n" );
       printf( "\t   Mesh Formats:\n" );
       printf( "\t   \"u3d\"  - Unreal Vertex Mesh Format (_a.3d/_d.3d)\n" );
       printf( "\t   \"obj\"  - Waveform Obj Format\n" );
+      printf( "\t   \"glb\"  - Binary glTF, with animation frames as morph targets\n" );
+      printf( "\t-z                    - Quanti(z)es glb attributes to 16-bit values\n" );
       printf( "\n" );
       return ERR_BAD_ARGS;
     }
@@ -87,6 +94,15 @@ int meshexport( int argc, char** argv )
       case 't':
         MeshType = argv[++i];
         break;
+      case 'a':
+        bAllFrames = true;
+        break;
+      case 'q':
+        Sequences = argv[++i];
+        break;
+      case 'z':
+        bQuantize = true;
+        break;
       default:
         GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
         goto BadOpt;
@@ -101,6 +117,21 @@ int meshexport( int argc, char** argv )
     i++;
   }
 
+  // Per frame and glb exports are written by lucc itself
+  bool bExportGlb = (MeshType != NULL && stricmp( MeshType, "glb" ) == 0);
+  bool bExportFrames = (bAllFrames || Sequences != NULL) && !bExportGlb;
+  if ( bExportFrames )
+  {
+    if ( MeshType == NULL )
+      MeshType = (char*)"obj";
+
+    if ( stricmp( MeshType, "obj" ) != 0 )
+    {
+      GLogf( LOG_CRIT, "Exporting frames is only supported for the obj and glb formats" );
+      goto BadOpt;
+    }
+  }
+
   if ( Path[0] == '\0' )
   {
     strcat( Path, "../" );
@@ -126,12 +157,10 @@ int meshexport( int argc, char** argv )
   UClass* Class = UMesh::StaticClass();
 
   // Load package
-  UPackage* Pkg = UPackage::StaticLoadPackage( PkgName );
+  FPackagePrefetcher Prefetcher;
+  UPackage* Pkg = LoadPackageWithPrefetch( PkgName, Prefetcher );
   if ( Pkg == NULL )
-  {
-    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist" );
     return ERR_MISSING_PKG;
-  }
 
   // Iterate and export all textures
   TArray<FExport>& ExportTable = Pkg->GetExportTable();
@@ -175,7 +204,12 @@ int meshexport( int argc, char** argv )
           }
         }
 
-        UMeshExporter::ExportObject( Obj, Path, MeshType, FrameNum );
+        if ( bExportGlb )
+          ExportMeshGlb( Obj, Path, bQuantize, Sequences );
+        else if ( bExportFrames )
+          ExportMeshFramesObj( Obj, Path, Sequences );
+        else
+          UMeshExporter::ExportObject( Obj, Path, MeshType, FrameNum );
 
         if ( bDoGroupPathExport )
           *strrchr( Path, DIRECTORY_SEPARATOR ) = '\0';
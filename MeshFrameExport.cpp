@@ -0,0 +1,704 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * MeshFrameExport.cpp - Exports mesh animation frames to .obj and .glb
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <unordered_map>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define MESH_UNPACK_SSE2 1
+#endif
+#include "lucc.h"
+
+/*-----------------------------------------------------------------------------
+ * UnpackMeshVerts
+ * Vertex mesh positions are packed into 32 bits as X:11, Y:11, Z:10 signed
+ * fields from the low bit up. Four vertices are unpacked at a time with
+ * shifts, into separate X, Y and Z arrays
+-----------------------------------------------------------------------------*/
+void UnpackMeshVerts( const FMeshVert* Verts, int NumVerts, float* OutX, float* OutY, float* OutZ )
+{
+  static_assert( sizeof( FMeshVert ) == 4, "FMeshVert is expected to be packed into 32 bits" );
+  const u8* Data = (const u8*)Verts;
+  int i = 0;
+
+#ifdef MESH_UNPACK_SSE2
+  for ( ; i + 4 <= NumVerts; i += 4 )
+  {
+    __m128i D = _mm_loadu_si128( (const __m128i*)(Data + i * 4) );
+    __m128i X = _mm_srai_epi32( _mm_slli_epi32( D, 21 ), 21 );
+    __m128i Y = _mm_srai_epi32( _mm_slli_epi32( D, 10 ), 21 );
+    __m128i Z = _mm_srai_epi32( D, 22 );
+    _mm_storeu_ps( OutX + i, _mm_cvtepi32_ps( X ) );
+    _mm_storeu_ps( OutY + i, _mm_cvtepi32_ps( Y ) );
+    _mm_storeu_ps( OutZ + i, _mm_cvtepi32_ps( Z ) );
+  }
+#endif
+
+  for ( ; i < NumVerts; i++ )
+  {
+    u32 D;
+    memcpy( &D, Data + i * 4, 4 );
+    OutX[i] = (float)((i32)(D << 21) >> 21);
+    OutY[i] = (float)((i32)(D << 10) >> 21);
+    OutZ[i] = (float)((i32)D >> 22);
+  }
+}
+
+/*-----------------------------------------------------------------------------
+ * GatherMeshTriangles
+ * Flattens the triangles of a UMesh or ULodMesh into frame vertex indices
+ * and texture coordinates. LodMesh weapon triangles are left out
+-----------------------------------------------------------------------------*/
+void GatherMeshTriangles( UMesh* Mesh, std::vector<FMeshTriangle>& OutTris )
+{
+  if ( Mesh->IsA( ULodMesh::StaticClass() ) )
+  {
+    ULodMesh* LodMesh = (ULodMesh*)Mesh;
+    OutTris.reserve( LodMesh->Faces.Size() );
+    for ( int i = 0; i < LodMesh->Faces.Size(); i++ )
+    {
+      FMeshFace& Face = LodMesh->Faces[i];
+      FMeshTriangle Tri;
+      Tri.Material = Face.MaterialIndex;
+      for ( int j = 0; j < 3; j++ )
+      {
+        FMeshWedge& Wedge = LodMesh->Wedges[Face.iWedge[j]];
+        Tri.iVertex[j] = LodMesh->SpecialVerts + Wedge.iVertex;
+        Tri.U[j] = Wedge.TexUV.U / 255.0f;
+        Tri.V[j] = Wedge.TexUV.V / 255.0f;
+      }
+      OutTris.push_back( Tri );
+    }
+  }
+  else
+  {
+    OutTris.reserve( Mesh->Tris.Size() );
+    for ( int i = 0; i < Mesh->Tris.Size(); i++ )
+    {
+      FMeshTri& MeshTri = Mesh->Tris[i];
+      FMeshTriangle Tri;
+      Tri.Material = MeshTri.TextureIndex;
+      for ( int j = 0; j < 3; j++ )
+      {
+        Tri.iVertex[j] = MeshTri.iVertex[j];
+        Tri.U[j] = MeshTri.Tex[j].U / 255.0f;
+        Tri.V[j] = MeshTri.Tex[j].V / 255.0f;
+      }
+      OutTris.push_back( Tri );
+    }
+  }
+}
+
+/*-----------------------------------------------------------------------------
+ * ExportMeshFramesObj
+ * Writes one .obj file per frame. Texture coordinates and faces are the
+ * same for every frame, so they are formatted once and copied into each
+ * file. Frames are unpacked and written in parallel.
+-----------------------------------------------------------------------------*/
+struct FFrameJob
+{
+  int Frame;
+  char FileName[4096];
+};
+
+static const char* FindFrameSequence( UMesh* Mesh, int Frame, int& OutIndex )
+{
+  for ( int i = 0; i < Mesh->AnimSeqs.Size(); i++ )
+  {
+    FMeshAnimSeq& Seq = Mesh->AnimSeqs[i];
+    if ( Frame >= Seq.StartFrame && Frame < Seq.StartFrame + Seq.NumFrames )
+    {
+      OutIndex = Frame - Seq.StartFrame;
+      return Seq.Name.Data();
+    }
+  }
+  return NULL;
+}
+
+static bool IsSequenceSelected( const char* SeqName, const char* Sequences )
+{
+  size_t NameLen = strlen( SeqName );
+  for ( const char* It = Sequences; *It != '\0'; )
+  {
+    const char* End = strchr( It, ',' );
+    size_t Len = (End != NULL) ? (size_t)(End - It) : strlen( It );
+    if ( Len == NameLen && strnicmp( It, SeqName, Len ) == 0 )
+      return true;
+    if ( End == NULL )
+      break;
+    It = End + 1;
+  }
+  return false;
+}
+
+bool ExportMeshFramesObj( UMesh* Mesh, const char* Path, const char* Sequences )
+{
+  int NumVerts = Mesh->FrameVerts;
+  int NumFrames = Mesh->AnimFrames;
+  if ( NumVerts <= 0 || Mesh->Verts.Size() < (size_t)NumFrames * NumVerts )
+  {
+    GLogf( LOG_ERR, "Mesh '%s' has no usable frame data", Mesh->Name.Data() );
+    return false;
+  }
+
+  // Pick the frames to write
+  std::vector<FFrameJob> Jobs;
+  for ( int i = 0; i < NumFrames; i++ )
+  {
+    int SeqFrame = 0;
+    const char* SeqName = FindFrameSequence( Mesh, i, SeqFrame );
+    if ( Sequences != NULL && (SeqName == NULL || !IsSequenceSelected( SeqName, Sequences )) )
+      continue;
+
+    Jobs.push_back( FFrameJob() );
+    FFrameJob& Job = Jobs.back();
+    Job.Frame = i;
+    if ( SeqName != NULL )
+      snprintf( Job.FileName, sizeof( Job.FileName ), "%s/%s_%s_%03d.obj", Path, Mesh->Name.Data(), SeqName, SeqFrame );
+    else
+      snprintf( Job.FileName, sizeof( Job.FileName ), "%s/%s_%03d.obj", Path, Mesh->Name.Data(), i );
+  }
+
+  if ( Jobs.size() == 0 )
+  {
+    if ( Sequences != NULL )
+      GLogf( LOG_WARN, "No frames of mesh '%s' matched '%s'", Mesh->Name.Data(), Sequences );
+    else
+      GLogf( LOG_WARN, "Mesh '%s' has no frames to export", Mesh->Name.Data() );
+    return false;
+  }
+
+  // Texture coordinates and faces, shared by all frames
+  std::vector<FMeshTriangle> Tris;
+  GatherMeshTriangles( Mesh, Tris );
+
+  FTextBuffer Shared;
+  for ( size_t i = 0; i < Tris.size(); i++ )
+  {
+    for ( int j = 0; j < 3; j++ )
+    {
+      Shared.Write( "vt " );
+      Shared.WriteFloat( Tris[i].U[j] );
+      Shared.Write( " " );
+      Shared.WriteFloat( 1.0f - Tris[i].V[j] );
+      Shared.Write( "\n" );
+    }
+  }
+
+  int Material = -1;
+  for ( size_t i = 0; i < Tris.size(); i++ )
+  {
+    FMeshTriangle& Tri = Tris[i];
+    if ( Tri.iVertex[0] >= NumVerts || Tri.iVertex[1] >= NumVerts || Tri.iVertex[2] >= NumVerts )
+      continue;
+
+    if ( Tri.Material != Material )
+    {
+      Material = Tri.Material;
+      Shared.Write( "g Skin" );
+      Shared.WriteInt( Material );
+      Shared.Write( "\n" );
+    }
+
+    Shared.Write( "f" );
+    for ( int j = 0; j < 3; j++ )
+    {
+      Shared.Write( " " );
+      Shared.WriteInt( Tri.iVertex[j] + 1 );
+      Shared.Write( "/" );
+      Shared.WriteInt( i * 3 + j + 1 );
+    }
+    Shared.Write( "\n" );
+  }
+
+  std::atomic<int> NumFailed( 0 );
+  ParallelFor( Jobs.size(), [&]( int iJob )
+  {
+    FFrameJob& Job = Jobs[iJob];
+    FILE* File = fopen( Job.FileName, "wb" );
+    if ( File == NULL )
+    {
+      GLogf( LOG_ERR, "Failed to open '%s' for writing", Job.FileName );
+      NumFailed++;
+      return;
+    }
+
+    std::vector<float> Pos( NumVerts * 3 );
+    float* X = &Pos[0];
+    float* Y = X + NumVerts;
+    float* Z = Y + NumVerts;
+    UnpackMeshVerts( &Mesh->Verts[Job.Frame * NumVerts], NumVerts, X, Y, Z );
+
+    {
+      FTextBuffer Out( File );
+      Out.Write( "# " );
+      Out.Write( Mesh->Name.Data() );
+      Out.Write( " frame " );
+      Out.WriteInt( Job.Frame );
+      Out.Write( "\n" );
+
+      for ( int i = 0; i < NumVerts; i++ )
+      {
+        Out.Write( "v " );
+        Out.WriteFloat( X[i] );
+        Out.Write( " " );
+        Out.WriteFloat( Y[i] );
+        Out.Write( " " );
+        Out.WriteFloat( Z[i] );
+        Out.Write( "\n" );
+      }
+
+      Out.Write( Shared.Data, Shared.Len );
+    }
+
+    if ( ferror( File ) )
+      NumFailed++;
+    fclose( File );
+  });
+
+  GLogf( LOG_INFO, "Exported %d frames of mesh '%s'", (int)Jobs.size() - (int)NumFailed, Mesh->Name.Data() );
+  return NumFailed == 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * ExportMeshGlb
+ * Writes a mesh as binary glTF. The first selected frame is the base mesh
+ * and every selected frame becomes a morph target, so each animation
+ * sequence turns into a glTF animation that moves the morph weights from
+ * one frame's target to the next. Positions are converted to Y up by
+ * swapping Y and Z, like level geometry.
+ *
+ * With bQuantize, positions are stored as 16-bit integers (mesh positions
+ * are integers to begin with, so nothing is lost), normals as normalized
+ * 16-bit values and texture coordinates as bytes, using
+ * KHR_mesh_quantization. Everything is written straight into the binary
+ * chunk, frames in parallel.
+-----------------------------------------------------------------------------*/
+struct FGlbMeshVertex
+{
+  int iFrameVert;
+  u8 U, V;
+};
+
+struct FGlbMeshGroup
+{
+  int Material;
+  std::vector<u32> Indices;
+};
+
+// Unpacks one frame and computes smooth normals, both in glTF space
+static void ComputeGlbFrame( UMesh* Mesh, int Frame, std::vector<FMeshTriangle>& Tris,
+  std::vector<FGlbMeshVertex>& Verts, float* OutPos, float* OutNormal )
+{
+  int NumFrameVerts = Mesh->FrameVerts;
+  std::vector<float> Scratch( NumFrameVerts * 6, 0.0f );
+  float* X = &Scratch[0];
+  float* Y = X + NumFrameVerts;
+  float* Z = Y + NumFrameVerts;
+  float* N = Z + NumFrameVerts;
+  UnpackMeshVerts( &Mesh->Verts[Frame * NumFrameVerts], NumFrameVerts, X, Y, Z );
+
+  // Area weighted face normals, summed per frame vertex. Swapping Y and Z
+  // mirrors the mesh, so the edges are crossed the other way around to get
+  // normals that face the same way as glTF's counter clockwise winding
+  for ( size_t i = 0; i < Tris.size(); i++ )
+  {
+    int* Idx = Tris[i].iVertex;
+    float E1[3] = { X[Idx[2]] - X[Idx[0]], Y[Idx[2]] - Y[Idx[0]], Z[Idx[2]] - Z[Idx[0]] };
+    float E2[3] = { X[Idx[1]] - X[Idx[0]], Y[Idx[1]] - Y[Idx[0]], Z[Idx[1]] - Z[Idx[0]] };
+    float Cross[3] =
+    {
+      E1[1] * E2[2] - E1[2] * E2[1],
+      E1[2] * E2[0] - E1[0] * E2[2],
+      E1[0] * E2[1] - E1[1] * E2[0],
+    };
+
+    for ( int j = 0; j < 3; j++ )
+      for ( int k = 0; k < 3; k++ )
+        N[Idx[j] * 3 + k] += Cross[k];
+  }
+
+  for ( size_t i = 0; i < Verts.size(); i++ )
+  {
+    int Src = Verts[i].iFrameVert;
+    float* Normal = &N[Src * 3];
+    float Len = sqrtf( Normal[0] * Normal[0] + Normal[1] * Normal[1] + Normal[2] * Normal[2] );
+    float Scale = (Len > 0.0f) ? 1.0f / Len : 0.0f;
+
+    OutPos[i * 3 + 0] = X[Src];
+    OutPos[i * 3 + 1] = Z[Src];
+    OutPos[i * 3 + 2] = Y[Src];
+    OutNormal[i * 3 + 0] = Normal[0] * Scale;
+    OutNormal[i * 3 + 1] = Normal[2] * Scale;
+    OutNormal[i * 3 + 2] = Normal[1] * Scale;
+  }
+}
+
+// Stores Num vec3s at Stride bytes apart, as floats or as 16-bit values.
+// Min and Max get the bounds of what was stored
+static void StoreGlbVec3( u8* Dest, const float* Src, int Num, bool bQuantize, bool bNormal, float* Min, float* Max )
+{
+  for ( int k = 0; k < 3; k++ )
+  {
+    Min[k] = FLT_MAX;
+    Max[k] = -FLT_MAX;
+  }
+
+  for ( int i = 0; i < Num; i++ )
+  {
+    for ( int k = 0; k < 3; k++ )
+    {
+      float Value = Src[i * 3 + k];
+      if ( bQuantize )
+      {
+        if ( bNormal )
+          Value = (Value < -1.0f) ? -1.0f : (Value > 1.0f) ? 1.0f : Value;
+        i16 Packed = (i16)lrintf( bNormal ? Value * 32767.0f : Value );
+        memcpy( Dest + i * 8 + k * 2, &Packed, 2 );
+        Value = Packed;
+      }
+      else
+      {
+        memcpy( Dest + i * 12 + k * 4, &Value, 4 );
+      }
+
+      if ( Value < Min[k] ) Min[k] = Value;
+      if ( Value > Max[k] ) Max[k] = Value;
+    }
+  }
+}
+
+bool ExportMeshGlb( UMesh* Mesh, const char* Path, bool bQuantize, const char* Sequences )
+{
+  int NumFrameVerts = Mesh->FrameVerts;
+  int NumFrames = Mesh->AnimFrames;
+  if ( NumFrameVerts <= 0 || NumFrames <= 0 || Mesh->Verts.Size() < (size_t)NumFrames * NumFrameVerts )
+  {
+    GLogf( LOG_ERR, "Mesh '%s' has no usable frame data", Mesh->Name.Data() );
+    return false;
+  }
+
+  // Every selected frame becomes a morph target
+  std::vector<int> Targets;
+  std::vector<int> FrameTarget( NumFrames, -1 );
+  for ( int i = 0; i < NumFrames; i++ )
+  {
+    int SeqFrame = 0;
+    const char* SeqName = FindFrameSequence( Mesh, i, SeqFrame );
+    if ( Sequences != NULL && (SeqName == NULL || !IsSequenceSelected( SeqName, Sequences )) )
+      continue;
+
+    FrameTarget[i] = Targets.size();
+    Targets.push_back( i );
+  }
+
+  if ( Targets.size() == 0 )
+  {
+    if ( Sequences != NULL )
+      GLogf( LOG_WARN, "No frames of mesh '%s' matched '%s'", Mesh->Name.Data(), Sequences );
+    else
+      GLogf( LOG_WARN, "Mesh '%s' has no frames to export", Mesh->Name.Data() );
+    return false;
+  }
+
+  // glTF vertices are unique frame vertex and texture coordinate pairs
+  std::vector<FMeshTriangle> Tris;
+  GatherMeshTriangles( Mesh, Tris );
+
+  std::vector<FGlbMeshVertex> Verts;
+  std::vector<FGlbMeshGroup> Groups;
+  std::unordered_map<u64, u32> VertMap;
+  size_t NumTris = 0;
+  for ( size_t i = 0; i < Tris.size(); i++ )
+  {
+    FMeshTriangle& Tri = Tris[i];
+    if ( Tri.iVertex[0] >= NumFrameVerts || Tri.iVertex[1] >= NumFrameVerts || Tri.iVertex[2] >= NumFrameVerts )
+      continue;
+
+    size_t iGroup;
+    for ( iGroup = 0; iGroup < Groups.size(); iGroup++ )
+      if ( Groups[iGroup].Material == Tri.Material )
+        break;
+
+    if ( iGroup == Groups.size() )
+    {
+      Groups.push_back( FGlbMeshGroup() );
+      Groups.back().Material = Tri.Material;
+    }
+
+    for ( int j = 0; j < 3; j++ )
+    {
+      FGlbMeshVertex Vert;
+      Vert.iFrameVert = Tri.iVertex[j];
+      Vert.U = (u8)lrintf( Tri.U[j] * 255.0f );
+      Vert.V = (u8)lrintf( Tri.V[j] * 255.0f );
+
+      u64 Key = ((u64)Vert.iFrameVert << 16) | (Vert.U << 8) | Vert.V;
+      std::unordered_map<u64, u32>::iterator It = VertMap.find( Key );
+      if ( It == VertMap.end() )
+      {
+        It = VertMap.insert( std::make_pair( Key, (u32)Verts.size() ) ).first;
+        Verts.push_back( Vert );
+      }
+      Groups[iGroup].Indices.push_back( It->second );
+    }
+    NumTris++;
+  }
+
+  int NumVerts = Verts.size();
+  int NumTargets = Targets.size();
+  int Stride = bQuantize ? 8 : 12;
+  int ComponentType = bQuantize ? GLTF_SHORT : GLTF_FLOAT;
+  FGlbWriter Glb;
+
+  // Base mesh
+  std::vector<float> BasePos( NumVerts * 3 );
+  std::vector<float> BaseNormal( NumVerts * 3 );
+  ComputeGlbFrame( Mesh, Targets[0], Tris, Verts, BasePos.data(), BaseNormal.data() );
+
+  float Min[3], Max[3];
+  int PosView, NormView, UVView;
+  StoreGlbVec3( Glb.AllocBufferView( NumVerts * Stride, GLTF_ARRAY_BUFFER, Stride, &PosView ),
+    BasePos.data(), NumVerts, bQuantize, false, Min, Max );
+  int PosAcc = Glb.AddAccessor( PosView, ComponentType, NumVerts, "VEC3", Min, Max, 3 );
+
+  StoreGlbVec3( Glb.AllocBufferView( NumVerts * Stride, GLTF_ARRAY_BUFFER, Stride, &NormView ),
+    BaseNormal.data(), NumVerts, bQuantize, true, Min, Max );
+  int NormAcc = Glb.AddAccessor( NormView, ComponentType, NumVerts, "VEC3", NULL, NULL, 0, bQuantize );
+
+  u8* UVData = Glb.AllocBufferView( NumVerts * (bQuantize ? 4 : 8), GLTF_ARRAY_BUFFER, bQuantize ? 4 : 8, &UVView );
+  for ( int i = 0; i < NumVerts; i++ )
+  {
+    if ( bQuantize )
+    {
+      UVData[i * 4 + 0] = Verts[i].U;
+      UVData[i * 4 + 1] = Verts[i].V;
+    }
+    else
+    {
+      float UV[2] = { Verts[i].U / 255.0f, Verts[i].V / 255.0f };
+      memcpy( UVData + i * 8, UV, sizeof( UV ) );
+    }
+  }
+  int UVAcc = Glb.AddAccessor( UVView, bQuantize ? GLTF_UNSIGNED_BYTE : GLTF_FLOAT, NumVerts, "VEC2",
+    NULL, NULL, 0, bQuantize );
+
+  // Morph targets; position deltas of all frames go in one view and normal
+  // deltas in another, so that frames can be filled in parallel. Normal
+  // deltas between two unit normals reach +-2, more than a normalized short
+  // holds, so they are always stored as floats
+  int TargetView;
+  size_t TargetSize = (size_t)NumVerts * Stride;
+  size_t TargetNormSize = (size_t)NumVerts * 12;
+  u8* TargetData = Glb.AllocBufferView( TargetSize * NumTargets, GLTF_ARRAY_BUFFER, Stride, &TargetView );
+  std::vector<u8> TargetNormData( TargetNormSize * NumTargets );
+  std::vector<float> TargetBounds( NumTargets * 6 );
+
+  ParallelFor( NumTargets, [&]( int iTarget )
+  {
+    std::vector<float> Pos( NumVerts * 3 );
+    std::vector<float> Normal( NumVerts * 3 );
+    ComputeGlbFrame( Mesh, Targets[iTarget], Tris, Verts, Pos.data(), Normal.data() );
+    for ( int i = 0; i < NumVerts * 3; i++ )
+    {
+      Pos[i] -= BasePos[i];
+      Normal[i] -= BaseNormal[i];
+    }
+
+    float NormMin[3], NormMax[3];
+    u8* Dest = TargetData + TargetSize * iTarget;
+    StoreGlbVec3( Dest, Pos.data(), NumVerts, bQuantize, false, &TargetBounds[iTarget * 6], &TargetBounds[iTarget * 6 + 3] );
+    StoreGlbVec3( &TargetNormData[TargetNormSize * iTarget], Normal.data(), NumVerts, false, true, NormMin, NormMax );
+  });
+
+  int TargetNormView = Glb.AddBufferView( TargetNormData.data(), TargetNormData.size(), GLTF_ARRAY_BUFFER, 12 );
+
+  FTextBuffer TargetJson;
+  FTextBuffer TargetNames;
+  FTextBuffer Weights;
+  for ( int i = 0; i < NumTargets; i++ )
+  {
+    size_t Offset = TargetSize * i;
+    int TargetPosAcc = Glb.AddAccessor( TargetView, ComponentType, NumVerts, "VEC3",
+      &TargetBounds[i * 6], &TargetBounds[i * 6 + 3], 3, false, Offset );
+    int TargetNormAcc = Glb.AddAccessor( TargetNormView, GLTF_FLOAT, NumVerts, "VEC3",
+      NULL, NULL, 0, false, TargetNormSize * i );
+
+    if ( i > 0 )
+    {
+      TargetJson.Write( "," );
+      TargetNames.Write( "," );
+      Weights.Write( "," );
+    }
+    TargetJson.Write( "{\"POSITION\":" );
+    TargetJson.WriteInt( TargetPosAcc );
+    TargetJson.Write( ",\"NORMAL\":" );
+    TargetJson.WriteInt( TargetNormAcc );
+    TargetJson.Write( "}" );
+    Weights.Write( "0" );
+
+    char Name[256];
+    int SeqFrame = 0;
+    const char* SeqName = FindFrameSequence( Mesh, Targets[i], SeqFrame );
+    if ( SeqName != NULL )
+      snprintf( Name, sizeof( Name ), "%s_%03d", SeqName, SeqFrame );
+    else
+      snprintf( Name, sizeof( Name ), "Frame_%03d", Targets[i] );
+    TargetNames.WriteJsonString( Name );
+  }
+
+  // Triangles, one primitive per skin
+  bool bShortIndices = (NumVerts <= 0xFFFF);
+  FTextBuffer Json;
+  FTextBuffer Materials;
+  Json.Write( "\"meshes\":[{\"name\":" );
+  Json.WriteJsonString( Mesh->Name.Data() );
+  Json.Write( ",\"primitives\":[" );
+  for ( size_t i = 0; i < Groups.size(); i++ )
+  {
+    std::vector<u32>& Indices = Groups[i].Indices;
+    OptimizeVertexCache( Indices.data(), Indices.size() );
+
+    int IdxView;
+    if ( bShortIndices )
+    {
+      u8* Dest = Glb.AllocBufferView( Indices.size() * sizeof( u16 ), GLTF_ELEMENT_ARRAY_BUFFER, 0, &IdxView );
+      for ( size_t j = 0; j < Indices.size(); j++ )
+      {
+        u16 Index = (u16)Indices[j];
+        memcpy( Dest + j * sizeof( u16 ), &Index, sizeof( u16 ) );
+      }
+    }
+    else
+    {
+      IdxView = Glb.AddBufferView( Indices.data(), Indices.size() * sizeof( u32 ), GLTF_ELEMENT_ARRAY_BUFFER );
+    }
+    int IdxAcc = Glb.AddAccessor( IdxView, bShortIndices ? GLTF_UNSIGNED_SHORT : GLTF_UNSIGNED_INT,
+      Indices.size(), "SCALAR" );
+
+    if ( i > 0 )
+    {
+      Json.Write( "," );
+      Materials.Write( "," );
+    }
+    Json.Write( "{\"attributes\":{\"POSITION\":" );
+    Json.WriteInt( PosAcc );
+    Json.Write( ",\"NORMAL\":" );
+    Json.WriteInt( NormAcc );
+    Json.Write( ",\"TEXCOORD_0\":" );
+    Json.WriteInt( UVAcc );
+    Json.Write( "},\"indices\":" );
+    Json.WriteInt( IdxAcc );
+    Json.Write( ",\"material\":" );
+    Json.WriteInt( i );
+    Json.Write( ",\"targets\":[" );
+    Json.Write( TargetJson.Data, TargetJson.Len );
+    Json.Write( "]}" );
+
+    int Material = Groups[i].Material;
+    UTexture* Texture = NULL;
+    if ( Material >= 0 && Material < Mesh->Textures.Size() )
+      Texture = Mesh->Textures[Material];
+
+    char MatName[256];
+    if ( Texture != NULL )
+      snprintf( MatName, sizeof( MatName ), "%s", Texture->Name.Data() );
+    else
+      snprintf( MatName, sizeof( MatName ), "Skin%d", Material );
+    Materials.Write( "{\"name\":" );
+    Materials.WriteJsonString( MatName );
+    Materials.Write( "}" );
+  }
+  Json.Write( "],\"weights\":[" );
+  Json.Write( Weights.Data, Weights.Len );
+  Json.Write( "],\"extras\":{\"targetNames\":[" );
+  Json.Write( TargetNames.Data, TargetNames.Len );
+  Json.Write( "]}}],\"materials\":[" );
+  Json.Write( Materials.Data, Materials.Len );
+  Json.Write( "],\"nodes\":[{\"name\":" );
+  Json.WriteJsonString( Mesh->Name.Data() );
+  Json.Write( ",\"mesh\":0}],\"scenes\":[{\"nodes\":[0]}],\"scene\":0" );
+
+  // Animations step through the targets of their frames. Weights are
+  // stored as normalized bytes, one row of NumTargets per key
+  int NumAnims = 0;
+  for ( int i = 0; i < Mesh->AnimSeqs.Size(); i++ )
+  {
+    FMeshAnimSeq& Seq = Mesh->AnimSeqs[i];
+    std::vector<float> Times;
+    std::vector<int> Keys;
+    float Rate = (Seq.Rate > 0.0f) ? Seq.Rate : 1.0f;
+    for ( int j = 0; j < Seq.NumFrames; j++ )
+    {
+      int Frame = Seq.StartFrame + j;
+      if ( Frame < 0 || Frame >= NumFrames || FrameTarget[Frame] < 0 )
+        continue;
+      Times.push_back( j / Rate );
+      Keys.push_back( FrameTarget[Frame] );
+    }
+
+    if ( Keys.size() == 0 )
+      continue;
+
+    int TimeView = Glb.AddBufferView( Times.data(), Times.size() * sizeof( float ), 0 );
+    int TimeAcc = Glb.AddAccessor( TimeView, GLTF_FLOAT, Times.size(), "SCALAR",
+      &Times.front(), &Times.back(), 1 );
+
+    int WeightView;
+    u8* WeightData = Glb.AllocBufferView( Keys.size() * NumTargets, 0, 0, &WeightView );
+    memset( WeightData, 0, Keys.size() * NumTargets );
+    for ( size_t j = 0; j < Keys.size(); j++ )
+      WeightData[j * NumTargets + Keys[j]] = 255;
+    int WeightAcc = Glb.AddAccessor( WeightView, GLTF_UNSIGNED_BYTE, Keys.size() * NumTargets, "SCALAR",
+      NULL, NULL, 0, true );
+
+    Json.Write( (NumAnims == 0) ? ",\"animations\":[" : "," );
+    Json.Write( "{\"name\":" );
+    Json.WriteJsonString( Seq.Name.Data() );
+    Json.Write( ",\"samplers\":[{\"input\":" );
+    Json.WriteInt( TimeAcc );
+    Json.Write( ",\"output\":" );
+    Json.WriteInt( WeightAcc );
+    Json.Write( ",\"interpolation\":\"LINEAR\"}],\"channels\":[{\"sampler\":0,\"target\":{\"node\":0,\"path\":\"weights\"}}]}" );
+    NumAnims++;
+  }
+  if ( NumAnims > 0 )
+    Json.Write( "]" );
+
+  if ( bQuantize )
+    Json.Write( ",\"extensionsUsed\":[\"KHR_mesh_quantization\"],\"extensionsRequired\":[\"KHR_mesh_quantization\"]" );
+  Json.Write( "", 1 );
+
+  char FileName[4096];
+  snprintf( FileName, sizeof( FileName ), "%s/%s.glb", Path, Mesh->Name.Data() );
+
+  GLogf( LOG_INFO, "Exporting mesh '%s' with %d vertices, %d triangles, %d morph targets and %d animations",
+    Mesh->Name.Data(), NumVerts, (int)NumTris, NumTargets, NumAnims );
+
+  return Glb.Save( FileName, Json.Data );
+}
+
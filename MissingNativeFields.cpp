@@ -49,70 +49,145 @@ const char* const CppPropNames[] =
   "u64"
 };
 
-char* GetCppClassName( UClass* Class )
+// Name helpers write into the caller's buffer so that they can be used from
+// any thread
+char* GetCppClassName( UClass* Class, char* Out, size_t OutSize )
 {
-  // Not thread-safe
-  static char ClassName[128] = { 0 };
-  memset( ClassName, 0, sizeof( ClassName ) );
-
-  if ( Class->ClassIsA( AActor::StaticClass() ) )
-    ClassName[0] = 'A';
-  else
-    ClassName[0] = 'U';
-
-  strcat( ClassName, Class->Name.Data() );
-  return ClassName;
+  snprintf( Out, OutSize, "%c%s", Class->ClassIsA( AActor::StaticClass() ) ? 'A' : 'U', Class->Name.Data() );
+  return Out;
 }
 
-char* GetCppClassNameProp( UProperty* Prop )
+char* GetCppClassNameProp( UProperty* Prop, char* Out, size_t OutSize )
 {
   UObjectProperty* ObjProp = (UObjectProperty*)Prop;
-  char* ClassName = GetCppClassName( ObjProp->ObjectType );
-  strcat( ClassName, "*" );
-  return ClassName;
+  GetCppClassName( ObjProp->ObjectType, Out, OutSize );
+  strncat( Out, "*", OutSize - strlen( Out ) - 1 );
+  return Out;
 }
 
-char* GetCppArrayType( UProperty* Prop )
+const char* GetCppArrayType( UProperty* Prop, char* Out, size_t OutSize )
 {
-  // Not thread-safe
-  static char ArrayName[128] = { 0 };
-  memset( ArrayName, 0, sizeof( ArrayName ) );
-
   UArrayProperty* ArrayProp = (UArrayProperty*)Prop;
   if ( ArrayProp->Inner->PropertyType == PROP_Object )
-    return GetCppClassNameProp( ArrayProp->Inner );
+    return GetCppClassNameProp( ArrayProp->Inner, Out, OutSize );
   else if ( ArrayProp->Inner->PropertyType == PROP_Struct )
   {
-    ArrayName[0] = 'F';
-    strcat( ArrayName, ((UStructProperty*)ArrayProp->Inner)->Struct->Name.Data() );
-    return ArrayName;
+    snprintf( Out, OutSize, "F%s", ((UStructProperty*)ArrayProp->Inner)->Struct->Name.Data() );
+    return Out;
   }
 
-  return (char*)CppPropNames[ArrayProp->Inner->PropertyType];
+  return CppPropNames[ArrayProp->Inner->PropertyType];
+}
+
+// Writes the C++ type of a property, as it would be declared in a class
+const char* GetCppPropType( UProperty* Prop, char* Out, size_t OutSize )
+{
+  char Inner[256];
+  if ( Prop->PropertyType == PROP_Struct )
+    snprintf( Out, OutSize, "F%s", ((UStructProperty*)Prop)->Struct->Name.Data() );
+  else if ( Prop->PropertyType == PROP_Object )
+    GetCppClassNameProp( Prop, Out, OutSize );
+  else if ( Prop->PropertyType == PROP_Array )
+    snprintf( Out, OutSize, "TArray<%s>*", GetCppArrayType( Prop, Inner, sizeof( Inner ) ) );
+  else
+    snprintf( Out, OutSize, "%s", CppPropNames[Prop->PropertyType] );
+  return Out;
+}
+
+static inline bool IsMissingNativeField( UClass* Class, UField* Field )
+{
+  UProperty* Prop = SafeCast<UProperty>( Field );
+  return Prop && Prop->Offset == MAX_UINT32 && Prop->Outer == Class;
 }
 
 /*-----------------------------------------------------------------------------
- * missingnativefields
- * This reports any missing properties and prints them in a way that can
- * be pasted to C++ code
+ * FormatMissingFields
+ * Writes the C++ declarations and property links for a class's missing
+ * fields, and the same information as a JSON object. Returns the number of
+ * missing fields; nothing is written if there are none
 -----------------------------------------------------------------------------*/
-int missingnativefields( int argc, char** argv )
+static int FormatMissingFields( UClass* Class, const char* PkgName, FTextBuffer& Cpp, FTextBuffer& Json )
 {
-  if ( argc < 1 )
+  char CppClass[256];
+  char CppType[256];
+  char Line[1024];
+  int NumMissing = 0;
+
+  GetCppClassName( Class, CppClass, sizeof( CppClass ) );
+
+  // Iterate through all class properties for dumping cpp class text
+  for ( UField* It = Class->Children; It != NULL; It = It->Next )
   {
-    printf( "levelexport usage:\n" );
-    printf( "\tlucc missingnativefields <Package Name>\n\n" );
-    return ERR_BAD_ARGS;
+    if ( !IsMissingNativeField( Class, It ) )
+      continue;
+
+    UProperty* Prop = (UProperty*)It;
+    if ( NumMissing == 0 )
+    {
+      Cpp.Write( "//====================================================================\n" );
+      snprintf( Line, sizeof( Line ), "// Missing native fields for class '%s'\n", Class->Name.Data() );
+      Cpp.Write( Line );
+      Cpp.Write( "//====================================================================\n" );
+
+      Json.Write( "    { \"package\": " );
+      Json.WriteJsonString( PkgName );
+      Json.Write( ", \"class\": " );
+      Json.WriteJsonString( Class->Name.Data() );
+      Json.Write( ", \"cppClass\": " );
+      Json.WriteJsonString( CppClass );
+      Json.Write( ", \"fields\": [" );
+    }
+
+    GetCppPropType( Prop, CppType, sizeof( CppType ) );
+    if ( Prop->ArrayDim > 1 )
+      snprintf( Line, sizeof( Line ), "  %s %s[%i];\n", CppType, Prop->Name.Data(), Prop->ArrayDim );
+    else
+      snprintf( Line, sizeof( Line ), "  %s %s;\n", CppType, Prop->Name.Data() );
+    Cpp.Write( Line );
+
+    Json.Write( (NumMissing == 0) ? "\n      { \"name\": " : ",\n      { \"name\": " );
+    Json.WriteJsonString( Prop->Name.Data() );
+    Json.Write( ", \"cppType\": " );
+    Json.WriteJsonString( CppType );
+    Json.Write( ", \"arrayDim\": " );
+    Json.WriteInt( Prop->ArrayDim );
+    Json.Write( " }" );
+
+    NumMissing++;
   }
 
-  char* PkgName = argv[0];
+  if ( NumMissing == 0 )
+    return 0;
 
-  // Load package
-  USystem::LogLevel = LOG_CRIT;
+  Json.Write( "\n    ] }" );
+
+  // Iterate again, but this time spit out LINK_NATIVE_PROPERTY stuff
+  snprintf( Line, sizeof( Line ), "BEGIN_PROPERTY_LINK( %s, %i )\n", CppClass, NumMissing );
+  Cpp.Write( Line );
+  for ( UField* It = Class->Children; It != NULL; It = It->Next )
+  {
+    if ( IsMissingNativeField( Class, It ) )
+    {
+      snprintf( Line, sizeof( Line ), "  LINK_NATIVE_PROPERTY( %s );\n", It->Name.Data() );
+      Cpp.Write( Line );
+    }
+  }
+  Cpp.Write( "END_PROPERTY_LINK()\n" );
+
+  return NumMissing;
+}
+
+/*-----------------------------------------------------------------------------
+ * LoadPackageClasses
+ * Loads every class in a package. Loading goes through libunr, so this
+ * has to happen on the main thread
+-----------------------------------------------------------------------------*/
+int LoadPackageClasses( const char* PkgName, std::vector<FClassEntry>& OutClasses )
+{
   UPackage* Pkg = UPackage::StaticLoadPackage( PkgName );
   if ( Pkg == NULL )
   {
-    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist\n" );
+    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist", PkgName );
     return ERR_MISSING_PKG;
   }
 
@@ -124,66 +199,196 @@ int missingnativefields( int argc, char** argv )
     const char* ObjName = Pkg->ResolveNameFromIdx( Export->ObjectName );
 
     // Why are there 'None' exports at all???
-    if ( strnicmp( ObjName, "None", 4 ) != 0 )
+    if ( strnicmp( ObjName, "None", 4 ) == 0 )
+      continue;
+
+    // Check class type
+    const char* ClassName = Pkg->ResolveNameFromObjRef( Export->Class );
+    if ( strnicmp( ClassName, "None", 4 ) != 0 )
+      continue;
+
+    UClass* Class = (UClass*)UObject::StaticLoadObject( Pkg, Export, UClass::StaticClass(), NULL, LOAD_Immediate );
+    if ( !Class )
     {
-      // Check class type
-      const char* ClassName = Pkg->ResolveNameFromObjRef( Export->Class );
-      if ( strnicmp( ClassName, "None", 4 ) == 0 )
+      GLogf( LOG_CRIT, "Failed to load object '%s' in package '%s'", ObjName, PkgName );
+      return ERR_BAD_OBJECT;
+    }
+
+    FClassEntry Entry = { PkgName, Class };
+    OutClasses.push_back( Entry );
+  }
+
+  return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * missingnativefields
+ * This reports any missing properties and prints them in a way that can
+ * be pasted to C++ code. With -a, every script package in the game's
+ * System folder is checked. Classes are loaded one after another, then
+ * checked and formatted on the thread pool; the output keeps package and
+ * class order
+-----------------------------------------------------------------------------*/
+int missingnativefields( int argc, char** argv )
+{
+  int i = 0;
+  bool bAllPackages = false;
+  char* OutName = NULL;
+
+  // Argument parsing
+  while ( 1 )
+  {
+    if ( argc == 0 || i > argc || (i == argc && !bAllPackages) )
+    {
+    BadOpt:
+      printf( "missingnativefields usage:\n" );
+      printf( "\tlucc [gopts] missingnativefields [copts] <Package Name>\n" );
+      printf( "\tlucc [gopts] missingnativefields [copts] -a\n\n" );
+
+      printf( "Command options:\n" );
+      printf( "\t-a                    - Checks (a)ll script packages of the game\n" );
+      printf( "\t-o \"<FileName>\"     - Writes (o)utput to <FileName>.h and <FileName>.json\n" );
+      printf( "\n" );
+      return ERR_BAD_ARGS;
+    }
+
+    if ( i == argc )
+      break;
+
+    if ( argv[i][0] == '-' )
+    {
+      switch ( argv[i][1] )
       {
-        UClass* Class = (UClass*)UObject::StaticLoadObject( Pkg, Export, UClass::StaticClass(), NULL, LOAD_Immediate );
-        if ( !Class )
-        {
-          GLogf( LOG_CRIT, "Failed to load object '%s'\n", ClassName );
-          return ERR_BAD_OBJECT;
-        }
-
-        // Iterate through all class properties for dumping cpp class text
-        int NumMissing = 0;
-        for ( UField* It = Class->Children; It != NULL; It = It->Next )
-        {
-          UProperty* Prop = SafeCast<UProperty>( It );
-          if ( Prop && Prop->Offset == MAX_UINT32 && Prop->Outer == Class )
-          {
-            if ( NumMissing == 0 )
-            {
-              printf( "//====================================================================\n" );
-              printf( "// Missing native fields for class '%s'\n", Class->Name.Data() );
-              printf( "//====================================================================\n" );
-            }
-
-            if ( Prop->PropertyType == PROP_Struct )
-              printf( "  F%s %s", ((UStructProperty*)Prop)->Struct->Name.Data(), Prop->Name.Data() );
-            else if ( Prop->PropertyType == PROP_Object )
-              printf( "  %s %s", GetCppClassNameProp( Prop ), Prop->Name.Data() );
-            else if ( Prop->PropertyType == PROP_Array )
-              printf( "  TArray<%s>* %s", GetCppArrayType( Prop ), Prop->Name.Data() );
-            else
-              printf( "  %s %s", CppPropNames[Prop->PropertyType], Prop->Name.Data() );
-
-            if ( Prop->ArrayDim > 1 )
-              printf( "[%i]", Prop->ArrayDim );
-            printf( ";\n" );
-
-            NumMissing++;
-          }
-        }
-
-        if ( NumMissing == 0 )
+      case 'a':
+        bAllPackages = true;
+        break;
+      case 'o':
+        if ( i + 1 >= argc )
+          goto BadOpt;
+        OutName = argv[++i];
+        break;
+      default:
+        GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
+        goto BadOpt;
+      }
+    }
+    else
+    {
+      PkgName = argv[i];
+      break;
+    }
+
+    i++;
+  }
+
+  // Build the package list
+  TArray<char*> Packages;
+  if ( bAllPackages )
+  {
+    FindPackageFiles( "../System", ".u", Packages );
+    if ( Packages.Size() == 0 )
+    {
+      GLogf( LOG_CRIT, "No script packages found in '../System'" );
+      return ERR_MISSING_PKG;
+    }
+  }
+  else
+  {
+    Packages.PushBack( strdup( PkgName ) );
+  }
+
+  // Load all classes, reading upcoming package files in the background
+  USystem::LogLevel = LOG_CRIT;
+  FPackagePrefetcher Prefetcher;
+  for ( int i = 0; i < Packages.Size(); i++ )
+    Prefetcher.AddDependencies( Packages[i] );
+  Prefetcher.Start( GetNumThreads() );
+
+  std::vector<FClassEntry> Classes;
+  int Result = 0;
+  for ( int i = 0; i < Packages.Size(); i++ )
+  {
+    // A broken package doesn't stop a whole game scan
+    Result = LoadPackageClasses( Packages[i], Classes );
+    if ( Result != 0 && !bAllPackages )
+      break;
+    Result = 0;
+  }
+  Prefetcher.Wait();
+
+  // Check and format every class in parallel, each into its own buffers
+  std::vector<FTextBuffer*> CppOut( Classes.size() );
+  std::vector<FTextBuffer*> JsonOut( Classes.size() );
+  std::vector<int> NumMissing( Classes.size() );
+  ParallelFor( Classes.size(), [&]( int iClass )
+  {
+    CppOut[iClass] = new FTextBuffer();
+    JsonOut[iClass] = new FTextBuffer();
+    NumMissing[iClass] = FormatMissingFields( Classes[iClass].Class, Classes[iClass].PkgName,
+      *CppOut[iClass], *JsonOut[iClass] );
+  });
+
+  // Write everything out in order
+  FILE* CppFile = stdout;
+  FILE* JsonFile = NULL;
+  if ( OutName != NULL )
+  {
+    char FileName[4096];
+    snprintf( FileName, sizeof( FileName ), "%s/%s.h", wd, OutName );
+    CppFile = fopen( FileName, "wb" );
+    snprintf( FileName, sizeof( FileName ), "%s/%s.json", wd, OutName );
+    JsonFile = fopen( FileName, "wb" );
+    if ( CppFile == NULL || JsonFile == NULL )
+    {
+      GLogf( LOG_CRIT, "Failed to open '%s' for writing", FileName );
+      Result = ERR_BAD_PATH;
+    }
+  }
+
+  if ( Result != ERR_BAD_PATH )
+  {
+    FTextBuffer Cpp( CppFile );
+    for ( size_t i = 0; i < Classes.size(); i++ )
+      Cpp.Write( CppOut[i]->Data, CppOut[i]->Len );
+
+    if ( JsonFile != NULL )
+    {
+      int NumClasses = 0;
+      int NumFields = 0;
+      FTextBuffer Json( JsonFile );
+      Json.Write( "{\n  \"classes\": [\n" );
+      for ( size_t i = 0; i < Classes.size(); i++ )
+      {
+        if ( NumMissing[i] == 0 )
           continue;
 
-        // Iterate again, but this time spit out LINK_NATIVE_PROPERTY stuff
-        printf( "BEGIN_PROPERTY_LINK( %s, %i )\n", GetCppClassName( Class ), NumMissing );
-        for ( UField* It = Class->Children; It != NULL; It = It->Next )
-        {
-          UProperty* Prop = SafeCast<UProperty>( It );
-          if ( Prop && Prop->Offset == MAX_UINT32 && Prop->Outer == Class )
-            printf( "  LINK_NATIVE_PROPERTY( %s );\n", Prop->Name.Data() );
-        }
-        printf( "END_PROPERTY_LINK()\n" );
+        if ( NumClasses++ > 0 )
+          Json.Write( ",\n" );
+        Json.Write( JsonOut[i]->Data, JsonOut[i]->Len );
+        NumFields += NumMissing[i];
       }
+      Json.Write( "\n  ],\n  \"numPackages\": " );
+      Json.WriteInt( Packages.Size() );
+      Json.Write( ",\n  \"numClasses\": " );
+      Json.WriteInt( NumClasses );
+      Json.Write( ",\n  \"numFields\": " );
+      Json.WriteInt( NumFields );
+      Json.Write( "\n}\n" );
     }
   }
 
-  return 0;
-}
+  for ( size_t i = 0; i < Classes.size(); i++ )
+  {
+    delete CppOut[i];
+    delete JsonOut[i];
+  }
+  for ( int i = 0; i < Packages.Size(); i++ )
+    free( Packages[i] );
 
+  if ( CppFile != NULL && CppFile != stdout )
+    fclose( CppFile );
+  if ( JsonFile != NULL )
+    fclose( JsonFile );
+
+  return Result;
+}
@@ -86,12 +86,10 @@ int musicexport( int argc, char** argv )
   UClass* Class = UMusic::StaticClass();
 
   // Load package
-  UPackage* Pkg = UPackage::StaticLoadPackage( PkgName );
+  FPackagePrefetcher Prefetcher;
+  UPackage* Pkg = LoadPackageWithPrefetch( PkgName, Prefetcher );
   if ( Pkg == NULL )
-  {
-    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist" );
     return ERR_MISSING_PKG;
-  }
 
   // Iterate and export all music files
   TArray<FExport>& ExportTable = Pkg->GetExportTable();
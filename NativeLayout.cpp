@@ -0,0 +1,448 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * NativeLayout.cpp - Reports padding in the memory layout of classes
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "lucc.h"
+
+/*-----------------------------------------------------------------------------
+ * nativelayout helpers
+ * Sizes come from the properties themselves; alignment is taken from the
+ * C++ type each property is stored as (see CppPropNames)
+-----------------------------------------------------------------------------*/
+struct FLayoutField
+{
+  UProperty* Prop;
+  u32 Offset;
+  u32 Size;
+  u32 Align;
+};
+
+struct FClassLayout
+{
+  FClassEntry Entry;
+  u32 StartOffset;
+  u32 Size;
+  u32 Align;
+  u32 Padding;
+  int NumHoles;
+  int NumMissing;
+  u32 PackedSize;
+  std::vector<FLayoutField> Fields;
+  std::vector<FLayoutField> Packed;
+  int NumInstances;
+};
+
+static u32 GetStructAlign( UStruct* Struct );
+
+static u32 GetPropAlign( UProperty* Prop )
+{
+  switch ( Prop->PropertyType )
+  {
+    case PROP_Byte:   return alignof( u8 );
+    case PROP_Int:    return alignof( int );
+    case PROP_Bool:   return alignof( bool );
+    case PROP_Float:  return alignof( float );
+    case PROP_Object: return alignof( UObject* );
+    case PROP_Class:  return alignof( UClass* );
+    case PROP_Name:   return alignof( FName );
+    case PROP_String:
+    case PROP_Ascii:  return alignof( FString* );
+    case PROP_Array:
+    case PROP_Map:    return alignof( void* );
+    case PROP_Qword:  return alignof( u64 );
+    case PROP_Struct: return GetStructAlign( ((UStructProperty*)Prop)->Struct );
+    default:
+      break;
+  }
+
+  // Unknown types are assumed to be aligned to their size
+  u32 Align = 1;
+  while ( Align < 8 && Align * 2 <= (u32)Prop->ElementSize )
+    Align *= 2;
+  return Align;
+}
+
+static u32 GetStructAlign( UStruct* Struct )
+{
+  u32 Align = 1;
+  for ( UStruct* It = Struct; It != NULL; It = It->SuperField )
+  {
+    for ( UField* Field = It->Children; Field != NULL; Field = Field->Next )
+    {
+      UProperty* Prop = SafeCast<UProperty>( Field );
+      if ( Prop && Prop->Outer == It )
+        Align = std::max( Align, GetPropAlign( Prop ) );
+    }
+  }
+  return Align;
+}
+
+static inline u32 AlignUp( u32 Value, u32 Align )
+{
+  return (Value + Align - 1) & ~(Align - 1);
+}
+
+/*-----------------------------------------------------------------------------
+ * ComputeClassLayout
+ * Finds the holes between a class's own fields and works out how big its
+ * fields would be if they were sorted by alignment, biggest first. Fields
+ * of parent classes stay where they are
+-----------------------------------------------------------------------------*/
+static bool ComputeClassLayout( FClassEntry& Entry, FClassLayout& Layout )
+{
+  UClass* Class = Entry.Class;
+  UStruct* Super = Class->SuperField;
+
+  Layout.Entry = Entry;
+  Layout.StartOffset = (Super != NULL) ? Super->StructSize : 0;
+  Layout.Size = Class->StructSize;
+  Layout.Align = GetStructAlign( Class );
+  Layout.Padding = 0;
+  Layout.NumHoles = 0;
+  Layout.NumMissing = 0;
+  Layout.NumInstances = 0;
+
+  if ( Layout.Size < Layout.StartOffset )
+    return false;
+
+  for ( UField* It = Class->Children; It != NULL; It = It->Next )
+  {
+    UProperty* Prop = SafeCast<UProperty>( It );
+    if ( !Prop || Prop->Outer != Class )
+      continue;
+
+    if ( Prop->Offset == MAX_UINT32 )
+    {
+      Layout.NumMissing++;
+      continue;
+    }
+
+    FLayoutField Field = { Prop, Prop->Offset, (u32)(Prop->ElementSize * Prop->ArrayDim), GetPropAlign( Prop ) };
+    Layout.Fields.push_back( Field );
+  }
+
+  std::stable_sort( Layout.Fields.begin(), Layout.Fields.end(),
+    []( const FLayoutField& A, const FLayoutField& B ) { return A.Offset < B.Offset; } );
+
+  // Holes before and between fields, and at the end
+  u32 Cursor = Layout.StartOffset;
+  for ( size_t i = 0; i < Layout.Fields.size(); i++ )
+  {
+    FLayoutField& Field = Layout.Fields[i];
+    if ( Field.Offset > Cursor )
+    {
+      Layout.Padding += Field.Offset - Cursor;
+      Layout.NumHoles++;
+    }
+    Cursor = std::max( Cursor, Field.Offset + Field.Size );
+  }
+
+  if ( Layout.Size > Cursor )
+  {
+    Layout.Padding += Layout.Size - Cursor;
+    Layout.NumHoles++;
+  }
+
+  // Suggested order; ties keep their current order
+  Layout.Packed = Layout.Fields;
+  std::stable_sort( Layout.Packed.begin(), Layout.Packed.end(),
+    []( const FLayoutField& A, const FLayoutField& B ) { return A.Align > B.Align; } );
+
+  Cursor = Layout.StartOffset;
+  for ( size_t i = 0; i < Layout.Packed.size(); i++ )
+  {
+    FLayoutField& Field = Layout.Packed[i];
+    Field.Offset = AlignUp( Cursor, Field.Align );
+    Cursor = Field.Offset + Field.Size;
+  }
+  Layout.PackedSize = std::min( Layout.Size, AlignUp( Cursor, Layout.Align ) );
+
+  return true;
+}
+
+static void PrintClassDetail( FClassLayout& Layout )
+{
+  char CppType[256];
+
+  printf( "Layout of class '%s' (%s)\n", Layout.Entry.Class->Name.Data(), Layout.Entry.PkgName );
+  printf( "  Inherited: %u bytes, total: %u bytes, alignment: %u\n\n",
+    Layout.StartOffset, Layout.Size, Layout.Align );
+
+  printf( "  %6s %6s %5s  %s\n", "Offset", "Size", "Align", "Field" );
+  u32 Cursor = Layout.StartOffset;
+  for ( size_t i = 0; i < Layout.Fields.size(); i++ )
+  {
+    FLayoutField& Field = Layout.Fields[i];
+    if ( Field.Offset > Cursor )
+      printf( "  %6u %6u %5s  <%u byte hole>\n", Cursor, Field.Offset - Cursor, "", Field.Offset - Cursor );
+
+    GetCppPropType( Field.Prop, CppType, sizeof( CppType ) );
+    printf( "  %6u %6u %5u  %s %s", Field.Offset, Field.Size, Field.Align, CppType, Field.Prop->Name.Data() );
+    if ( Field.Prop->ArrayDim > 1 )
+      printf( "[%i]", Field.Prop->ArrayDim );
+    printf( "\n" );
+    Cursor = std::max( Cursor, Field.Offset + Field.Size );
+  }
+  if ( Layout.Size > Cursor )
+    printf( "  %6u %6u %5s  <%u bytes of tail padding>\n", Cursor, Layout.Size - Cursor, "", Layout.Size - Cursor );
+
+  if ( Layout.NumMissing > 0 )
+    printf( "\n  %d fields have no native offset (see missingnativefields)\n", Layout.NumMissing );
+
+  if ( Layout.PackedSize >= Layout.Size )
+  {
+    printf( "\n  Reordering fields would not make this class smaller\n\n" );
+    return;
+  }
+
+  printf( "\n  Suggested order (%u bytes, saves %u):\n", Layout.PackedSize, Layout.Size - Layout.PackedSize );
+  for ( size_t i = 0; i < Layout.Packed.size(); i++ )
+  {
+    FLayoutField& Field = Layout.Packed[i];
+    GetCppPropType( Field.Prop, CppType, sizeof( CppType ) );
+    printf( "  %6u  %s %s", Field.Offset, CppType, Field.Prop->Name.Data() );
+    if ( Field.Prop->ArrayDim > 1 )
+      printf( "[%i]", Field.Prop->ArrayDim );
+    printf( ";\n" );
+  }
+  printf( "\n" );
+}
+
+/*-----------------------------------------------------------------------------
+ * CountLevelInstances
+ * Counts the actors of every class in a map
+-----------------------------------------------------------------------------*/
+static bool CountLevelInstances( const char* MapName, std::unordered_map<UClass*, int>& OutCounts )
+{
+  FPackagePrefetcher Prefetcher;
+  UPackage* Pkg = LoadPackageWithPrefetch( MapName, Prefetcher );
+  if ( Pkg == NULL )
+    return false;
+
+  ULevel* Level = (ULevel*)UObject::StaticLoadObject( Pkg, "MyLevel", ULevel::StaticClass(), NULL );
+  if ( Level == NULL )
+  {
+    GLogf( LOG_CRIT, "Failed to load level from package '%s'", MapName );
+    return false;
+  }
+
+  for ( int i = 0; i < Level->Actors.Size(); i++ )
+    if ( Level->Actors[i] != NULL )
+      OutCounts[Level->Actors[i]->Class]++;
+
+  return true;
+}
+
+/*-----------------------------------------------------------------------------
+ * nativelayout
+ * Reports how much of every class is padding, and how much reordering its
+ * own fields would save. With a map, savings are multiplied by the number
+ * of actors of each class (and of its subclasses, which carry the same
+ * fields)
+-----------------------------------------------------------------------------*/
+int nativelayout( int argc, char** argv )
+{
+  int i = 0;
+  bool bAllPackages = false;
+  char* DetailClass = NULL;
+  char* MapName = NULL;
+
+  // Argument parsing
+  while ( 1 )
+  {
+    if ( argc == 0 || i > argc || (i == argc && !bAllPackages) )
+    {
+    BadOpt:
+      printf( "nativelayout usage:\n" );
+      printf( "\tlucc [gopts] nativelayout [copts] <Package Name>\n" );
+      printf( "\tlucc [gopts] nativelayout [copts] -a\n\n" );
+
+      printf( "Command options:\n" );
+      printf( "\t-a                    - Checks (a)ll script packages of the game\n" );
+      printf( "\t-s \"<ClassName>\"    - Shows the full layout of a (s)ingle class\n" );
+      printf( "\t-l \"<MapName>\"      - Estimates savings from the actors in a (l)evel\n" );
+      printf( "\n" );
+      return ERR_BAD_ARGS;
+    }
+
+    if ( i == argc )
+      break;
+
+    if ( argv[i][0] == '-' )
+    {
+      switch ( argv[i][1] )
+      {
+      case 'a':
+        bAllPackages = true;
+        break;
+      case 's':
+        if ( i + 1 >= argc )
+          goto BadOpt;
+        DetailClass = argv[++i];
+        break;
+      case 'l':
+        if ( i + 1 >= argc )
+          goto BadOpt;
+        MapName = argv[++i];
+        break;
+      default:
+        GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
+        goto BadOpt;
+      }
+    }
+    else
+    {
+      PkgName = argv[i];
+      break;
+    }
+
+    i++;
+  }
+
+  TArray<char*> Packages;
+  if ( bAllPackages )
+    FindPackageFiles( "../System", ".u", Packages );
+  else
+    Packages.PushBack( strdup( PkgName ) );
+
+  // Load all classes, reading upcoming package files in the background
+  USystem::LogLevel = LOG_CRIT;
+  FPackagePrefetcher Prefetcher;
+  for ( int i = 0; i < Packages.Size(); i++ )
+    Prefetcher.AddDependencies( Packages[i] );
+  Prefetcher.Start( GetNumThreads() );
+
+  std::vector<FClassEntry> Classes;
+  for ( int i = 0; i < Packages.Size(); i++ )
+  {
+    int Result = LoadPackageClasses( Packages[i], Classes );
+    if ( Result != 0 && !bAllPackages )
+      return Result;
+  }
+
+  std::vector<FClassLayout> Layouts;
+  std::unordered_map<UClass*, size_t> LayoutMap;
+  for ( size_t i = 0; i < Classes.size(); i++ )
+  {
+    Layouts.push_back( FClassLayout() );
+    if ( !ComputeClassLayout( Classes[i], Layouts.back() ) )
+    {
+      Layouts.pop_back();
+      continue;
+    }
+    LayoutMap[Classes[i].Class] = Layouts.size() - 1;
+  }
+
+  if ( DetailClass != NULL )
+  {
+    for ( size_t i = 0; i < Layouts.size(); i++ )
+    {
+      if ( stricmp( Layouts[i].Entry.Class->Name.Data(), DetailClass ) == 0 )
+      {
+        PrintClassDetail( Layouts[i] );
+        return 0;
+      }
+    }
+
+    GLogf( LOG_CRIT, "Class '%s' was not found", DetailClass );
+    return ERR_MISSING_CLASS;
+  }
+
+  // An actor carries the fields of all of its parent classes, so savings
+  // in a parent count once for every actor of every subclass
+  bool bHaveCounts = false;
+  if ( MapName != NULL )
+  {
+    std::unordered_map<UClass*, int> Counts;
+    if ( !CountLevelInstances( MapName, Counts ) )
+      return ERR_BAD_OBJECT;
+
+    for ( std::unordered_map<UClass*, int>::iterator It = Counts.begin(); It != Counts.end(); ++It )
+    {
+      for ( UStruct* Struct = It->first; Struct != NULL; Struct = Struct->SuperField )
+      {
+        std::unordered_map<UClass*, size_t>::iterator Found = LayoutMap.find( (UClass*)Struct );
+        if ( Found != LayoutMap.end() )
+          Layouts[Found->second].NumInstances += It->second;
+      }
+    }
+    bHaveCounts = true;
+  }
+
+  // Biggest savings first
+  std::vector<size_t> Order( Layouts.size() );
+  for ( size_t i = 0; i < Order.size(); i++ )
+    Order[i] = i;
+
+  std::stable_sort( Order.begin(), Order.end(), [&]( size_t A, size_t B )
+  {
+    u64 SaveA = (u64)(Layouts[A].Size - Layouts[A].PackedSize) * (bHaveCounts ? Layouts[A].NumInstances : 1);
+    u64 SaveB = (u64)(Layouts[B].Size - Layouts[B].PackedSize) * (bHaveCounts ? Layouts[B].NumInstances : 1);
+    if ( SaveA != SaveB )
+      return SaveA > SaveB;
+    return Layouts[A].Padding > Layouts[B].Padding;
+  });
+
+  printf( "%-32s %-16s %7s %7s %7s %5s %7s %6s", "Class", "Package", "Size", "Own", "Padding", "Holes", "Packed", "Saves" );
+  if ( bHaveCounts )
+    printf( " %9s %9s", "Actors", "Saved" );
+  printf( "\n" );
+
+  u64 TotalPadding = 0;
+  u64 TotalSaved = 0;
+  for ( size_t i = 0; i < Order.size(); i++ )
+  {
+    FClassLayout& Layout = Layouts[Order[i]];
+    u32 Saves = Layout.Size - Layout.PackedSize;
+    TotalPadding += Layout.Padding;
+
+    // Only classes with something to report
+    if ( Layout.Padding == 0 && (!bHaveCounts || Layout.NumInstances == 0) )
+      continue;
+
+    printf( "%-32s %-16s %7u %7u %7u %5d %7u %6u", Layout.Entry.Class->Name.Data(), Layout.Entry.PkgName,
+      Layout.Size, Layout.Size - Layout.StartOffset, Layout.Padding, Layout.NumHoles, Layout.PackedSize, Saves );
+    if ( bHaveCounts )
+    {
+      u64 Saved = (u64)Saves * Layout.NumInstances;
+      printf( " %9d %9llu", Layout.NumInstances, (unsigned long long)Saved );
+      TotalSaved += Saved;
+    }
+    printf( "\n" );
+  }
+
+  printf( "\n%d classes, %llu bytes of padding in total\n", (int)Layouts.size(), (unsigned long long)TotalPadding );
+  if ( bHaveCounts )
+    printf( "Reordering would save an estimated %llu bytes across the actors in '%s'\n",
+      (unsigned long long)TotalSaved, MapName );
+
+  for ( int i = 0; i < Packages.Size(); i++ )
+    free( Packages[i] );
+
+  return 0;
+}
+
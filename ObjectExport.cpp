@@ -25,10 +25,72 @@
 
 #include "lucc.h"
 
+/*-----------------------------------------------------------------------------
+ * ExportRawObject
+ * Writes an object's serialized data, and that of the objects in the same
+ * package it depends on, exactly as stored. Only the package tables and
+ * those objects' data are read; the package is never loaded
+-----------------------------------------------------------------------------*/
+static int ExportRawObject( const char* ClassType )
+{
+  char FileName[4096];
+  if ( !FindPackageFile( PkgName, FileName, sizeof( FileName ) ) )
+  {
+    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist", PkgName );
+    return ERR_MISSING_PKG;
+  }
+
+  FPackageReader Reader;
+  if ( !Reader.Open( FileName ) )
+  {
+    GLogf( LOG_CRIT, "Failed to read package '%s'; %s", PkgName, Reader.Error );
+    return ERR_MISSING_PKG;
+  }
+
+  int iExport = Reader.FindExport( SingleObject, ClassType );
+  if ( iExport < 0 )
+  {
+    GLogf( LOG_CRIT, "Object '%s' not found in package '%s'", SingleObject, PkgName );
+    return ERR_BAD_OBJECT;
+  }
+
+  std::vector<int> Exports;
+  Reader.GetExportDependencies( iExport, Exports );
+
+  std::vector<u8> Data;
+  for ( size_t i = 0; i < Exports.size(); i++ )
+  {
+    if ( Reader.Exports[Exports[i]].SerialSize <= 0 )
+      continue;
+
+    char ObjPath[1024];
+    Reader.GetObjectPath( Exports[i] + 1, ObjPath, sizeof( ObjPath ) );
+    if ( !Reader.ReadExportData( Exports[i], Data ) )
+    {
+      GLogf( LOG_CRIT, "Failed to read object '%s.%s'", PkgName, ObjPath );
+      return ERR_BAD_OBJECT;
+    }
+
+    snprintf( FileName, sizeof( FileName ), "%s/%s.%s.raw", Path, ObjPath, Reader.GetClassName( Exports[i] + 1 ) );
+    FILE* File = fopen( FileName, "wb" );
+    if ( File == NULL || fwrite( Data.data(), 1, Data.size(), File ) != Data.size() )
+    {
+      GLogf( LOG_CRIT, "Could not write '%s'", FileName );
+      if ( File != NULL )
+        fclose( File );
+      return ERR_EXPORT_FAILED;
+    }
+    fclose( File );
+  }
+
+  return 0;
+}
+
 int objectexport( int argc, char** argv )
 {
   int i = 0;
   char* ClassType = NULL;
+  bool bRaw = false;
 
   // Argument parsing
   while ( 1 )
@@ -44,6 +106,7 @@ int objectexport( int argc, char** argv )
       printf( "\t-s \"<ObjectName>\"   - Specifies a {s}ingle object to export\n" );
       printf( "\t-t \"<ExportType>\"   - Specifies the extension type of the exported object\n" );
       printf( "\t-c \"<ClassType>\"    - Specifies the class type of the object to export\n");
+      printf( "\t-r                   - Writes the (r)aw serialized data without loading the package\n");
       printf( "\n" ); 
       return ERR_BAD_ARGS;
     }
@@ -72,6 +135,9 @@ int objectexport( int argc, char** argv )
       case 'c':
         ClassType = argv[++i];
         break;
+      case 'r':
+        bRaw = true;
+        break;
       default:
         GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
         goto BadOpt;
@@ -105,13 +171,14 @@ int objectexport( int argc, char** argv )
     return ERR_BAD_PATH;
   }
 
+  if ( bRaw )
+    return ExportRawObject( ClassType );
+
   // Load package
-  UPackage* Pkg = UPackage::StaticLoadPackage( PkgName );
+  FPackagePrefetcher Prefetcher;
+  UPackage* Pkg = LoadPackageWithPrefetch( PkgName, Prefetcher );
   if ( Pkg == NULL )
-  {
-    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist" );
     return ERR_MISSING_PKG;
-  }
 
   // Iterate and export all class scripts
   TArray<FExport>& ExportTable = Pkg->GetExportTable();
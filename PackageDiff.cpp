@@ -0,0 +1,354 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * PackageDiff.cpp - Compares two versions of a package
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <map>
+#include <string>
+#include <cctype>
+#include <algorithm>
+#include <unordered_map>
+#include "lucc.h"
+
+/*-----------------------------------------------------------------------------
+ * HashBytes
+ * XXH64. Input is consumed as four independent 64-bit lanes, which keeps
+ * the multipliers busy in parallel (and lets compilers vectorize it)
+-----------------------------------------------------------------------------*/
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline u64 Rotl64( u64 X, int R )
+{
+  return (X << R) | (X >> (64 - R));
+}
+
+static inline u64 Read64( const u8* P )
+{
+  u64 V;
+  memcpy( &V, P, sizeof( V ) );
+  return V;
+}
+
+static inline u32 Read32( const u8* P )
+{
+  u32 V;
+  memcpy( &V, P, sizeof( V ) );
+  return V;
+}
+
+static inline u64 HashRound( u64 Acc, u64 Input )
+{
+  Acc += Input * PRIME64_2;
+  Acc = Rotl64( Acc, 31 );
+  return Acc * PRIME64_1;
+}
+
+static inline u64 HashMerge( u64 Acc, u64 Lane )
+{
+  Acc ^= HashRound( 0, Lane );
+  return Acc * PRIME64_1 + PRIME64_4;
+}
+
+static u64 HashBytes( const u8* Data, size_t Size, u64 Seed )
+{
+  const u8* P = Data;
+  const u8* End = Data + Size;
+  u64 Hash;
+
+  if ( Size >= 32 )
+  {
+    u64 Lanes[4] = { Seed + PRIME64_1 + PRIME64_2, Seed + PRIME64_2, Seed, Seed - PRIME64_1 };
+    do
+    {
+      for ( int i = 0; i < 4; i++ )
+        Lanes[i] = HashRound( Lanes[i], Read64( P + i * 8 ) );
+      P += 32;
+    } while ( P <= End - 32 );
+
+    Hash = Rotl64( Lanes[0], 1 ) + Rotl64( Lanes[1], 7 ) + Rotl64( Lanes[2], 12 ) + Rotl64( Lanes[3], 18 );
+    for ( int i = 0; i < 4; i++ )
+      Hash = HashMerge( Hash, Lanes[i] );
+  }
+  else
+  {
+    Hash = Seed + PRIME64_5;
+  }
+
+  Hash += (u64)Size;
+  for ( ; P + 8 <= End; P += 8 )
+    Hash = Rotl64( Hash ^ HashRound( 0, Read64( P ) ), 27 ) * PRIME64_1 + PRIME64_4;
+  if ( P + 4 <= End )
+  {
+    Hash = Rotl64( Hash ^ ((u64)Read32( P ) * PRIME64_1), 23 ) * PRIME64_2 + PRIME64_3;
+    P += 4;
+  }
+  for ( ; P < End; P++ )
+    Hash = Rotl64( Hash ^ (*P * PRIME64_5), 11 ) * PRIME64_1;
+
+  Hash ^= Hash >> 33;
+  Hash *= PRIME64_2;
+  Hash ^= Hash >> 29;
+  Hash *= PRIME64_3;
+  Hash ^= Hash >> 32;
+  return Hash;
+}
+
+/*-----------------------------------------------------------------------------
+ * Package side of a diff
+-----------------------------------------------------------------------------*/
+struct FDiffExport
+{
+  std::string Path;
+  std::string Class;
+  int Size;
+  u32 Flags;
+  u64 Hash;
+  bool bReadOk;
+};
+
+static bool OpenDiffPackage( const char* Name, FPackageReader& Reader )
+{
+  // Files relative to where lucc was run from come first, then packages
+  // of the game by name
+  char FileName[4096];
+#ifdef _WIN32
+  if ( strchr( Name, ':' ) != NULL )
+    strcpy( FileName, Name );
+  else
+#endif
+    snprintf( FileName, sizeof( FileName ), "%s/%s", wd, Name );
+
+  if ( !USystem::FileExists( FileName ) && !FindPackageFile( Name, FileName, sizeof( FileName ) ) )
+  {
+    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist", Name );
+    return false;
+  }
+
+  if ( !Reader.Open( FileName ) )
+  {
+    GLogf( LOG_CRIT, "Failed to read package '%s'; %s", FileName, Reader.Error );
+    return false;
+  }
+  return true;
+}
+
+static void GatherDiffExports( FPackageReader& Reader, std::vector<FDiffExport>& OutExports )
+{
+  char Path[1024];
+  OutExports.resize( Reader.Exports.size() );
+  for ( size_t i = 0; i < Reader.Exports.size(); i++ )
+  {
+    FDiffExport& Export = OutExports[i];
+    Reader.GetObjectPath( (int)i + 1, Path, sizeof( Path ) );
+    Export.Path = Path;
+    Export.Class = Reader.GetClassName( (int)i + 1 );
+    Export.Size = std::max( Reader.Exports[i].SerialSize, 0 );
+    Export.Flags = Reader.Exports[i].ObjectFlags;
+    Export.Hash = 0;
+    Export.bReadOk = true;
+  }
+}
+
+static std::string ToLower( const std::string& Str )
+{
+  std::string Lower( Str );
+  for ( size_t i = 0; i < Lower.size(); i++ )
+    Lower[i] = (char)tolower( (u8)Lower[i] );
+  return Lower;
+}
+
+// Objects of different classes can share a name (a Texture and a Sound both
+// called Foo), so they are matched by class and path together
+static std::string GetDiffKey( const FDiffExport& Export )
+{
+  return ToLower( Export.Class + "'" + Export.Path + "'" );
+}
+
+/*-----------------------------------------------------------------------------
+ * pkgdiff
+ * Nothing is deserialized, so objects count as changed when their stored
+ * bytes differ. Saving a package again can renumber its names, which shows
+ * up as changes in every object that uses them
+-----------------------------------------------------------------------------*/
+struct FDiffEntry
+{
+  char Kind;                  // '+' added, '-' removed, '*' changed
+  const FDiffExport* Old;
+  const FDiffExport* New;
+
+  const FDiffExport* Any() const { return (New != NULL) ? New : Old; }
+};
+
+int pkgdiff( int argc, char** argv )
+{
+  if ( argc != 2 )
+  {
+    printf( "pkgdiff usage:\n" );
+    printf( "\tlucc [gopts] pkgdiff <Old Package> <New Package>\n\n" );
+    printf( "Packages are file names relative to the current folder, or package names\n" );
+    printf( "\n" );
+    return ERR_BAD_ARGS;
+  }
+
+  FPackageReader Readers[2];
+  if ( !OpenDiffPackage( argv[0], Readers[0] ) || !OpenDiffPackage( argv[1], Readers[1] ) )
+    return ERR_MISSING_PKG;
+
+  double StartTime = USystem::GetSeconds();
+  std::vector<FDiffExport> Exports[2];
+  GatherDiffExports( Readers[0], Exports[0] );
+  GatherDiffExports( Readers[1], Exports[1] );
+
+  // Hash both packages' exports together so big ones spread evenly
+  int NumOld = (int)Exports[0].size();
+  int NumTotal = NumOld + (int)Exports[1].size();
+  ParallelFor( NumTotal, [&]( int i )
+  {
+    int Side = (i < NumOld) ? 0 : 1;
+    int iExport = (i < NumOld) ? i : i - NumOld;
+
+    std::vector<u8> Data;
+    FDiffExport& Export = Exports[Side][iExport];
+    Export.bReadOk = Readers[Side].ReadExportData( iExport, Data );
+    if ( Export.bReadOk )
+      Export.Hash = HashBytes( Data.data(), Data.size(), 0 );
+  });
+
+  // Match by class and path
+  std::unordered_map<std::string, const FDiffExport*> OldMap;
+  for ( size_t i = 0; i < Exports[0].size(); i++ )
+    OldMap[GetDiffKey( Exports[0][i] )] = &Exports[0][i];
+
+  std::vector<FDiffEntry> Entries;
+  int NumSame = 0;
+  for ( size_t i = 0; i < Exports[1].size(); i++ )
+  {
+    const FDiffExport* New = &Exports[1][i];
+    std::unordered_map<std::string, const FDiffExport*>::iterator It = OldMap.find( GetDiffKey( *New ) );
+    if ( It == OldMap.end() )
+    {
+      FDiffEntry Entry = { '+', NULL, New };
+      Entries.push_back( Entry );
+      continue;
+    }
+
+    const FDiffExport* Old = It->second;
+    OldMap.erase( It );
+
+    if ( Old->Hash != New->Hash || Old->Size != New->Size || Old->Flags != New->Flags ||
+         !Old->bReadOk || !New->bReadOk )
+    {
+      FDiffEntry Entry = { '*', Old, New };
+      Entries.push_back( Entry );
+    }
+    else
+    {
+      NumSame++;
+    }
+  }
+
+  for ( size_t i = 0; i < Exports[0].size(); i++ )
+  {
+    if ( OldMap.find( GetDiffKey( Exports[0][i] ) ) != OldMap.end() )
+    {
+      FDiffEntry Entry = { '-', &Exports[0][i], NULL };
+      Entries.push_back( Entry );
+    }
+  }
+
+  // By class, then by kind, then by path
+  std::sort( Entries.begin(), Entries.end(), []( const FDiffEntry& A, const FDiffEntry& B )
+  {
+    int Cmp = stricmp( A.Any()->Class.c_str(), B.Any()->Class.c_str() );
+    if ( Cmp != 0 )
+      return Cmp < 0;
+    if ( A.Kind != B.Kind )
+      return A.Kind < B.Kind;
+    return stricmp( A.Any()->Path.c_str(), B.Any()->Path.c_str() ) < 0;
+  });
+
+  printf( "Comparing '%s' (%i objects) to '%s' (%i objects)\n", argv[0], (int)Exports[0].size(),
+    argv[1], (int)Exports[1].size() );
+
+  struct FDiffCounts
+  {
+    int Added;
+    int Removed;
+    int Changed;
+  };
+
+  FDiffCounts Totals = { 0, 0, 0 };
+  std::map<std::string, FDiffCounts> ClassCounts;
+  const char* LastClass = "";
+  for ( size_t i = 0; i < Entries.size(); i++ )
+  {
+    FDiffEntry& Entry = Entries[i];
+    const FDiffExport* Export = Entry.Any();
+    if ( stricmp( Export->Class.c_str(), LastClass ) != 0 )
+    {
+      printf( "\n%s:\n", Export->Class.c_str() );
+      LastClass = Export->Class.c_str();
+    }
+
+    FDiffCounts& Counts = ClassCounts[Export->Class];
+    if ( Entry.Kind == '+' )
+    {
+      printf( "  + %-48s %10i bytes\n", Export->Path.c_str(), Export->Size );
+      Counts.Added++;
+      Totals.Added++;
+    }
+    else if ( Entry.Kind == '-' )
+    {
+      printf( "  - %-48s %10i bytes\n", Export->Path.c_str(), Export->Size );
+      Counts.Removed++;
+      Totals.Removed++;
+    }
+    else
+    {
+      printf( "  * %-48s %10i -> %i bytes", Export->Path.c_str(), Entry.Old->Size, Entry.New->Size );
+      if ( Entry.Old->Flags != Entry.New->Flags )
+        printf( ", flags %08x -> %08x", Entry.Old->Flags, Entry.New->Flags );
+      if ( !Entry.Old->bReadOk || !Entry.New->bReadOk )
+        printf( ", data outside of the file" );
+      printf( "\n" );
+      Counts.Changed++;
+      Totals.Changed++;
+    }
+  }
+
+  if ( ClassCounts.size() > 0 )
+  {
+    printf( "\n  %-32s %8s %8s %8s\n", "Class", "Added", "Removed", "Changed" );
+    for ( std::map<std::string, FDiffCounts>::iterator It = ClassCounts.begin(); It != ClassCounts.end(); ++It )
+      printf( "  %-32s %8i %8i %8i\n", It->first.c_str(), It->second.Added, It->second.Removed, It->second.Changed );
+  }
+
+  printf( "%i added, %i removed, %i changed, %i unchanged in %.3f seconds\n", Totals.Added, Totals.Removed,
+    Totals.Changed, NumSame, USystem::GetSeconds() - StartTime );
+
+  return 0;
+}
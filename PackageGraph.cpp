@@ -0,0 +1,448 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * PackageGraph.cpp - Reference graph between all packages of a game
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <map>
+#include <string>
+#include <cctype>
+#include <unordered_map>
+#include "lucc.h"
+
+/*-----------------------------------------------------------------------------
+ * Graph building
+ * Everything comes from import and export tables. An export counts as used
+ * if any other package imports it, or if another export of its own package
+ * names it as class, super or group. References made from inside serialized
+ * data (a map's surfaces using its own textures, a script package's default
+ * properties using its own sounds, DynamicLoadObject in script) can't be
+ * seen this way
+-----------------------------------------------------------------------------*/
+struct FGraphExport
+{
+  std::string Path;
+  std::string Class;
+  int Size;
+  bool bUsed;
+};
+
+struct FGraphPackage
+{
+  const FIndexedPackage* Entry;
+  const char* Name;
+  bool bReadable;
+  bool bHasScript;                     // Exports classes, whose code can use any of its assets
+  std::vector<FGraphExport> Exports;
+  std::vector<std::string> Imports;    // Full object paths
+  std::map<std::string, int> FanOut;   // Package name -> objects imported
+  std::map<std::string, int> FanIn;    // Package name -> objects imported by it
+};
+
+static std::string ToLower( const char* Str )
+{
+  std::string Lower( Str );
+  for ( size_t i = 0; i < Lower.size(); i++ )
+    Lower[i] = (char)tolower( (u8)Lower[i] );
+  return Lower;
+}
+
+static void ReadPackageRefs( FGraphPackage& Package )
+{
+  FPackageReader Reader;
+  Package.bReadable = Reader.Open( GPackageIndex.GetString( Package.Entry->Path ) );
+  if ( !Package.bReadable )
+    return;
+
+  char Path[1024];
+  Package.Exports.resize( Reader.Exports.size() );
+  for ( size_t i = 0; i < Reader.Exports.size(); i++ )
+  {
+    FGraphExport& Export = Package.Exports[i];
+    Reader.GetObjectPath( (int)i + 1, Path, sizeof( Path ) );
+    Export.Path = Path;
+    Export.Class = Reader.GetClassName( (int)i + 1 );
+    Export.Size = Reader.Exports[i].SerialSize;
+    Export.bUsed = false;
+    if ( stricmp( Export.Class.c_str(), "Class" ) == 0 )
+      Package.bHasScript = true;
+  }
+
+  // Class, super and group references inside the package
+  for ( size_t i = 0; i < Reader.Exports.size(); i++ )
+  {
+    FRawExport& Raw = Reader.Exports[i];
+    int Refs[3] = { Raw.Class, Raw.Super, Raw.Group };
+    for ( int j = 0; j < 3; j++ )
+      if ( Refs[j] > 0 && Refs[j] <= (int)Package.Exports.size() )
+        Package.Exports[Refs[j] - 1].bUsed = true;
+  }
+
+  // Packages and groups are only imported as outers of the objects that
+  // are really used
+  for ( size_t i = 0; i < Reader.Imports.size(); i++ )
+  {
+    if ( stricmp( Reader.GetName( Reader.Imports[i].ClassName ), "Package" ) == 0 )
+      continue;
+
+    Reader.GetObjectPath( -(int)i - 1, Path, sizeof( Path ) );
+    Package.Imports.push_back( Path );
+  }
+}
+
+static bool IsInList( const char* Name, TArray<char*>& List )
+{
+  for ( int i = 0; i < List.Size(); i++ )
+    if ( stricmp( List[i], Name ) == 0 )
+      return true;
+  return false;
+}
+
+static bool IsMapPackage( FGraphPackage& Package )
+{
+  const char* Path = GPackageIndex.GetString( Package.Entry->Path );
+  size_t Len = strlen( Path );
+  return Len > 4 && stricmp( Path + Len - 4, ".unr" ) == 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Output
+-----------------------------------------------------------------------------*/
+static void WriteGraphText( FTextBuffer& Out, std::vector<FGraphPackage>& Packages,
+  std::vector<FGraphExport*>& Unused, std::vector<FGraphPackage*>& UnusedPkgs )
+{
+  char Line[2048];
+  Out.Write( "Packages:\n" );
+  Out.Write( "  Package                          Fan in  Fan out  Objects imported\n" );
+  for ( size_t i = 0; i < Packages.size(); i++ )
+  {
+    FGraphPackage& Package = Packages[i];
+    int NumImported = 0;
+    for ( std::map<std::string, int>::iterator It = Package.FanOut.begin(); It != Package.FanOut.end(); ++It )
+      NumImported += It->second;
+
+    int Len = snprintf( Line, sizeof( Line ), "  %-32s %6i %8i %17i%s\n", Package.Name, (int)Package.FanIn.size(),
+      (int)Package.FanOut.size(), NumImported, Package.bReadable ? "" : "  (unreadable)" );
+    Out.Write( Line, std::min( Len, (int)sizeof( Line ) - 1 ) );
+  }
+
+  u64 UnusedBytes = 0;
+  Out.Write( "\nUnreferenced exports:\n" );
+  for ( size_t i = 0; i < Unused.size(); i++ )
+  {
+    char FullName[1024];
+    snprintf( FullName, sizeof( FullName ), "%s.%s", UnusedPkgs[i]->Name, Unused[i]->Path.c_str() );
+    int Len = snprintf( Line, sizeof( Line ), "  %-48s %-20s %10i%s\n", FullName, Unused[i]->Class.c_str(),
+      Unused[i]->Size, UnusedPkgs[i]->bHasScript ? "  (unverifiable)" : "" );
+    Out.Write( Line, std::min( Len, (int)sizeof( Line ) - 1 ) );
+    UnusedBytes += Unused[i]->Size;
+  }
+
+  snprintf( Line, sizeof( Line ), "%i unreferenced exports, %.1f KB\n", (int)Unused.size(), UnusedBytes / 1024.0 );
+  Out.Write( Line );
+}
+
+static void WriteGraphDot( FTextBuffer& Out, std::vector<FGraphPackage>& Packages )
+{
+  Out.Write( "digraph packages\n{\n" );
+  for ( size_t i = 0; i < Packages.size(); i++ )
+  {
+    FGraphPackage& Package = Packages[i];
+    for ( std::map<std::string, int>::iterator It = Package.FanOut.begin(); It != Package.FanOut.end(); ++It )
+    {
+      Out.Write( "  " );
+      Out.WriteJsonString( Package.Name );
+      Out.Write( " -> " );
+      Out.WriteJsonString( It->first.c_str() );
+      Out.Write( " [label=" );
+      Out.WriteInt( It->second );
+      Out.Write( "];\n" );
+    }
+  }
+  Out.Write( "}\n" );
+}
+
+static void WriteNameCounts( FTextBuffer& Out, std::map<std::string, int>& Counts )
+{
+  Out.Write( "[" );
+  for ( std::map<std::string, int>::iterator It = Counts.begin(); It != Counts.end(); ++It )
+  {
+    if ( It != Counts.begin() )
+      Out.Write( "," );
+    Out.Write( "{\"package\":" );
+    Out.WriteJsonString( It->first.c_str() );
+    Out.Write( ",\"objects\":" );
+    Out.WriteInt( It->second );
+    Out.Write( "}" );
+  }
+  Out.Write( "]" );
+}
+
+static void WriteGraphJson( FTextBuffer& Out, std::vector<FGraphPackage>& Packages,
+  std::vector<FGraphExport*>& Unused, std::vector<FGraphPackage*>& UnusedPkgs )
+{
+  Out.Write( "{\"packages\":[" );
+  for ( size_t i = 0; i < Packages.size(); i++ )
+  {
+    FGraphPackage& Package = Packages[i];
+    Out.Write( (i == 0) ? "\n  {\"name\":" : ",\n  {\"name\":" );
+    Out.WriteJsonString( Package.Name );
+    Out.Write( ",\"path\":" );
+    Out.WriteJsonString( GPackageIndex.GetString( Package.Entry->Path ) );
+    Out.Write( ",\"readable\":" );
+    Out.Write( Package.bReadable ? "true" : "false" );
+    Out.Write( ",\"imports\":" );
+    WriteNameCounts( Out, Package.FanOut );
+    Out.Write( ",\"importedBy\":" );
+    WriteNameCounts( Out, Package.FanIn );
+    Out.Write( "}" );
+  }
+
+  Out.Write( "\n],\"unreferenced\":[" );
+  for ( size_t i = 0; i < Unused.size(); i++ )
+  {
+    Out.Write( (i == 0) ? "\n  {\"package\":" : ",\n  {\"package\":" );
+    Out.WriteJsonString( UnusedPkgs[i]->Name );
+    Out.Write( ",\"object\":" );
+    Out.WriteJsonString( Unused[i]->Path.c_str() );
+    Out.Write( ",\"class\":" );
+    Out.WriteJsonString( Unused[i]->Class.c_str() );
+    Out.Write( ",\"size\":" );
+    Out.WriteInt( Unused[i]->Size );
+    Out.Write( ",\"verifiable\":" );
+    Out.Write( UnusedPkgs[i]->bHasScript ? "false" : "true" );
+    Out.Write( "}" );
+  }
+  Out.Write( "\n]}\n" );
+}
+
+/*-----------------------------------------------------------------------------
+ * pkggraph
+-----------------------------------------------------------------------------*/
+static const char* const DefaultAssetClasses =
+  "Texture,FireTexture,IceTexture,WaterTexture,WaveTexture,WetTexture,ScriptedTexture,"
+  "Sound,Music,Mesh,LodMesh,Font";
+
+static void SplitList( const char* List, TArray<char*>& OutItems )
+{
+  char* Copy = strdup( List );
+  for ( char* Item = strtok( Copy, "," ); Item != NULL; Item = strtok( NULL, "," ) )
+    OutItems.PushBack( strdup( Item ) );
+  free( Copy );
+}
+
+int pkggraph( int argc, char** argv )
+{
+  char* Format = NULL;
+  char* OutFile = NULL;
+  char* PackageList = NULL;
+  char* ClassList = NULL;
+
+  // Argument parsing
+  for ( int i = 0; i < argc; i++ )
+  {
+    if ( argv[i][0] != '-' || i + 1 == argc )
+      goto BadOpt;
+
+    switch ( argv[i][1] )
+    {
+    case 'f':
+      Format = argv[++i];
+      break;
+    case 'o':
+      OutFile = argv[++i];
+      break;
+    case 'p':
+      PackageList = argv[++i];
+      break;
+    case 'c':
+      ClassList = argv[++i];
+      break;
+    default:
+      GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
+    BadOpt:
+      printf( "pkggraph usage:\n" );
+      printf( "\tlucc [gopts] pkggraph [copts]\n\n" );
+
+      printf( "Command options:\n" );
+      printf( "\t-f \"<Format>\"        - Specifies the output (f)ormat, \"text\" (default), \"dot\" or \"json\"\n" );
+      printf( "\t-o \"<File>\"          - Writes the report to a file instead of the console (o)utput\n" );
+      printf( "\t-p \"<Pkg,Pkg,...>\"   - Only reports unreferenced exports of these (p)ackages\n" );
+      printf( "\t-c \"<Class,...>\"     - Only reports unreferenced exports of these (c)lasses\n" );
+      printf( "\n" );
+      return ERR_BAD_ARGS;
+    }
+  }
+
+  enum { FORMAT_Text, FORMAT_Dot, FORMAT_Json } OutFormat = FORMAT_Text;
+  if ( Format != NULL )
+  {
+    if ( stricmp( Format, "dot" ) == 0 )
+      OutFormat = FORMAT_Dot;
+    else if ( stricmp( Format, "json" ) == 0 )
+      OutFormat = FORMAT_Json;
+    else if ( stricmp( Format, "text" ) != 0 )
+    {
+      GLogf( LOG_CRIT, "Unknown output format '%s'", Format );
+      return ERR_BAD_ARGS;
+    }
+  }
+
+  if ( !GPackageIndex.OpenIfNeeded() )
+  {
+    GLogf( LOG_CRIT, "The package index could not be opened" );
+    return ERR_BAD_PATH;
+  }
+
+  TArray<char*> ReportPackages;
+  TArray<char*> ReportClasses;
+  if ( PackageList != NULL )
+    SplitList( PackageList, ReportPackages );
+  SplitList( (ClassList != NULL) ? ClassList : DefaultAssetClasses, ReportClasses );
+
+  // One node per package name, using the file the game would load
+  double StartTime = USystem::GetSeconds();
+  std::vector<FGraphPackage> Packages;
+  for ( u32 i = 0; i < GPackageIndex.Header->NumPackages; i++ )
+  {
+    const FIndexedPackage* Entry = &GPackageIndex.Packages[i];
+    const char* Name = GPackageIndex.GetString( Entry->Name );
+    if ( GPackageIndex.Find( Name ) != Entry )
+      continue;
+
+    FGraphPackage Package;
+    Package.Entry = Entry;
+    Package.Name = Name;
+    Package.bReadable = false;
+    Package.bHasScript = false;
+    Packages.push_back( Package );
+  }
+
+  ParallelFor( (int)Packages.size(), [&]( int i )
+  {
+    ReadPackageRefs( Packages[i] );
+  });
+
+  // Resolve every import against the exports of the package it names
+  std::unordered_map<std::string, size_t> PackageMap;
+  std::unordered_map<std::string, FGraphExport*> ExportMap;
+  for ( size_t i = 0; i < Packages.size(); i++ )
+  {
+    FGraphPackage& Package = Packages[i];
+    std::string Prefix = ToLower( Package.Name ) + ".";
+    PackageMap[ToLower( Package.Name )] = i;
+    for ( size_t j = 0; j < Package.Exports.size(); j++ )
+      ExportMap[Prefix + ToLower( Package.Exports[j].Path.c_str() )] = &Package.Exports[j];
+  }
+
+  for ( size_t i = 0; i < Packages.size(); i++ )
+  {
+    FGraphPackage& Package = Packages[i];
+    for ( size_t j = 0; j < Package.Imports.size(); j++ )
+    {
+      std::string Import = ToLower( Package.Imports[j].c_str() );
+      std::string Target = Package.Imports[j].substr( 0, Import.find( '.' ) );
+
+      std::unordered_map<std::string, FGraphExport*>::iterator Export = ExportMap.find( Import );
+      if ( Export != ExportMap.end() )
+        Export->second->bUsed = true;
+
+      // Edges use the package's real name where it is known
+      std::unordered_map<std::string, size_t>::iterator TargetPkg = PackageMap.find( ToLower( Target.c_str() ) );
+      if ( TargetPkg != PackageMap.end() )
+      {
+        Package.FanOut[Packages[TargetPkg->second].Name]++;
+        Packages[TargetPkg->second].FanIn[Package.Name]++;
+      }
+      else
+      {
+        Package.FanOut[Target]++;
+      }
+    }
+  }
+
+  // Maps are where references start, nothing ever imports from them. Script
+  // packages use their own assets from code and defaults the tables don't
+  // show, so they are only reported when asked for by name
+  std::vector<FGraphExport*> Unused;
+  std::vector<FGraphPackage*> UnusedPkgs;
+  for ( size_t i = 0; i < Packages.size(); i++ )
+  {
+    FGraphPackage& Package = Packages[i];
+    if ( ReportPackages.Size() > 0 ? !IsInList( Package.Name, ReportPackages ) :
+         (IsMapPackage( Package ) || Package.bHasScript) )
+      continue;
+
+    for ( size_t j = 0; j < Package.Exports.size(); j++ )
+    {
+      FGraphExport& Export = Package.Exports[j];
+      if ( !Export.bUsed && IsInList( Export.Class.c_str(), ReportClasses ) )
+      {
+        Unused.push_back( &Export );
+        UnusedPkgs.push_back( &Package );
+      }
+    }
+  }
+
+  GLogf( LOG_INFO, "Built the reference graph of %i packages in %.3f seconds",
+    (int)Packages.size(), USystem::GetSeconds() - StartTime );
+
+  FILE* File = stdout;
+  if ( OutFile != NULL )
+  {
+    // Relative to our original working directory
+    char FileName[4096];
+#ifdef _WIN32
+    if ( strchr( OutFile, ':' ) != NULL )
+      strcpy( FileName, OutFile );
+    else
+#endif
+      snprintf( FileName, sizeof( FileName ), "%s/%s", wd, OutFile );
+
+    File = fopen( FileName, "wb" );
+    if ( File == NULL )
+    {
+      GLogf( LOG_CRIT, "Failed to open '%s' for writing", FileName );
+      return ERR_BAD_PATH;
+    }
+  }
+
+  {
+    FTextBuffer Out( File );
+    if ( OutFormat == FORMAT_Dot )
+      WriteGraphDot( Out, Packages );
+    else if ( OutFormat == FORMAT_Json )
+      WriteGraphJson( Out, Packages, Unused, UnusedPkgs );
+    else
+      WriteGraphText( Out, Packages, Unused, UnusedPkgs );
+  }
+
+  if ( File != stdout )
+    fclose( File );
+
+  for ( int i = 0; i < ReportPackages.Size(); i++ )
+    free( ReportPackages[i] );
+  for ( int i = 0; i < ReportClasses.Size(); i++ )
+    free( ReportClasses[i] );
+
+  return 0;
+}
@@ -0,0 +1,592 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * PackageIndex.cpp - Persistent index of every package in a game
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+#include <stdlib.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+  #include <unistd.h>
+#endif
+#include "lucc.h"
+
+FPackageIndex GPackageIndex;
+
+/*-----------------------------------------------------------------------------
+ * Index building
+ * Package files are found by listing the game's folders. Files whose size
+ * and modification time haven't changed keep their old entry, everything
+ * else has its tables read again
+-----------------------------------------------------------------------------*/
+struct FPackageScan
+{
+  std::string Name;
+  std::string Path;
+  u32 SearchOrder;
+  u64 FileSize;
+  i64 FileTime;
+  u8 Guid[16];
+  u32 NumExports;
+  u32 NumImports;
+  u32 Flags;
+  std::vector< std::pair<std::string, u32> > Classes;
+};
+
+static bool GetFileInfo( const char* FileName, u64& OutSize, i64& OutTime )
+{
+  struct stat Stat;
+  if ( stat( FileName, &Stat ) != 0 )
+    return false;
+
+  OutSize = (u64)Stat.st_size;
+  OutTime = (i64)Stat.st_mtime;
+  return true;
+}
+
+// Folders change whenever a file is added, removed or renamed inside them.
+// The trailing slash is dropped, stat() on Windows fails with it
+static void GetDirTimes( i64* OutTimes )
+{
+  for ( int i = 0; i < NUM_PACKAGE_DIRS; i++ )
+  {
+    char Dir[256];
+    u64 Size;
+    int Len = (int)strlen( PackageDirs[i] );
+    if ( Len > 0 && (PackageDirs[i][Len-1] == '/' || PackageDirs[i][Len-1] == '\\') )
+      Len--;
+    snprintf( Dir, sizeof( Dir ), "%.*s", Len, PackageDirs[i] );
+    if ( !GetFileInfo( Dir, Size, OutTimes[i] ) )
+      OutTimes[i] = 0;
+  }
+}
+
+// The index lives in the game's root folder. When that can't be written
+// (e.g. a read-only install), it goes in the user's cache folder instead,
+// named after the game's System folder so every game gets its own
+#define NUM_INDEX_LOCATIONS 2
+
+static bool GetIndexFileName( int Location, char* Out, size_t OutSize, bool bMakeDir )
+{
+  if ( Location == 0 )
+  {
+    snprintf( Out, OutSize, "%s", PACKAGE_INDEX_FILE );
+    return true;
+  }
+
+  char Cwd[4096];
+  if ( getcwd( Cwd, sizeof( Cwd ) ) == NULL )
+    return false;
+
+  u64 Hash = 14695981039346656037ULL;
+  for ( const char* It = Cwd; *It != '\0'; It++ )
+  {
+    Hash ^= (u8)*It;
+    Hash *= 1099511628211ULL;
+  }
+
+  char Dir[4096];
+#ifdef _WIN32
+  const char* Base = getenv( "LOCALAPPDATA" );
+  if ( Base == NULL || Base[0] == '\0' )
+    return false;
+  snprintf( Dir, sizeof( Dir ), "%s/lucc", Base );
+#else
+  const char* Base = getenv( "XDG_CACHE_HOME" );
+  if ( Base != NULL && Base[0] != '\0' )
+    snprintf( Dir, sizeof( Dir ), "%s/lucc", Base );
+  else if ( (Base = getenv( "HOME" )) != NULL && Base[0] != '\0' )
+    snprintf( Dir, sizeof( Dir ), "%s/.cache/lucc", Base );
+  else
+    return false;
+#endif
+
+  if ( bMakeDir && !USystem::MakeDir( Dir ) )
+    return false;
+
+  snprintf( Out, OutSize, "%s/%016llx.pkgindex", Dir, (unsigned long long)Hash );
+  return true;
+}
+
+static void ScanPackage( FPackageScan& Scan )
+{
+  Scan.NumExports = 0;
+  Scan.NumImports = 0;
+  Scan.Flags = 0;
+  memset( Scan.Guid, 0, sizeof( Scan.Guid ) );
+
+  FPackageReader Reader;
+  if ( !Reader.Open( Scan.Path.c_str() ) )
+  {
+    GLogf( LOG_WARN, "Package index: can't read '%s'; %s", Scan.Path.c_str(), Reader.Error );
+    Scan.Flags |= INDEX_BadPackage;
+    return;
+  }
+
+  memcpy( Scan.Guid, Reader.Guid, sizeof( Scan.Guid ) );
+  Scan.NumExports = (u32)Reader.Exports.size();
+  Scan.NumImports = (u32)Reader.Imports.size();
+
+  std::unordered_map<std::string, u32> Counts;
+  for ( size_t i = 0; i < Reader.Exports.size(); i++ )
+    Counts[Reader.GetClassName( (int)i + 1 )]++;
+
+  Scan.Classes.assign( Counts.begin(), Counts.end() );
+  std::sort( Scan.Classes.begin(), Scan.Classes.end(),
+    []( const std::pair<std::string, u32>& A, const std::pair<std::string, u32>& B )
+  {
+    if ( A.second != B.second )
+      return A.second > B.second;
+    return A.first < B.first;
+  });
+}
+
+static u32 AddString( std::string& Strings, std::unordered_map<std::string, u32>& Offsets, const std::string& Str )
+{
+  std::unordered_map<std::string, u32>::iterator It = Offsets.find( Str );
+  if ( It != Offsets.end() )
+    return It->second;
+
+  u32 Offset = (u32)Strings.size();
+  Strings.append( Str.c_str(), Str.size() + 1 );
+  Offsets[Str] = Offset;
+  return Offset;
+}
+
+/*-----------------------------------------------------------------------------
+ * FPackageIndex
+-----------------------------------------------------------------------------*/
+FPackageIndex::FPackageIndex()
+  : Header( NULL ), Packages( NULL ), ClassCounts( NULL ), Strings( NULL ), bTriedOpen( false )
+{
+}
+
+bool FPackageIndex::Open( bool bRefresh )
+{
+  bTriedOpen = true;
+
+  // An out of date index still saves reading every package that didn't
+  // change, so keep one around in case none of them are current
+  int Stale = -1;
+  for ( int i = 0; i < NUM_INDEX_LOCATIONS; i++ )
+  {
+    if ( !MapFile( i ) )
+      continue;
+
+    if ( !bRefresh && IsCurrent() )
+      return true;
+
+    if ( Stale < 0 )
+      Stale = i;
+  }
+
+  if ( Header == NULL && Stale >= 0 )
+    MapFile( Stale );
+
+  return Update( bRefresh );
+}
+
+// Opens the index the first time a command asks for it
+bool FPackageIndex::OpenIfNeeded()
+{
+  if ( !bTriedOpen )
+    Open( false );
+  return IsOpen();
+}
+
+bool FPackageIndex::MapFile( int Location )
+{
+  char FileName[4096];
+  Header = NULL;
+  Map.Close();
+  return GetIndexFileName( Location, FileName, sizeof( FileName ), false ) &&
+    Map.Open( FileName ) && Attach( Map.Data, Map.Size );
+}
+
+// Files that were added or removed show up in the folder times, files that
+// were changed in place in their own size and time
+bool FPackageIndex::IsCurrent()
+{
+  i64 DirTimes[NUM_PACKAGE_DIRS];
+  GetDirTimes( DirTimes );
+  if ( memcmp( Header->DirTimes, DirTimes, sizeof( DirTimes ) ) != 0 )
+    return false;
+
+  for ( u32 i = 0; i < Header->NumPackages; i++ )
+  {
+    u64 FileSize;
+    i64 FileTime;
+    if ( !GetFileInfo( GetString( Packages[i].Path ), FileSize, FileTime ) ||
+         FileSize != Packages[i].FileSize || FileTime != Packages[i].FileTime )
+      return false;
+  }
+
+  return true;
+}
+
+bool FPackageIndex::Attach( const u8* Data, size_t Size )
+{
+  Header = NULL;
+  if ( Data == NULL || Size < sizeof( FPackageIndexHeader ) )
+    return false;
+
+  const FPackageIndexHeader* NewHeader = (const FPackageIndexHeader*)Data;
+  if ( NewHeader->Magic != PACKAGE_INDEX_MAGIC || NewHeader->Version != PACKAGE_INDEX_VERSION )
+    return false;
+
+  size_t ExpectedSize = sizeof( FPackageIndexHeader ) +
+    (size_t)NewHeader->NumPackages * sizeof( FIndexedPackage ) +
+    (size_t)NewHeader->NumClassCounts * sizeof( FIndexedClassCount ) +
+    NewHeader->StringsSize;
+  if ( Size != ExpectedSize || NewHeader->StringsSize == 0 || Data[Size-1] != '\0' )
+    return false;
+
+  const FIndexedPackage* NewPackages = (const FIndexedPackage*)(Data + sizeof( FPackageIndexHeader ));
+  const FIndexedClassCount* NewClassCounts = (const FIndexedClassCount*)(NewPackages + NewHeader->NumPackages);
+
+  // Every string offset and class count range has to land inside the file,
+  // a damaged index is rebuilt rather than read past its end
+  for ( u32 i = 0; i < NewHeader->NumPackages; i++ )
+  {
+    const FIndexedPackage& Pkg = NewPackages[i];
+    if ( Pkg.Name >= NewHeader->StringsSize || Pkg.Path >= NewHeader->StringsSize )
+      return false;
+    if ( Pkg.FirstClassCount > NewHeader->NumClassCounts ||
+         Pkg.NumClassCounts > NewHeader->NumClassCounts - Pkg.FirstClassCount )
+      return false;
+  }
+
+  for ( u32 i = 0; i < NewHeader->NumClassCounts; i++ )
+  {
+    if ( NewClassCounts[i].ClassName >= NewHeader->StringsSize )
+      return false;
+  }
+
+  Packages = NewPackages;
+  ClassCounts = NewClassCounts;
+  Strings = (const char*)(NewClassCounts + NewHeader->NumClassCounts);
+  Header = NewHeader;
+  return true;
+}
+
+bool FPackageIndex::Update( bool bReadAll )
+{
+  double StartTime = USystem::GetSeconds();
+
+  // Entries that are still valid are copied from the old index
+  std::unordered_map<std::string, const FIndexedPackage*> OldPackages;
+  for ( u32 i = 0; Header != NULL && !bReadAll && i < Header->NumPackages; i++ )
+    OldPackages[GetString( Packages[i].Path )] = &Packages[i];
+
+  std::vector<FPackageScan> Scans;
+  for ( int i = 0; i < NUM_PACKAGE_DIRS; i++ )
+  {
+    for ( int j = 0; j < NUM_PACKAGE_EXTS; j++ )
+    {
+      TArray<char*> Names;
+      FindPackageFiles( PackageDirs[i], PackageExts[j], Names );
+      for ( int k = 0; k < Names.Size(); k++ )
+      {
+        FPackageScan Scan;
+        Scan.Name = Names[k];
+        Scan.Path = std::string( PackageDirs[i] ) + Names[k] + PackageExts[j];
+        Scan.SearchOrder = i * NUM_PACKAGE_EXTS + j;
+        Scans.push_back( Scan );
+        free( Names[k] );
+      }
+    }
+  }
+
+  std::atomic<int> NumRead( 0 );
+  ParallelFor( (int)Scans.size(), [&]( int i )
+  {
+    FPackageScan& Scan = Scans[i];
+    if ( !GetFileInfo( Scan.Path.c_str(), Scan.FileSize, Scan.FileTime ) )
+    {
+      Scan.FileSize = 0;
+      Scan.FileTime = 0;
+    }
+
+    std::unordered_map<std::string, const FIndexedPackage*>::iterator Old = OldPackages.find( Scan.Path );
+    if ( Old != OldPackages.end() && Old->second->FileSize == Scan.FileSize && Old->second->FileTime == Scan.FileTime )
+    {
+      const FIndexedPackage* Package = Old->second;
+      memcpy( Scan.Guid, Package->Guid, sizeof( Scan.Guid ) );
+      Scan.NumExports = Package->NumExports;
+      Scan.NumImports = Package->NumImports;
+      Scan.Flags = Package->Flags;
+      for ( u32 j = 0; j < Package->NumClassCounts; j++ )
+      {
+        const FIndexedClassCount& Count = ClassCounts[Package->FirstClassCount + j];
+        Scan.Classes.push_back( std::make_pair( std::string( GetString( Count.ClassName ) ), Count.Count ) );
+      }
+      return;
+    }
+
+    ScanPackage( Scan );
+    NumRead++;
+  });
+
+  std::sort( Scans.begin(), Scans.end(), []( const FPackageScan& A, const FPackageScan& B )
+  {
+    int Cmp = stricmp( A.Name.c_str(), B.Name.c_str() );
+    if ( Cmp != 0 )
+      return Cmp < 0;
+    return A.SearchOrder < B.SearchOrder;
+  });
+
+  // Lay out the new index
+  std::vector<FIndexedPackage> NewPackages( Scans.size() );
+  std::vector<FIndexedClassCount> NewCounts;
+  std::string NewStrings;
+  std::unordered_map<std::string, u32> StringOffsets;
+  for ( size_t i = 0; i < Scans.size(); i++ )
+  {
+    FPackageScan& Scan = Scans[i];
+    FIndexedPackage& Package = NewPackages[i];
+    Package.Name = AddString( NewStrings, StringOffsets, Scan.Name );
+    Package.Path = AddString( NewStrings, StringOffsets, Scan.Path );
+    Package.FileSize = Scan.FileSize;
+    Package.FileTime = Scan.FileTime;
+    memcpy( Package.Guid, Scan.Guid, sizeof( Package.Guid ) );
+    Package.NumExports = Scan.NumExports;
+    Package.NumImports = Scan.NumImports;
+    Package.FirstClassCount = (u32)NewCounts.size();
+    Package.NumClassCounts = (u32)Scan.Classes.size();
+    Package.SearchOrder = Scan.SearchOrder;
+    Package.Flags = Scan.Flags;
+
+    for ( size_t j = 0; j < Scan.Classes.size(); j++ )
+    {
+      FIndexedClassCount Count;
+      Count.ClassName = AddString( NewStrings, StringOffsets, Scan.Classes[j].first );
+      Count.Count = Scan.Classes[j].second;
+      NewCounts.push_back( Count );
+    }
+  }
+  NewStrings.push_back( '\0' );
+
+  FPackageIndexHeader NewHeader;
+  memset( &NewHeader, 0, sizeof( NewHeader ) );
+  NewHeader.Magic = PACKAGE_INDEX_MAGIC;
+  NewHeader.Version = PACKAGE_INDEX_VERSION;
+  NewHeader.NumPackages = (u32)NewPackages.size();
+  NewHeader.NumClassCounts = (u32)NewCounts.size();
+  NewHeader.StringsSize = (u32)NewStrings.size();
+  GetDirTimes( NewHeader.DirTimes );
+
+  std::vector<u8> Data;
+  Data.insert( Data.end(), (u8*)&NewHeader, (u8*)(&NewHeader + 1) );
+  Data.insert( Data.end(), (u8*)NewPackages.data(), (u8*)(NewPackages.data() + NewPackages.size()) );
+  Data.insert( Data.end(), (u8*)NewCounts.data(), (u8*)(NewCounts.data() + NewCounts.size()) );
+  Data.insert( Data.end(), NewStrings.begin(), NewStrings.end() );
+
+  // The old index is no longer needed, and has to be unmapped before it
+  // can be replaced
+  Header = NULL;
+  Map.Close();
+
+  GLogf( LOG_DEV, "Package index: %i packages, %i read, in %.3f seconds",
+    (int)Scans.size(), (int)NumRead, USystem::GetSeconds() - StartTime );
+
+  for ( int i = 0; i < NUM_INDEX_LOCATIONS; i++ )
+  {
+    char FileName[4096];
+    char TmpName[4096];
+    if ( !GetIndexFileName( i, FileName, sizeof( FileName ), true ) )
+      continue;
+    snprintf( TmpName, sizeof( TmpName ), "%s.tmp", FileName );
+
+    bool bSaved = false;
+    FILE* File = fopen( TmpName, "wb" );
+    if ( File != NULL )
+    {
+      bSaved = fwrite( Data.data(), 1, Data.size(), File ) == Data.size();
+      bSaved &= fclose( File ) == 0;
+#ifdef _WIN32
+      remove( FileName );
+#endif
+      bSaved = bSaved && rename( TmpName, FileName ) == 0;
+      if ( !bSaved )
+        remove( TmpName );
+    }
+
+    if ( bSaved && MapFile( i ) )
+    {
+      Built.clear();
+      return true;
+    }
+
+    GLogf( LOG_DEV, "Package index: could not write '%s'", FileName );
+  }
+
+  // Nowhere to save it; keep it for this run
+  Map.Close();
+  Built.swap( Data );
+  return Attach( Built.data(), Built.size() );
+}
+
+const FIndexedPackage* FPackageIndex::Find( const char* Name )
+{
+  if ( Header == NULL )
+    return NULL;
+
+  const FIndexedPackage* End = Packages + Header->NumPackages;
+  const FIndexedPackage* Found = std::lower_bound( Packages, End, Name,
+    [this]( const FIndexedPackage& Package, const char* Key )
+  {
+    return stricmp( GetString( Package.Name ), Key ) < 0;
+  });
+
+  if ( Found == End || stricmp( GetString( Found->Name ), Name ) != 0 )
+    return NULL;
+  return Found;
+}
+
+/*-----------------------------------------------------------------------------
+ * pkgindex
+ * Refreshes the package index and answers questions from it
+-----------------------------------------------------------------------------*/
+static void PrintPackageEntry( const FIndexedPackage* Package )
+{
+  printf( "%s\n", GPackageIndex.GetString( Package->Name ) );
+  printf( "  Path:    %s\n", GPackageIndex.GetString( Package->Path ) );
+  printf( "  Size:    %llu bytes\n", (unsigned long long)Package->FileSize );
+  if ( Package->Flags & INDEX_BadPackage )
+  {
+    printf( "  (tables could not be read)\n" );
+    return;
+  }
+
+  printf( "  GUID:    " );
+  for ( int i = 0; i < 16; i++ )
+    printf( "%02X", Package->Guid[i] );
+  printf( "\n  Exports: %u\n", Package->NumExports );
+  printf( "  Imports: %u\n", Package->NumImports );
+  printf( "  Classes:\n" );
+  for ( u32 i = 0; i < Package->NumClassCounts; i++ )
+  {
+    const FIndexedClassCount& Count = GPackageIndex.ClassCounts[Package->FirstClassCount + i];
+    printf( "    %-32s %u\n", GPackageIndex.GetString( Count.ClassName ), Count.Count );
+  }
+}
+
+int pkgindex( int argc, char** argv )
+{
+  bool bRefresh = false;
+  char* ClassName = NULL;
+  char* ShowPackage = NULL;
+
+  // Argument parsing
+  for ( int i = 0; i < argc; i++ )
+  {
+    if ( argv[i][0] != '-' )
+      goto BadOpt;
+
+    switch ( argv[i][1] )
+    {
+    case 'r':
+      bRefresh = true;
+      break;
+    case 'c':
+      if ( ++i == argc )
+        goto BadOpt;
+      ClassName = argv[i];
+      break;
+    case 's':
+      if ( ++i == argc )
+        goto BadOpt;
+      ShowPackage = argv[i];
+      break;
+    default:
+      GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
+    BadOpt:
+      printf( "pkgindex usage:\n" );
+      printf( "\tlucc [gopts] pkgindex [copts]\n\n" );
+
+      printf( "Command options:\n" );
+      printf( "\t-r                   - (R)e-reads every package, even ones that didn't change\n" );
+      printf( "\t-c \"<ClassName>\"    - Lists the packages with objects of a (c)lass\n" );
+      printf( "\t-s \"<Package>\"      - (S)hows everything indexed for one package\n" );
+      printf( "\n" );
+      return ERR_BAD_ARGS;
+    }
+  }
+
+  if ( !GPackageIndex.Open( bRefresh ) )
+  {
+    GLogf( LOG_CRIT, "Failed to build the package index" );
+    return ERR_BAD_PATH;
+  }
+
+  const FPackageIndexHeader* Header = GPackageIndex.Header;
+  if ( ShowPackage != NULL )
+  {
+    const FIndexedPackage* Package = GPackageIndex.Find( ShowPackage );
+    if ( Package == NULL )
+    {
+      GLogf( LOG_CRIT, "Package '%s' is not in the index", ShowPackage );
+      return ERR_MISSING_PKG;
+    }
+    PrintPackageEntry( Package );
+    return 0;
+  }
+
+  if ( ClassName != NULL )
+  {
+    u32 Total = 0;
+    for ( u32 i = 0; i < Header->NumPackages; i++ )
+    {
+      const FIndexedPackage& Package = GPackageIndex.Packages[i];
+      for ( u32 j = 0; j < Package.NumClassCounts; j++ )
+      {
+        const FIndexedClassCount& Count = GPackageIndex.ClassCounts[Package.FirstClassCount + j];
+        if ( stricmp( GPackageIndex.GetString( Count.ClassName ), ClassName ) == 0 )
+        {
+          printf( "  %-32s %8u\n", GPackageIndex.GetString( Package.Path ), Count.Count );
+          Total += Count.Count;
+        }
+      }
+    }
+    printf( "%u objects of class '%s'\n", Total, ClassName );
+    return 0;
+  }
+
+  u64 TotalSize = 0;
+  u64 TotalExports = 0;
+  printf( "  %-32s %10s %8s  %s\n", "Package", "KB", "Exports", "Path" );
+  for ( u32 i = 0; i < Header->NumPackages; i++ )
+  {
+    const FIndexedPackage& Package = GPackageIndex.Packages[i];
+    printf( "  %-32s %10.1f %8u  %s%s\n", GPackageIndex.GetString( Package.Name ), Package.FileSize / 1024.0,
+      Package.NumExports, GPackageIndex.GetString( Package.Path ), (Package.Flags & INDEX_BadPackage) ? " (unreadable)" : "" );
+    TotalSize += Package.FileSize;
+    TotalExports += Package.NumExports;
+  }
+  printf( "%u packages, %.1f MB, %llu exports\n", Header->NumPackages, TotalSize / (1024.0 * 1024.0),
+    (unsigned long long)TotalExports );
+
+  return 0;
+}
@@ -0,0 +1,464 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * PackageReader.cpp - Reads package tables without loading the package
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <algorithm>
+#ifndef _WIN32
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/stat.h>
+#endif
+#include "lucc.h"
+
+#define TABLE_CHUNK_SIZE (64 * 1024)
+#define MAX_NAME_LEN     1024
+#define MAX_OUTER_DEPTH  64
+
+/*-----------------------------------------------------------------------------
+ * FTableCursor
+ * Walks through a table in the file, reading it in chunks as it goes so
+ * that only the table itself is ever read
+-----------------------------------------------------------------------------*/
+struct FTableCursor
+{
+  FTableCursor( FPackageReader* InReader, u64 InPos )
+    : Reader( InReader ), Pos( InPos ), BufStart( 0 ), BufLen( 0 )
+  {
+  }
+
+  bool Read( void* Out, size_t Size )
+  {
+    u8* Dest = (u8*)Out;
+    while ( Size > 0 )
+    {
+      if ( Pos < BufStart || Pos >= BufStart + BufLen )
+      {
+        if ( Pos >= Reader->FileSize )
+          return false;
+
+        BufStart = Pos;
+        BufLen = (size_t)std::min( (u64)TABLE_CHUNK_SIZE, Reader->FileSize - Pos );
+        if ( !Reader->ReadAt( BufStart, Buf, BufLen ) )
+          return false;
+      }
+
+      size_t Avail = (size_t)(BufStart + BufLen - Pos);
+      size_t Num = std::min( Avail, Size );
+      memcpy( Dest, Buf + (Pos - BufStart), Num );
+      Dest += Num;
+      Pos += Num;
+      Size -= Num;
+    }
+    return true;
+  }
+
+  bool ReadInt( int& Out )
+  {
+    i32 Value;
+    if ( !Read( &Value, sizeof( Value ) ) )
+      return false;
+    Out = Value;
+    return true;
+  }
+
+  bool ReadCompact( int& Out )
+  {
+    u8 B;
+    if ( !Read( &B, 1 ) )
+      return false;
+
+    bool bNegative = (B & 0x80) != 0;
+    u32 Value = B & 0x3f;
+    if ( B & 0x40 )
+    {
+      for ( int Shift = 6; Shift < 32; Shift += 7 )
+      {
+        if ( !Read( &B, 1 ) )
+          return false;
+        Value |= (u32)(B & 0x7f) << Shift;
+        if ( !(B & 0x80) )
+          break;
+      }
+    }
+
+    Out = bNegative ? -(int)Value : (int)Value;
+    return true;
+  }
+
+  FPackageReader* Reader;
+  u64 Pos;
+  u64 BufStart;
+  size_t BufLen;
+  u8 Buf[TABLE_CHUNK_SIZE];
+};
+
+/*-----------------------------------------------------------------------------
+ * FPackageReader
+-----------------------------------------------------------------------------*/
+FPackageReader::FPackageReader()
+  : Error( NULL ), FileVersion( 0 ), LicenseeVersion( 0 ), PackageFlags( 0 ),
+    FileSize( 0 ), NameOffset( 0 ), ImportOffset( 0 ), ExportOffset( 0 ),
+#ifdef _WIN32
+    File( INVALID_HANDLE_VALUE )
+#else
+    File( -1 )
+#endif
+{
+  memset( Guid, 0, sizeof( Guid ) );
+}
+
+FPackageReader::~FPackageReader()
+{
+  Close();
+}
+
+bool FPackageReader::Open( const char* FileName )
+{
+  Close();
+
+#ifdef _WIN32
+  File = CreateFileA( FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL );
+  if ( File == INVALID_HANDLE_VALUE )
+  {
+    Error = "could not open file";
+    return false;
+  }
+
+  LARGE_INTEGER Size;
+  GetFileSizeEx( File, &Size );
+  FileSize = (u64)Size.QuadPart;
+#else
+  File = open( FileName, O_RDONLY );
+  if ( File < 0 )
+  {
+    Error = "could not open file";
+    return false;
+  }
+
+  struct stat Stat;
+  fstat( File, &Stat );
+  FileSize = (u64)Stat.st_size;
+#endif
+
+  // Header
+  struct
+  {
+    u32 Tag;
+    u16 FileVersion;
+    u16 LicenseeVersion;
+    u32 PackageFlags;
+    u32 NameCount;
+    u32 NameOffset;
+    u32 ExportCount;
+    u32 ExportOffset;
+    u32 ImportCount;
+    u32 ImportOffset;
+  } Header;
+
+  if ( !ReadAt( 0, &Header, sizeof( Header ) ) )
+  {
+    Error = "file is too small";
+    return false;
+  }
+
+  if ( Header.Tag != PACKAGE_TAG )
+  {
+    Error = "not a package file";
+    return false;
+  }
+
+  FileVersion = Header.FileVersion;
+  LicenseeVersion = Header.LicenseeVersion;
+  PackageFlags = Header.PackageFlags;
+  NameOffset = Header.NameOffset;
+  ImportOffset = Header.ImportOffset;
+  ExportOffset = Header.ExportOffset;
+
+  // Every table entry takes at least one byte, so anything more than that
+  // can only come from a damaged header
+  if ( Header.NameOffset >= FileSize || Header.NameCount > FileSize ||
+       Header.ImportOffset > FileSize || Header.ImportCount > FileSize ||
+       Header.ExportOffset > FileSize || Header.ExportCount > FileSize )
+  {
+    Error = "table offsets or counts are outside of the file";
+    return false;
+  }
+
+  // Packages before version 68 keep their GUID as the first heritage entry
+  if ( FileVersion >= 68 )
+  {
+    if ( !ReadAt( sizeof( Header ), Guid, sizeof( Guid ) ) )
+    {
+      Error = "file is too small";
+      return false;
+    }
+  }
+  else
+  {
+    u32 Heritage[2];
+    if ( !ReadAt( sizeof( Header ), Heritage, sizeof( Heritage ) ) )
+    {
+      Error = "file is too small";
+      return false;
+    }
+    if ( Heritage[0] > 0 && !ReadAt( Heritage[1], Guid, sizeof( Guid ) ) )
+    {
+      Error = "heritage table is outside of the file";
+      return false;
+    }
+  }
+
+  // Names
+  FTableCursor Cursor( this, NameOffset );
+  NameStarts.resize( Header.NameCount );
+  for ( u32 i = 0; i < Header.NameCount; i++ )
+  {
+    NameStarts[i] = (u32)NameData.size();
+
+    char Name[MAX_NAME_LEN];
+    int Len = 0;
+    if ( FileVersion >= 64 )
+    {
+      if ( !Cursor.ReadCompact( Len ) || Len < 0 || Len > MAX_NAME_LEN || !Cursor.Read( Name, Len ) )
+      {
+        Error = "name table is damaged";
+        return false;
+      }
+    }
+    else
+    {
+      do
+      {
+        if ( Len == MAX_NAME_LEN || !Cursor.Read( &Name[Len], 1 ) )
+        {
+          Error = "name table is damaged";
+          return false;
+        }
+      } while ( Name[Len++] != '\0' );
+    }
+
+    int Flags;
+    if ( !Cursor.ReadInt( Flags ) )
+    {
+      Error = "name table is damaged";
+      return false;
+    }
+
+    // Lengths include the terminator, but don't trust that it is there
+    if ( Len > 0 && Name[Len-1] == '\0' )
+      Len--;
+    NameData.insert( NameData.end(), Name, Name + Len );
+    NameData.push_back( '\0' );
+  }
+
+  // Imports
+  Cursor = FTableCursor( this, ImportOffset );
+  Imports.resize( Header.ImportCount );
+  for ( u32 i = 0; i < Header.ImportCount; i++ )
+  {
+    FRawImport& Import = Imports[i];
+    if ( !Cursor.ReadCompact( Import.ClassPackage ) || !Cursor.ReadCompact( Import.ClassName ) ||
+         !Cursor.ReadInt( Import.Package ) || !Cursor.ReadCompact( Import.ObjectName ) )
+    {
+      Error = "import table is damaged";
+      return false;
+    }
+  }
+
+  // Exports
+  Cursor = FTableCursor( this, ExportOffset );
+  Exports.resize( Header.ExportCount );
+  for ( u32 i = 0; i < Header.ExportCount; i++ )
+  {
+    FRawExport& Export = Exports[i];
+    int Flags;
+    if ( !Cursor.ReadCompact( Export.Class ) || !Cursor.ReadCompact( Export.Super ) ||
+         !Cursor.ReadInt( Export.Group ) || !Cursor.ReadCompact( Export.ObjectName ) ||
+         !Cursor.ReadInt( Flags ) || !Cursor.ReadCompact( Export.SerialSize ) )
+    {
+      Error = "export table is damaged";
+      return false;
+    }
+
+    Export.ObjectFlags = (u32)Flags;
+    Export.SerialOffset = 0;
+    if ( Export.SerialSize > 0 && !Cursor.ReadCompact( Export.SerialOffset ) )
+    {
+      Error = "export table is damaged";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void FPackageReader::Close()
+{
+#ifdef _WIN32
+  if ( File != INVALID_HANDLE_VALUE )
+    CloseHandle( File );
+  File = INVALID_HANDLE_VALUE;
+#else
+  if ( File >= 0 )
+    close( File );
+  File = -1;
+#endif
+
+  Error = NULL;
+  FileSize = 0;
+  NameData.clear();
+  NameStarts.clear();
+  Imports.clear();
+  Exports.clear();
+}
+
+// Safe to call from several threads at once
+bool FPackageReader::ReadAt( u64 Offset, void* Buf, size_t Size )
+{
+  if ( Offset > FileSize || Size > FileSize - Offset )
+    return false;
+
+#ifdef _WIN32
+  OVERLAPPED Overlapped;
+  memset( &Overlapped, 0, sizeof( Overlapped ) );
+  Overlapped.Offset = (DWORD)Offset;
+  Overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+
+  DWORD NumRead = 0;
+  return ReadFile( File, Buf, (DWORD)Size, &NumRead, &Overlapped ) && NumRead == Size;
+#else
+  u8* Dest = (u8*)Buf;
+  while ( Size > 0 )
+  {
+    ssize_t NumRead = pread( File, Dest, Size, (off_t)Offset );
+    if ( NumRead <= 0 )
+      return false;
+
+    Dest += NumRead;
+    Offset += NumRead;
+    Size -= NumRead;
+  }
+  return true;
+#endif
+}
+
+bool FPackageReader::ReadExportData( int iExport, std::vector<u8>& OutData )
+{
+  FRawExport& Export = Exports[iExport];
+  if ( Export.SerialSize <= 0 )
+  {
+    OutData.clear();
+    return true;
+  }
+
+  OutData.resize( Export.SerialSize );
+  return ReadAt( (u32)Export.SerialOffset, OutData.data(), Export.SerialSize );
+}
+
+const char* FPackageReader::GetName( int Idx )
+{
+  if ( Idx < 0 || Idx >= (int)NameStarts.size() )
+    return "";
+  return &NameData[NameStarts[Idx]];
+}
+
+const char* FPackageReader::GetObjectName( int ObjRef )
+{
+  if ( ObjRef > 0 && ObjRef <= (int)Exports.size() )
+    return GetName( Exports[ObjRef-1].ObjectName );
+  if ( ObjRef < 0 && -ObjRef <= (int)Imports.size() )
+    return GetName( Imports[-ObjRef-1].ObjectName );
+  return "None";
+}
+
+const char* FPackageReader::GetClassName( int ObjRef )
+{
+  if ( ObjRef > 0 && ObjRef <= (int)Exports.size() )
+  {
+    int Class = Exports[ObjRef-1].Class;
+    return (Class == 0) ? "Class" : GetObjectName( Class );
+  }
+  if ( ObjRef < 0 && -ObjRef <= (int)Imports.size() )
+    return GetName( Imports[-ObjRef-1].ClassName );
+  return "None";
+}
+
+int FPackageReader::GetOuter( int ObjRef )
+{
+  if ( ObjRef > 0 && ObjRef <= (int)Exports.size() )
+    return Exports[ObjRef-1].Group;
+  if ( ObjRef < 0 && -ObjRef <= (int)Imports.size() )
+    return Imports[-ObjRef-1].Package;
+  return 0;
+}
+
+const char* FPackageReader::GetObjectPath( int ObjRef, char* Out, size_t OutSize )
+{
+  // Collect the outers first, then write them out starting at the top
+  int Chain[MAX_OUTER_DEPTH];
+  int Depth = 0;
+  for ( int Ref = ObjRef; Ref != 0 && Depth < MAX_OUTER_DEPTH; Ref = GetOuter( Ref ) )
+    Chain[Depth++] = Ref;
+
+  size_t Len = 0;
+  Out[0] = '\0';
+  for ( int i = Depth - 1; i >= 0 && Len < OutSize; i-- )
+    Len += snprintf( Out + Len, OutSize - Len, (i == Depth - 1) ? "%s" : ".%s", GetObjectName( Chain[i] ) );
+
+  return Out;
+}
+
+int FPackageReader::FindExport( const char* Name, const char* ClassName )
+{
+  for ( int i = 0; i < (int)Exports.size(); i++ )
+  {
+    if ( stricmp( GetName( Exports[i].ObjectName ), Name ) != 0 )
+      continue;
+    if ( ClassName != NULL && stricmp( GetClassName( i + 1 ), ClassName ) != 0 )
+      continue;
+    return i;
+  }
+  return -1;
+}
+
+void FPackageReader::GetExportDependencies( int iExport, std::vector<int>& OutExports )
+{
+  // Only the references the tables themselves hold (class, super and outer)
+  // are followed; whatever the serialized data refers to isn't known
+  // without deserializing it
+  OutExports.clear();
+  OutExports.push_back( iExport );
+  for ( size_t i = 0; i < OutExports.size(); i++ )
+  {
+    FRawExport& Export = Exports[OutExports[i]];
+    int Refs[3] = { Export.Class, Export.Super, Export.Group };
+    for ( int j = 0; j < 3; j++ )
+    {
+      if ( Refs[j] <= 0 || Refs[j] > (int)Exports.size() )
+        continue;
+      if ( std::find( OutExports.begin(), OutExports.end(), Refs[j] - 1 ) == OutExports.end() )
+        OutExports.push_back( Refs[j] - 1 );
+    }
+  }
+}
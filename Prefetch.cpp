@@ -0,0 +1,307 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * Prefetch.cpp - Finds package files and reads them ahead of loading
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <algorithm>
+#ifndef _WIN32
+  #include <dirent.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+#include "lucc.h"
+
+/*-----------------------------------------------------------------------------
+ * FindPackageFile
+ * Looks for a package file the same way the game would, relative to the
+ * game's System folder. The package index answers this when it is open
+-----------------------------------------------------------------------------*/
+const char* const PackageDirs[NUM_PACKAGE_DIRS] =
+{
+  "../System/",
+  "../Maps/",
+  "../Textures/",
+  "../Sounds/",
+  "../Music/",
+};
+
+const char* const PackageExts[NUM_PACKAGE_EXTS] =
+{
+  ".u",
+  ".unr",
+  ".utx",
+  ".uax",
+  ".umx",
+  ".usm",
+  ".dx",
+};
+
+bool FindPackageFile( const char* Name, char* OutPath, size_t OutSize )
+{
+  if ( GPackageIndex.IsOpen() )
+  {
+    const FIndexedPackage* Package = GPackageIndex.Find( Name );
+    snprintf( OutPath, OutSize, "%s", (Package != NULL) ? GPackageIndex.GetString( Package->Path ) : "" );
+    return Package != NULL;
+  }
+
+  for ( int i = 0; i < NUM_PACKAGE_DIRS; i++ )
+  {
+    for ( int j = 0; j < NUM_PACKAGE_EXTS; j++ )
+    {
+      snprintf( OutPath, OutSize, "%s%s%s", PackageDirs[i], Name, PackageExts[j] );
+      if ( USystem::FileExists( OutPath ) )
+        return true;
+    }
+  }
+
+  OutPath[0] = '\0';
+  return false;
+}
+
+/*-----------------------------------------------------------------------------
+ * FindPackageFiles
+ * Lists the names (without extension) of all packages in a folder that have
+ * the given extension, sorted so that results don't depend on the OS
+-----------------------------------------------------------------------------*/
+static bool HasExtension( const char* FileName, const char* Ext )
+{
+  size_t Len = strlen( FileName );
+  size_t ExtLen = strlen( Ext );
+  return Len > ExtLen && stricmp( FileName + Len - ExtLen, Ext ) == 0;
+}
+
+static void AddPackageName( const char* FileName, const char* Ext, TArray<char*>& OutNames )
+{
+  if ( !HasExtension( FileName, Ext ) )
+    return;
+
+  size_t NameLen = strlen( FileName ) - strlen( Ext );
+  char* Name = (char*)malloc( NameLen + 1 );
+  memcpy( Name, FileName, NameLen );
+  Name[NameLen] = '\0';
+  OutNames.PushBack( Name );
+}
+
+void FindPackageFiles( const char* Dir, const char* Ext, TArray<char*>& OutNames )
+{
+  size_t Start = OutNames.Size();
+
+#ifdef _WIN32
+  char Pattern[4096];
+  snprintf( Pattern, sizeof( Pattern ), "%s/*%s", Dir, Ext );
+
+  WIN32_FIND_DATAA FindData;
+  HANDLE Find = FindFirstFileA( Pattern, &FindData );
+  if ( Find == INVALID_HANDLE_VALUE )
+    return;
+
+  do
+  {
+    if ( !(FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) )
+      AddPackageName( FindData.cFileName, Ext, OutNames );
+  } while ( FindNextFileA( Find, &FindData ) );
+  FindClose( Find );
+#else
+  DIR* Folder = opendir( Dir );
+  if ( Folder == NULL )
+    return;
+
+  for ( struct dirent* Entry = readdir( Folder ); Entry != NULL; Entry = readdir( Folder ) )
+    AddPackageName( Entry->d_name, Ext, OutNames );
+  closedir( Folder );
+#endif
+
+  std::sort( OutNames.begin() + Start, OutNames.end(),
+    []( const char* A, const char* B ) { return stricmp( A, B ) < 0; } );
+}
+
+/*-----------------------------------------------------------------------------
+ * FPackagePrefetcher
+-----------------------------------------------------------------------------*/
+FPackagePrefetcher::FPackagePrefetcher()
+  : bFollowImports( false ), bStarted( false ), bCancel( false ), NextFile( 0 ), NumWorking( 0 ),
+    bDone( false ), FinishTime( 0.0 )
+{
+}
+
+FPackagePrefetcher::~FPackagePrefetcher()
+{
+  // Whatever hasn't been read yet isn't needed anymore
+  {
+    std::lock_guard<std::mutex> Lock( FilesLock );
+    bCancel = true;
+  }
+  FilesQueued.notify_all();
+  Wait();
+  for ( int i = 0; i < Files.Size(); i++ )
+    free( Files[i] );
+}
+
+// Asks the OS to start reading a whole file into its cache, without waiting
+static void AdviseWillNeed( const char* FilePath )
+{
+#if !defined(_WIN32) && !defined(__APPLE__)
+  int Fd = open( FilePath, O_RDONLY );
+  if ( Fd >= 0 )
+  {
+    posix_fadvise( Fd, 0, 0, POSIX_FADV_WILLNEED );
+    close( Fd );
+  }
+#endif
+}
+
+void FPackagePrefetcher::AddPackage( const char* Name )
+{
+  char FilePath[4096];
+  if ( !FindPackageFile( Name, FilePath, sizeof( FilePath ) ) )
+  {
+    GLogf( LOG_DEV, "Prefetch: no file found for package '%s'", Name );
+    return;
+  }
+
+  std::lock_guard<std::mutex> Lock( FilesLock );
+  for ( int i = 0; i < Files.Size(); i++ )
+    if ( stricmp( Files[i], FilePath ) == 0 )
+      return;
+
+  Files.PushBack( strdup( FilePath ) );
+
+  // Files found after starting are queued behind the ones being read, so
+  // get the OS going on them right away
+  if ( bStarted )
+  {
+    AdviseWillNeed( FilePath );
+    FilesQueued.notify_one();
+  }
+}
+
+void FPackagePrefetcher::AddDependencies( const char* Name )
+{
+  // Imports are looked up by name many times over, the index makes that cheap
+  GPackageIndex.OpenIfNeeded();
+  bFollowImports = true;
+  AddPackage( Name );
+}
+
+void FPackagePrefetcher::AddFileImports( const char* FilePath )
+{
+  FPackageReader Reader;
+  if ( !Reader.Open( FilePath ) )
+    return;
+
+  for ( size_t i = 0; i < Reader.Imports.size(); i++ )
+  {
+    FRawImport& Import = Reader.Imports[i];
+    if ( Import.Package == 0 && stricmp( Reader.GetName( Import.ClassName ), "Package" ) == 0 )
+      AddPackage( Reader.GetName( Import.ObjectName ) );
+  }
+}
+
+void FPackagePrefetcher::Start( int NumThreads )
+{
+  StartTime = USystem::GetSeconds();
+
+  // When following imports, the file list grows as it's being read
+  if ( NumThreads > Files.Size() && !bFollowImports )
+    NumThreads = Files.Size();
+  if ( NumThreads < 1 )
+    NumThreads = 1;
+
+  for ( int i = 0; i < Files.Size(); i++ )
+    AdviseWillNeed( Files[i] );
+
+  bStarted = true;
+  NextFile = 0;
+  NumWorking = 0;
+  NumRunning = NumThreads;
+  for ( int i = 0; i < NumThreads; i++ )
+    Threads.push_back( std::thread( &FPackagePrefetcher::Run, this ) );
+}
+
+void FPackagePrefetcher::Wait()
+{
+  for ( size_t i = 0; i < Threads.size(); i++ )
+    if ( Threads[i].joinable() )
+      Threads[i].join();
+  Threads.clear();
+}
+
+void FPackagePrefetcher::Run()
+{
+  std::unique_lock<std::mutex> Lock( FilesLock );
+  while ( 1 )
+  {
+    // Threads that are still reading a file may queue its imports, so an
+    // empty queue only means we're done once nobody is working anymore
+    while ( !bCancel && NextFile >= Files.Size() && NumWorking > 0 )
+      FilesQueued.wait( Lock );
+
+    if ( bCancel || NextFile >= Files.Size() )
+      break;
+
+    const char* FilePath = Files[NextFile++];
+    NumWorking++;
+    Lock.unlock();
+
+    // Tables are small and at known offsets, so dependencies are queued
+    // well before this file has been read in full
+    if ( bFollowImports )
+      AddFileImports( FilePath );
+
+    // Nothing is read out of the mapping, all we want is for the pages to be
+    // in the file cache by the time libunr asks for them. libunr still copies
+    // the file into its own buffers when it loads it
+    {
+      FMappedFile File;
+      if ( File.Open( FilePath ) )
+        File.Touch();
+    }
+
+    Lock.lock();
+    if ( --NumWorking == 0 )
+      FilesQueued.notify_all();
+  }
+  Lock.unlock();
+
+  // Last thread out marks the whole set as read
+  if ( --NumRunning == 0 )
+  {
+    FinishTime = USystem::GetSeconds() - StartTime;
+    bDone = true;
+  }
+}
+
+UPackage* LoadPackageWithPrefetch( const char* PkgName, FPackagePrefetcher& Prefetcher )
+{
+  // Read the packages this one depends on in the background while libunr
+  // works through them one by one
+  Prefetcher.AddDependencies( PkgName );
+  Prefetcher.Start( GetNumThreads() );
+
+  UPackage* Pkg = UPackage::StaticLoadPackage( PkgName );
+  if ( Pkg == NULL )
+    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist", PkgName );
+
+  return Pkg;
+}
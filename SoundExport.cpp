@@ -112,12 +112,10 @@ int soundexport( int argc, char** argv )
   UClass* Class = USound::StaticClass();
 
   // Load package
-  UPackage* Pkg = UPackage::StaticLoadPackage( PkgName );
+  FPackagePrefetcher Prefetcher;
+  UPackage* Pkg = LoadPackageWithPrefetch( PkgName, Prefetcher );
   if ( Pkg == NULL )
-  {
-    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist" );
     return ERR_MISSING_PKG;
-  }
 
   // Iterate and export all sounds
   TArray<FExport>& ExportTable = Pkg->GetExportTable();
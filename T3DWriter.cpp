@@ -0,0 +1,615 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * T3DWriter.cpp - Streams levels out as T3D text
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <math.h>
+#include "lucc.h"
+
+/*-----------------------------------------------------------------------------
+ * FTextBuffer
+-----------------------------------------------------------------------------*/
+#define TEXT_FILE_BUFFER_SIZE (1024 * 1024)
+#define TEXT_MEM_BUFFER_SIZE  (16 * 1024)
+
+FTextBuffer::FTextBuffer( FILE* InFile )
+{
+  File = InFile;
+  Len = 0;
+  Capacity = File ? TEXT_FILE_BUFFER_SIZE : TEXT_MEM_BUFFER_SIZE;
+  Data = (char*)malloc( Capacity );
+}
+
+FTextBuffer::~FTextBuffer()
+{
+  Flush();
+  free( Data );
+}
+
+void FTextBuffer::Write( const char* Str, size_t StrLen )
+{
+  if ( Len + StrLen > Capacity )
+  {
+    if ( File )
+    {
+      Flush();
+      if ( StrLen > Capacity )
+      {
+        fwrite( Str, 1, StrLen, File );
+        return;
+      }
+    }
+    else
+    {
+      while ( Len + StrLen > Capacity )
+        Capacity *= 2;
+      Data = (char*)realloc( Data, Capacity );
+    }
+  }
+
+  memcpy( Data + Len, Str, StrLen );
+  Len += StrLen;
+}
+
+void FTextBuffer::Write( const char* Str )
+{
+  Write( Str, strlen( Str ) );
+}
+
+void FTextBuffer::WriteInt( i64 Value )
+{
+  char Buf[24];
+  Write( Buf, FormatInt( Buf, Value ) );
+}
+
+void FTextBuffer::WriteFloat( float Value )
+{
+  char Buf[64];
+  Write( Buf, FormatFloat( Buf, Value, 6 ) );
+}
+
+// Writes a quoted string with JSON escapes. UE1 strings are Latin-1, so
+// bytes above 0x7F are written as the matching \u00XX code point
+void FTextBuffer::WriteJsonString( const char* Str )
+{
+  Write( "\"", 1 );
+  for ( const char* It = Str; *It != '\0'; It++ )
+  {
+    u8 C = (u8)*It;
+    if ( C == '"' || C == '\\' )
+    {
+      char Esc[2] = { '\\', (char)C };
+      Write( Esc, 2 );
+    }
+    else if ( C < 0x20 || C >= 0x80 )
+    {
+      char Esc[8];
+      snprintf( Esc, sizeof( Esc ), "\\u%04x", C );
+      Write( Esc, 6 );
+    }
+    else
+    {
+      Write( It, 1 );
+    }
+  }
+  Write( "\"", 1 );
+}
+
+void FTextBuffer::Flush()
+{
+  if ( File && Len > 0 )
+  {
+    fwrite( Data, 1, Len, File );
+    Len = 0;
+  }
+}
+
+/*-----------------------------------------------------------------------------
+ * T3D helpers
+-----------------------------------------------------------------------------*/
+#define T3D_NEWLINE "\r\n"
+
+// Same output as printf's "%+013.6f", used for brush polygon vectors
+static void WritePolyFloat( FTextBuffer& Out, float Value )
+{
+  char Num[64];
+  char Buf[80];
+  int NumLen = FormatFloat( Num, fabsf( Value ), 6 );
+  int Pos = 0;
+
+  Buf[Pos++] = signbit( Value ) ? '-' : '+';
+  for ( int i = NumLen + 1; i < 13; i++ )
+    Buf[Pos++] = '0';
+
+  memcpy( Buf + Pos, Num, NumLen );
+  Out.Write( Buf, Pos + NumLen );
+}
+
+static void WritePolyVector( FTextBuffer& Out, const char* Label, FVector& Vec )
+{
+  Out.Write( Label );
+  WritePolyFloat( Out, Vec.X );
+  Out.Write( ",", 1 );
+  WritePolyFloat( Out, Vec.Y );
+  Out.Write( ",", 1 );
+  WritePolyFloat( Out, Vec.Z );
+  Out.Write( T3D_NEWLINE );
+}
+
+// Writes Class'Package.Group.Name'; objects from the map itself live in MyLevel
+void WriteObjectRef( FTextBuffer& Out, UObject* Obj, UPackage* MapPkg )
+{
+  if ( Obj == NULL )
+  {
+    Out.Write( "None" );
+    return;
+  }
+
+  UObject* Outers[16];
+  int NumOuters = 0;
+  for ( UObject* It = Obj->Outer; It != NULL && NumOuters < 16; It = It->Outer )
+  {
+    if ( It->Class == UPackage::StaticClass() )
+      break;
+    Outers[NumOuters++] = It;
+  }
+
+  Out.Write( Obj->Class->Name.Data() );
+  Out.Write( "'", 1 );
+  Out.Write( (Obj->Pkg == MapPkg) ? "MyLevel" : Obj->Pkg->Name.Data() );
+  while ( NumOuters > 0 )
+  {
+    Out.Write( ".", 1 );
+    Out.Write( Outers[--NumOuters]->Name.Data() );
+  }
+  Out.Write( ".", 1 );
+  Out.Write( Obj->Name.Data() );
+  Out.Write( "'", 1 );
+}
+
+static bool IsPropertyWritable( UProperty* Prop );
+
+// Structs can hold strings, which only compare equal by contents. Members
+// that are never written (dynamic arrays, transient ones) don't count
+static bool IsStructDefault( UStruct* Struct, u8* Value, u8* Default )
+{
+  for ( UStruct* It = Struct; It != NULL; It = It->SuperField )
+  {
+    for ( UField* Field = It->Children; Field != NULL; Field = Field->Next )
+    {
+      UProperty* Prop = SafeCast<UProperty>( Field );
+      if ( Prop == NULL || Prop->Offset == MAX_UINT32 || Prop->Outer != It || !IsPropertyWritable( Prop ) )
+        continue;
+
+      for ( int i = 0; i < Prop->ArrayDim; i++ )
+      {
+        u32 Offset = Prop->Offset + (i * Prop->ElementSize);
+        if ( !IsPropertyDefault( Prop, Value + Offset, Default + Offset ) )
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool IsPropertyDefault( UProperty* Prop, u8* Value, u8* Default )
+{
+  if ( Default == NULL )
+    return false;
+
+  if ( Prop->PropertyType == PROP_Struct )
+    return IsStructDefault( ((UStructProperty*)Prop)->Struct, Value, Default );
+
+  if ( Prop->PropertyType == PROP_String )
+  {
+    FString* Str = *(FString**)Value;
+    FString* DefStr = *(FString**)Default;
+    if ( Str == NULL || DefStr == NULL )
+      return Str == DefStr;
+    return strcmp( Str->Data(), DefStr->Data() ) == 0;
+  }
+
+  if ( Prop->PropertyType == PROP_Bool )
+    return (*(bool*)Value) == (*(bool*)Default);
+
+  return memcmp( Value, Default, Prop->ElementSize ) == 0;
+}
+
+static void WritePropertyValue( FTextBuffer& Out, UProperty* Prop, u8* Value, UPackage* MapPkg );
+
+// Dynamic arrays and maps are not part of T3D actor text. Transient and
+// native properties are skipped like the editor's level exporter does, const
+// and editconst ones are still written since the editor keeps them too
+static bool IsPropertyWritable( UProperty* Prop )
+{
+  if ( Prop->PropertyFlags & (CPF_Transient | CPF_Native) )
+    return false;
+
+  switch ( Prop->PropertyType )
+  {
+  case PROP_Byte:
+  case PROP_Int:
+  case PROP_Bool:
+  case PROP_Float:
+  case PROP_Object:
+  case PROP_Class:
+  case PROP_Name:
+  case PROP_String:
+  case PROP_Vector:
+  case PROP_Rotator:
+  case PROP_Struct:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Writes the "Name=Value" pairs of a struct in parentheses
+static void WriteStructValue( FTextBuffer& Out, UStruct* Struct, u8* Value, UPackage* MapPkg )
+{
+  bool bFirst = true;
+  Out.Write( "(", 1 );
+  for ( UField* It = Struct->Children; It != NULL; It = It->Next )
+  {
+    UProperty* Prop = SafeCast<UProperty>( It );
+    if ( Prop == NULL || Prop->Offset == MAX_UINT32 || !IsPropertyWritable( Prop ) )
+      continue;
+
+    for ( int i = 0; i < Prop->ArrayDim; i++ )
+    {
+      if ( !bFirst )
+        Out.Write( ",", 1 );
+      bFirst = false;
+
+      Out.Write( Prop->Name.Data() );
+      if ( Prop->ArrayDim > 1 )
+      {
+        Out.Write( "(", 1 );
+        Out.WriteInt( i );
+        Out.Write( ")", 1 );
+      }
+      Out.Write( "=", 1 );
+      WritePropertyValue( Out, Prop, Value + Prop->Offset + (i * Prop->ElementSize), MapPkg );
+    }
+  }
+  Out.Write( ")", 1 );
+}
+
+static void WritePropertyValue( FTextBuffer& Out, UProperty* Prop, u8* Value, UPackage* MapPkg )
+{
+  switch ( Prop->PropertyType )
+  {
+  case PROP_Byte:
+  {
+    // Enum values are written by name so they survive enum reordering
+    UEnum* Enum = ((UByteProperty*)Prop)->Enum;
+    u8 Byte = *(u8*)Value;
+    if ( Enum != NULL && Byte < Enum->Names.Size() )
+      Out.Write( Enum->Names[Byte].Data() );
+    else
+      Out.WriteInt( Byte );
+    break;
+  }
+  case PROP_Int:
+    Out.WriteInt( *(int*)Value );
+    break;
+  case PROP_Bool:
+    Out.Write( (*(bool*)Value) ? "True" : "False" );
+    break;
+  case PROP_Float:
+    Out.WriteFloat( *(float*)Value );
+    break;
+  case PROP_Object:
+  case PROP_Class:
+    WriteObjectRef( Out, *(UObject**)Value, MapPkg );
+    break;
+  case PROP_Name:
+    Out.Write( ((FName*)Value)->Data() );
+    break;
+  case PROP_String:
+  {
+    FString* Str = *(FString**)Value;
+    Out.Write( "\"", 1 );
+    for ( const char* It = (Str != NULL) ? Str->Data() : ""; *It != '\0'; It++ )
+    {
+      if ( *It == '"' || *It == '\\' )
+        Out.Write( "\\", 1 );
+      Out.Write( It, 1 );
+    }
+    Out.Write( "\"", 1 );
+    break;
+  }
+  case PROP_Vector:
+  {
+    FVector* Vec = (FVector*)Value;
+    Out.Write( "(X=" );
+    Out.WriteFloat( Vec->X );
+    Out.Write( ",Y=" );
+    Out.WriteFloat( Vec->Y );
+    Out.Write( ",Z=" );
+    Out.WriteFloat( Vec->Z );
+    Out.Write( ")", 1 );
+    break;
+  }
+  case PROP_Rotator:
+  {
+    FRotator* Rot = (FRotator*)Value;
+    Out.Write( "(Pitch=" );
+    Out.WriteInt( Rot->Pitch );
+    Out.Write( ",Yaw=" );
+    Out.WriteInt( Rot->Yaw );
+    Out.Write( ",Roll=" );
+    Out.WriteInt( Rot->Roll );
+    Out.Write( ")", 1 );
+    break;
+  }
+  case PROP_Struct:
+    WriteStructValue( Out, ((UStructProperty*)Prop)->Struct, Value, MapPkg );
+    break;
+  default:
+    break;
+  }
+}
+
+static void WriteBrushT3D( FTextBuffer& Out, UModel* Brush )
+{
+  Out.Write( "    Begin Brush Name=" );
+  Out.Write( Brush->Name.Data() );
+  Out.Write( T3D_NEWLINE "       Begin PolyList" T3D_NEWLINE );
+
+  TArray<FPoly>& Polys = Brush->Polys->Element;
+  for ( int i = 0; i < Polys.Size(); i++ )
+  {
+    FPoly& Poly = Polys[i];
+    Out.Write( "          Begin Polygon" );
+    if ( stricmp( Poly.ItemName.Data(), "None" ) != 0 )
+    {
+      Out.Write( " Item=" );
+      Out.Write( Poly.ItemName.Data() );
+    }
+    if ( Poly.Texture != NULL )
+    {
+      Out.Write( " Texture=" );
+      Out.Write( Poly.Texture->Name.Data() );
+    }
+    if ( Poly.PolyFlags != 0 )
+    {
+      Out.Write( " Flags=" );
+      Out.WriteInt( Poly.PolyFlags );
+    }
+    if ( Poly.iLink != i )
+    {
+      Out.Write( " Link=" );
+      Out.WriteInt( Poly.iLink );
+    }
+    Out.Write( T3D_NEWLINE );
+
+    WritePolyVector( Out, "             Origin   ", Poly.Base );
+    WritePolyVector( Out, "             Normal   ", Poly.Normal );
+    WritePolyVector( Out, "             TextureU ", Poly.TextureU );
+    WritePolyVector( Out, "             TextureV ", Poly.TextureV );
+    if ( Poly.PanU != 0 || Poly.PanV != 0 )
+    {
+      Out.Write( "             Pan      U=" );
+      Out.WriteInt( Poly.PanU );
+      Out.Write( " V=" );
+      Out.WriteInt( Poly.PanV );
+      Out.Write( T3D_NEWLINE );
+    }
+    for ( int j = 0; j < Poly.NumVertices; j++ )
+      WritePolyVector( Out, "             Vertex   ", Poly.Vertex[j] );
+
+    Out.Write( "          End Polygon" T3D_NEWLINE );
+  }
+
+  Out.Write( "       End PolyList" T3D_NEWLINE "    End Brush" T3D_NEWLINE );
+}
+
+/*-----------------------------------------------------------------------------
+ * WriteActorT3D
+ * Writes one "Begin Actor ... End Actor" block. Only properties that differ
+ * from the class defaults are written, like the editor does
+-----------------------------------------------------------------------------*/
+void WriteActorT3D( FTextBuffer& Out, AActor* Actor, UPackage* MapPkg, bool bWriteBrush )
+{
+  UClass* Class = Actor->Class;
+  u8* Defaults = (u8*)Class->Default;
+
+  Out.Write( "Begin Actor Class=" );
+  Out.Write( Class->Name.Data() );
+  Out.Write( " Name=" );
+  Out.Write( Actor->Name.Data() );
+  Out.Write( T3D_NEWLINE );
+
+  // Walk every class in the hierarchy, base classes last
+  for ( UStruct* Struct = Class; Struct != NULL; Struct = Struct->SuperField )
+  {
+    for ( UField* It = Struct->Children; It != NULL; It = It->Next )
+    {
+      UProperty* Prop = SafeCast<UProperty>( It );
+      if ( Prop == NULL || Prop->Offset == MAX_UINT32 || Prop->Outer != Struct )
+        continue;
+
+      if ( !IsPropertyWritable( Prop ) )
+        continue;
+
+      for ( int i = 0; i < Prop->ArrayDim; i++ )
+      {
+        u32 Offset = Prop->Offset + (i * Prop->ElementSize);
+        u8* Value = (u8*)Actor + Offset;
+        if ( IsPropertyDefault( Prop, Value, Defaults ? Defaults + Offset : NULL ) )
+          continue;
+
+        // Like the editor, objects of 'export' properties (a brush's model)
+        // are written out in full right before the property that refers to them
+        if ( bWriteBrush && Prop->PropertyType == PROP_Object && (Prop->PropertyFlags & CPF_ExportObject) )
+        {
+          UModel* Model = SafeCast<UModel>( *(UObject**)Value );
+          if ( Model != NULL && Model->Polys != NULL )
+            WriteBrushT3D( Out, Model );
+        }
+
+        Out.Write( "    " );
+        Out.Write( Prop->Name.Data() );
+        if ( Prop->ArrayDim > 1 )
+        {
+          Out.Write( "(", 1 );
+          Out.WriteInt( i );
+          Out.Write( ")", 1 );
+        }
+        Out.Write( "=", 1 );
+
+        WritePropertyValue( Out, Prop, Value, MapPkg );
+        Out.Write( T3D_NEWLINE );
+      }
+    }
+  }
+
+  Out.Write( "End Actor" T3D_NEWLINE );
+}
+
+/*-----------------------------------------------------------------------------
+ * ExportLevelT3D
+ * Streams a level to a .t3d file through a large write buffer, so the
+ * document never has to exist in memory as a whole.
+ *
+ * Actors are formatted in parallel: each window of the actor list is split
+ * into blocks, every block is formatted into its own buffer on a worker
+ * thread, and the buffers are then written out in order. The output is
+ * the same as formatting every actor one after another.
+ *
+ * Actors rejected by the filter (if any) are dropped before formatting.
+-----------------------------------------------------------------------------*/
+#define T3D_ACTORS_PER_BLOCK 32
+#define T3D_BLOCKS_PER_THREAD 4
+
+bool ExportLevelT3D( ULevel* Level, FActorFilter* Filter, const char* FileName )
+{
+  FILE* File = fopen( FileName, "wb" );
+  if ( File == NULL )
+  {
+    GLogf( LOG_ERR, "Failed to open '%s' for writing", FileName );
+    return false;
+  }
+
+  UPackage* MapPkg = Level->Pkg;
+  bool bWriteBrushes = (Filter == NULL || !Filter->bSkipBrushGeometry);
+  TArray<AActor*> Actors;
+  FilterActors( Level, Filter, Actors );
+
+  int NumActors = Actors.Size();
+  int NumBlocks = GetNumThreads() * T3D_BLOCKS_PER_THREAD;
+  int WindowSize = NumBlocks * T3D_ACTORS_PER_BLOCK;
+
+  FTextBuffer** Blocks = new FTextBuffer*[NumBlocks];
+  for ( int i = 0; i < NumBlocks; i++ )
+    Blocks[i] = new FTextBuffer();
+
+  {
+    FTextBuffer Out( File );
+    Out.Write( "Begin Map" T3D_NEWLINE );
+
+    for ( int WindowStart = 0; WindowStart < NumActors; WindowStart += WindowSize )
+    {
+      int WindowEnd = WindowStart + WindowSize;
+      if ( WindowEnd > NumActors )
+        WindowEnd = NumActors;
+
+      int WindowBlocks = (WindowEnd - WindowStart + T3D_ACTORS_PER_BLOCK - 1) / T3D_ACTORS_PER_BLOCK;
+      ParallelFor( WindowBlocks, [&]( int Block )
+      {
+        FTextBuffer& BlockOut = *Blocks[Block];
+        int Start = WindowStart + (Block * T3D_ACTORS_PER_BLOCK);
+        int End = Start + T3D_ACTORS_PER_BLOCK;
+        if ( End > WindowEnd )
+          End = WindowEnd;
+
+        BlockOut.Len = 0;
+        for ( int i = Start; i < End; i++ )
+          WriteActorT3D( BlockOut, Actors[i], MapPkg, bWriteBrushes );
+      });
+
+      for ( int i = 0; i < WindowBlocks; i++ )
+        Out.Write( Blocks[i]->Data, Blocks[i]->Len );
+    }
+
+    Out.Write( "End Map" T3D_NEWLINE );
+  }
+
+  for ( int i = 0; i < NumBlocks; i++ )
+    delete Blocks[i];
+  delete[] Blocks;
+
+  bool bOk = ferror( File ) == 0;
+  fclose( File );
+  return bOk;
+}
+
+/*-----------------------------------------------------------------------------
+ * CompareT3DFiles
+ * Checks the streamed writer against a file written by ULevelExporter, and
+ * logs the first line where they differ
+-----------------------------------------------------------------------------*/
+bool CompareT3DFiles( const char* ExpectedFile, const char* ActualFile )
+{
+  FMappedFile Expected, Actual;
+  if ( !Expected.Open( ExpectedFile ) || !Actual.Open( ActualFile ) )
+  {
+    GLogf( LOG_ERR, "Failed to open '%s' or '%s' for comparing", ExpectedFile, ActualFile );
+    return false;
+  }
+
+  const char* A = (const char*)Expected.Data;
+  const char* B = (const char*)Actual.Data;
+  size_t SizeA = Expected.Size;
+  size_t SizeB = Actual.Size;
+  size_t Common = (SizeA < SizeB) ? SizeA : SizeB;
+
+  size_t Pos = 0;
+  while ( Pos < Common && A[Pos] == B[Pos] )
+    Pos++;
+
+  if ( Pos == Common && SizeA == SizeB )
+    return true;
+
+  // Back up to the start of the line and count the lines before it
+  size_t LineStart = Pos;
+  while ( LineStart > 0 && A[LineStart-1] != '\n' )
+    LineStart--;
+
+  int Line = 1;
+  for ( size_t i = 0; i < LineStart; i++ )
+    if ( A[i] == '\n' )
+      Line++;
+
+  size_t EndA = LineStart, EndB = LineStart;
+  while ( EndA < SizeA && A[EndA] != '\r' && A[EndA] != '\n' )
+    EndA++;
+  while ( EndB < SizeB && B[EndB] != '\r' && B[EndB] != '\n' )
+    EndB++;
+
+  GLogf( LOG_ERR, "T3D output differs at line %i", Line );
+  GLogf( LOG_ERR, "  ULevelExporter: %.*s", (int)(EndA - LineStart), A + LineStart );
+  GLogf( LOG_ERR, "  lucc:           %.*s", (int)(EndB - LineStart), B + LineStart );
+  return false;
+}
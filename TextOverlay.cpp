@@ -0,0 +1,220 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * TextOverlay.cpp - Debug text overlay and allocation counting
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <new>
+#include <math.h>
+#include <atomic>
+#include "lucc.h"
+
+/*-----------------------------------------------------------------------------
+ * Allocation counting
+ * Global new/delete are replaced so that debug overlays can show how many
+ * allocations happen per frame. Nothing is counted until SetCountAllocs()
+ * turns it on, which only the level viewer does while its overlay is up.
+ * On Windows, allocations made inside of the libunr DLL use its own CRT and
+ * are not counted.
+-----------------------------------------------------------------------------*/
+static std::atomic<u64> NumAllocs( 0 );
+static std::atomic<bool> bCountAllocs( false );
+
+u64 GetNumAllocs()
+{
+  return NumAllocs.load( std::memory_order_relaxed );
+}
+
+// Counting is off unless a command turns it on, other commands only pay for
+// a relaxed load per allocation
+void SetCountAllocs( bool bEnable )
+{
+  bCountAllocs.store( bEnable, std::memory_order_relaxed );
+}
+
+void* operator new( size_t Size )
+{
+  if ( bCountAllocs.load( std::memory_order_relaxed ) )
+    NumAllocs.fetch_add( 1, std::memory_order_relaxed );
+
+  void* Ptr = malloc( Size ? Size : 1 );
+  if ( Ptr == NULL )
+    throw std::bad_alloc();
+  return Ptr;
+}
+
+void* operator new[]( size_t Size )
+{
+  return operator new( Size );
+}
+
+void operator delete( void* Ptr ) noexcept
+{
+  free( Ptr );
+}
+
+void operator delete[]( void* Ptr ) noexcept
+{
+  free( Ptr );
+}
+
+/*-----------------------------------------------------------------------------
+ * Number formatting
+ * Cheap replacements for printf style conversions, writing into a caller
+ * provided buffer. Both return the number of characters written.
+-----------------------------------------------------------------------------*/
+int FormatInt( char* Buf, i64 Value )
+{
+  char Tmp[24];
+  int Len = 0;
+  int Pos = 0;
+  u64 Abs = (Value < 0) ? (u64)0 - (u64)Value : (u64)Value;
+
+  do
+  {
+    Tmp[Len++] = '0' + (Abs % 10);
+    Abs /= 10;
+  } while ( Abs );
+
+  if ( Value < 0 )
+    Buf[Pos++] = '-';
+
+  while ( Len )
+    Buf[Pos++] = Tmp[--Len];
+
+  Buf[Pos] = '\0';
+  return Pos;
+}
+
+int FormatFloat( char* Buf, float Value, int Decimals )
+{
+  static const double Pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+  if ( Decimals < 0 )
+    Decimals = 0;
+  else if ( Decimals > 6 )
+    Decimals = 6;
+
+  // Out of range for fixed point formatting (or not a number)
+  if ( !(Value > -1.0e12f && Value < 1.0e12f) )
+    return sprintf( Buf, "%.*f", Decimals, Value );
+
+  int Pos = 0;
+  double Abs = Value;
+  if ( signbit( Value ) )
+  {
+    Buf[Pos++] = '-';
+    Abs = -Abs;
+  }
+
+  // A float times a power of ten up to 10^6 is exact in a double, so rounding
+  // half to even here gives the same digits as printf's "%.*f"
+  u64 Scaled = (u64)nearbyint( Abs * Pow10[Decimals] );
+  u64 Unit = (u64)Pow10[Decimals];
+  Pos += FormatInt( Buf + Pos, (i64)(Scaled / Unit) );
+  if ( Decimals > 0 )
+  {
+    u64 Frac = Scaled % Unit;
+    Buf[Pos++] = '.';
+    for ( int i = Decimals - 1; i >= 0; i-- )
+    {
+      Buf[Pos + i] = '0' + (Frac % 10);
+      Frac /= 10;
+    }
+    Pos += Decimals;
+  }
+
+  Buf[Pos] = '\0';
+  return Pos;
+}
+
+/*-----------------------------------------------------------------------------
+ * FTextOverlay
+-----------------------------------------------------------------------------*/
+FTextOverlay::FTextOverlay( int InX, int InY, int InLineHeight )
+{
+  X = InX;
+  Y = InY;
+  LineHeight = InLineHeight;
+  NumLines = 0;
+
+  // Reserve once so that drawing never has to grow the strings
+  for ( int i = 0; i < OVERLAY_MAX_LINES; i++ )
+  {
+    Lines[i][0] = '\0';
+    LineLens[i] = 0;
+    Strings[i].reserve( OVERLAY_LINE_LEN );
+  }
+}
+
+void FTextOverlay::Begin()
+{
+  NumLines = 0;
+}
+
+FTextOverlay& FTextOverlay::Line( const char* Label )
+{
+  if ( NumLines < OVERLAY_MAX_LINES )
+  {
+    Lines[NumLines][0] = '\0';
+    LineLens[NumLines] = 0;
+    NumLines++;
+  }
+  return Text( Label );
+}
+
+FTextOverlay& FTextOverlay::Text( const char* Str )
+{
+  if ( NumLines == 0 )
+    return *this;
+
+  char* Buf = Lines[NumLines - 1];
+  int& Len = LineLens[NumLines - 1];
+  while ( *Str && Len < OVERLAY_LINE_LEN - 1 )
+    Buf[Len++] = *Str++;
+
+  Buf[Len] = '\0';
+  return *this;
+}
+
+FTextOverlay& FTextOverlay::Int( i64 Value )
+{
+  char Buf[24];
+  FormatInt( Buf, Value );
+  return Text( Buf );
+}
+
+FTextOverlay& FTextOverlay::Float( float Value, int Decimals )
+{
+  char Buf[48];
+  FormatFloat( Buf, Value, Decimals );
+  return Text( Buf );
+}
+
+void FTextOverlay::Draw( UFont* Font )
+{
+  for ( int i = 0; i < NumLines; i++ )
+  {
+    FBoxInt2D Pos( X, Y + (i * LineHeight), 256, 256 );
+    Strings[i].assign( Lines[i], LineLens[i] );
+    GEngine->Render->DrawText( Font, Pos, Strings[i] );
+  }
+}
@@ -113,12 +113,10 @@ int textureexport( int argc, char** argv )
   UClass* Class = UTexture::StaticClass();
 
   // Load package
-  UPackage* Pkg = UPackage::StaticLoadPackage( PkgName );
+  FPackagePrefetcher Prefetcher;
+  UPackage* Pkg = LoadPackageWithPrefetch( PkgName, Prefetcher );
   if ( Pkg == NULL )
-  {
-    GLogf( LOG_CRIT, "Failed to open package '%s'; file does not exist" );
     return ERR_MISSING_PKG;
-  }
 
   // Iterate and export all textures
   TArray<FExport>& ExportTable = Pkg->GetExportTable();
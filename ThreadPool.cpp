@@ -0,0 +1,80 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * ThreadPool.cpp - Simple helpers for running work on multiple threads
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include "lucc.h"
+
+int NumThreads = 0;
+
+/*-----------------------------------------------------------------------------
+ * GetNumThreads
+ * Number of worker threads to use; set with the -j global option or picked
+ * from the number of hardware threads
+-----------------------------------------------------------------------------*/
+int GetNumThreads()
+{
+  if ( NumThreads > 0 )
+    return NumThreads;
+
+  int HwThreads = (int)std::thread::hardware_concurrency();
+  return (HwThreads > 0) ? HwThreads : 1;
+}
+
+/*-----------------------------------------------------------------------------
+ * ParallelFor
+ * Calls Func for every index in [0, Num) spread over the worker threads.
+ * Indices are handed out one at a time, so uneven work still balances.
+ * The calling thread takes part in the work and returns once all is done
+-----------------------------------------------------------------------------*/
+void ParallelFor( int Num, const std::function<void(int)>& Func )
+{
+  int Threads = GetNumThreads();
+  if ( Threads > Num )
+    Threads = Num;
+
+  if ( Threads <= 1 )
+  {
+    for ( int i = 0; i < Num; i++ )
+      Func( i );
+    return;
+  }
+
+  std::atomic<int> NextIndex( 0 );
+  auto Worker = [&]()
+  {
+    for ( int i = NextIndex++; i < Num; i = NextIndex++ )
+      Func( i );
+  };
+
+  std::thread* Workers = new std::thread[Threads - 1];
+  for ( int i = 0; i < Threads - 1; i++ )
+    Workers[i] = std::thread( Worker );
+
+  Worker();
+
+  for ( int i = 0; i < Threads - 1; i++ )
+    Workers[i].join();
+
+  delete[] Workers;
+}
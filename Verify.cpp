@@ -0,0 +1,456 @@
+/*===========================================================================*\
+|*  lucc - An open source UCC implementation that makes use of libunr        *|
+|*  Copyright (C) 2018-2019  Adam W.E. Smith                                 *|
+|*                                                                           *|
+|*  This program is free software: you can redistribute it and/or modify     *|
+|*  it under the terms of the GNU General Public License as published by     *|
+|*  the Free Software Foundation, either version 3 of the License, or        *|
+|*  (at your option) any later version.                                      *|
+|*                                                                           *|
+|*  This program is distributed in the hope that it will be useful,          *|
+|*  but WITHOUT ANY WARRANTY; without even the implied warranty of           *|
+|*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *|
+|*  GNU General Public License for more details.                             *|
+|*                                                                           *|
+|*  You should have received a copy of the GNU General Public License        *|
+|*  along with this program. If not, see <https://www.gnu.org/licenses/>.    *|
+\*===========================================================================*/
+
+/*========================================================================
+ * Verify.cpp - Checks every package of a game for damage
+ *
+ * written by Adam 'Xaleros' Smith
+ *========================================================================
+*/
+
+#include <string>
+#include <cctype>
+#include <cerrno>
+#include <cstdarg>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#ifndef _WIN32
+  #include <unistd.h>
+  #include <sys/wait.h>
+#endif
+#include "lucc.h"
+
+#define MAX_PROBLEMS_LISTED 20
+
+struct FVerifyPackage
+{
+  const FIndexedPackage* Entry;
+  const char* Name;
+  bool bPrimary;       // The file the game loads for this name
+  bool bReadable;
+  bool bTablesOk;
+  bool bLoaded;
+  int NumProblems;
+  std::vector<std::string> Problems;
+  std::unordered_set<std::string> ExportPaths;
+  std::vector<std::string> ImportPaths;
+  double TableTime;
+  double LoadTime;
+};
+
+static void AddProblem( FVerifyPackage& Package, const char* Fmt, ... )
+{
+  if ( Package.NumProblems++ >= MAX_PROBLEMS_LISTED )
+    return;
+
+  char Msg[1024];
+  va_list Args;
+  va_start( Args, Fmt );
+  vsnprintf( Msg, sizeof( Msg ), Fmt, Args );
+  va_end( Args );
+  Package.Problems.push_back( Msg );
+}
+
+static std::string ToLower( const char* Str )
+{
+  std::string Lower( Str );
+  for ( size_t i = 0; i < Lower.size(); i++ )
+    Lower[i] = (char)tolower( (u8)Lower[i] );
+  return Lower;
+}
+
+/*-----------------------------------------------------------------------------
+ * Table checks
+ * Every name and object reference has to be in range, outer chains have to
+ * end, and every export's data has to lie inside the file without
+ * overlapping another export's
+-----------------------------------------------------------------------------*/
+static bool IsValidRef( FPackageReader& Reader, int ObjRef )
+{
+  return (ObjRef > 0) ? ObjRef <= (int)Reader.Exports.size() : -ObjRef <= (int)Reader.Imports.size();
+}
+
+static bool HasOuterLoop( FPackageReader& Reader, int ObjRef )
+{
+  // An outer chain can't be longer than the number of objects
+  int MaxDepth = (int)(Reader.Exports.size() + Reader.Imports.size());
+  for ( int Depth = 0; ObjRef != 0; Depth++ )
+  {
+    if ( Depth > MaxDepth || !IsValidRef( Reader, ObjRef ) )
+      return true;
+    ObjRef = Reader.GetOuter( ObjRef );
+  }
+  return false;
+}
+
+static void CheckTables( FVerifyPackage& Package )
+{
+  double StartTime = USystem::GetSeconds();
+
+  FPackageReader Reader;
+  Package.bReadable = Reader.Open( GPackageIndex.GetString( Package.Entry->Path ) );
+  if ( !Package.bReadable )
+  {
+    AddProblem( Package, "package can't be read; %s", Reader.Error );
+    Package.TableTime = USystem::GetSeconds() - StartTime;
+    return;
+  }
+
+  int NumNames = (int)Reader.NameStarts.size();
+  char Path[1024];
+
+  for ( size_t i = 0; i < Reader.Imports.size(); i++ )
+  {
+    FRawImport& Import = Reader.Imports[i];
+    if ( Import.ClassPackage < 0 || Import.ClassPackage >= NumNames ||
+         Import.ClassName < 0 || Import.ClassName >= NumNames ||
+         Import.ObjectName < 0 || Import.ObjectName >= NumNames )
+    {
+      AddProblem( Package, "import %i uses a name that doesn't exist", (int)i );
+      continue;
+    }
+
+    if ( HasOuterLoop( Reader, -(int)i - 1 ) )
+    {
+      AddProblem( Package, "import %i has a bad outer", (int)i );
+      continue;
+    }
+
+    // Packages and groups only matter through the objects inside them
+    if ( stricmp( Reader.GetName( Import.ClassName ), "Package" ) != 0 )
+    {
+      Reader.GetObjectPath( -(int)i - 1, Path, sizeof( Path ) );
+      Package.ImportPaths.push_back( Path );
+    }
+  }
+
+  std::vector< std::pair<u32, u32> > Ranges;
+  for ( size_t i = 0; i < Reader.Exports.size(); i++ )
+  {
+    FRawExport& Export = Reader.Exports[i];
+    if ( Export.ObjectName < 0 || Export.ObjectName >= NumNames )
+    {
+      AddProblem( Package, "export %i uses a name that doesn't exist", (int)i );
+      continue;
+    }
+
+    if ( !IsValidRef( Reader, Export.Class ) || !IsValidRef( Reader, Export.Super ) ||
+         HasOuterLoop( Reader, (int)i + 1 ) )
+    {
+      AddProblem( Package, "export '%s' has a bad class, super or outer", Reader.GetName( Export.ObjectName ) );
+      continue;
+    }
+
+    Reader.GetObjectPath( (int)i + 1, Path, sizeof( Path ) );
+    Package.ExportPaths.insert( ToLower( Path ) );
+
+    if ( Export.SerialSize < 0 || (Export.SerialSize > 0 && Export.SerialOffset < 0) ||
+         (u64)(u32)Export.SerialOffset + (u64)(u32)Export.SerialSize > Reader.FileSize )
+    {
+      AddProblem( Package, "export '%s' has data outside of the file (offset %i, size %i, file %llu)",
+        Path, Export.SerialOffset, Export.SerialSize, (unsigned long long)Reader.FileSize );
+      continue;
+    }
+
+    if ( Export.SerialSize > 0 )
+      Ranges.push_back( std::make_pair( (u32)Export.SerialOffset, (u32)Export.SerialSize ) );
+  }
+
+  std::sort( Ranges.begin(), Ranges.end() );
+  for ( size_t i = 1; i < Ranges.size(); i++ )
+  {
+    if ( Ranges[i-1].first + Ranges[i-1].second > Ranges[i].first )
+      AddProblem( Package, "export data at offset %u overlaps the export before it", Ranges[i].first );
+  }
+
+  Package.bTablesOk = Package.NumProblems == 0;
+  Package.TableTime = USystem::GetSeconds() - StartTime;
+}
+
+static void CheckImports( FVerifyPackage& Package, std::vector<FVerifyPackage>& Packages,
+  std::unordered_map<std::string, size_t>& PackageMap )
+{
+  std::unordered_set<std::string> MissingPackages;
+  for ( size_t i = 0; i < Package.ImportPaths.size(); i++ )
+  {
+    const std::string& Import = Package.ImportPaths[i];
+    std::string Key = ToLower( Import.c_str() );
+    size_t Dot = Key.find( '.' );
+    std::string Target = Key.substr( 0, Dot );
+
+    std::unordered_map<std::string, size_t>::iterator It = PackageMap.find( Target );
+    if ( It == PackageMap.end() )
+    {
+      if ( MissingPackages.insert( Target ).second )
+        AddProblem( Package, "imports from package '%s', which isn't installed", Import.substr( 0, Dot ).c_str() );
+      continue;
+    }
+
+    FVerifyPackage& TargetPkg = Packages[It->second];
+    if ( TargetPkg.bReadable && Dot != std::string::npos &&
+         TargetPkg.ExportPaths.find( Key.substr( Dot + 1 ) ) == TargetPkg.ExportPaths.end() )
+      AddProblem( Package, "imports '%s', which doesn't exist", Import.c_str() );
+  }
+}
+
+/*-----------------------------------------------------------------------------
+ * Deep checks
+ * Loads every export of a package through libunr. Loading has to happen on
+ * the main thread; with isolation each package is loaded in a child
+ * process, so a crash only takes that package down. The child sends its
+ * problems back through a pipe, one per line
+-----------------------------------------------------------------------------*/
+static void LoadAllExports( const char* Name, std::vector<std::string>& OutProblems )
+{
+  char Msg[1024];
+  UPackage* Pkg = UPackage::StaticLoadPackage( Name );
+  if ( Pkg == NULL )
+  {
+    GLogf( LOG_ERR, "verify: failed to open package '%s'", Name );
+    OutProblems.push_back( "package could not be opened" );
+    return;
+  }
+
+  TArray<FExport>& Exports = Pkg->GetExportTable();
+  for ( int i = 0; i < Exports.Size(); i++ )
+  {
+    const char* ObjName = Pkg->ResolveNameFromIdx( Exports[i].ObjectName );
+    if ( strnicmp( ObjName, "None", 4 ) == 0 )
+      continue;
+
+    if ( UObject::StaticLoadObject( Pkg, &Exports[i], NULL, NULL, LOAD_Immediate ) == NULL )
+    {
+      GLogf( LOG_ERR, "verify: failed to load '%s.%s'", Name, ObjName );
+      snprintf( Msg, sizeof( Msg ), "'%s' failed to load", ObjName );
+      OutProblems.push_back( Msg );
+    }
+  }
+}
+
+static void DeepCheck( FVerifyPackage& Package, bool bIsolate )
+{
+  double StartTime = USystem::GetSeconds();
+  Package.bLoaded = true;
+
+#ifndef _WIN32
+  int Fds[2];
+  if ( bIsolate && pipe( Fds ) != 0 )
+  {
+    AddProblem( Package, "could not start a process to load it in" );
+    return;
+  }
+
+  if ( bIsolate )
+  {
+    fflush( stdout );
+    fflush( stderr );
+
+    // _exit() skips stdio cleanup, so the child's log lines are flushed by hand
+    pid_t Child = fork();
+    if ( Child == 0 )
+    {
+      close( Fds[0] );
+      std::vector<std::string> Problems;
+      LoadAllExports( Package.Name, Problems );
+      for ( size_t i = 0; i < Problems.size(); i++ )
+      {
+        std::string Line = Problems[i] + "\n";
+        if ( write( Fds[1], Line.c_str(), Line.size() ) != (ssize_t)Line.size() )
+          break;
+      }
+      fflush( stdout );
+      fflush( stderr );
+      _exit( 0 );
+    }
+
+    // Read everything before waiting, a child with a full pipe never exits
+    close( Fds[1] );
+    std::string Output;
+    char Buf[4096];
+    ssize_t Len;
+    while ( Child > 0 && ((Len = read( Fds[0], Buf, sizeof( Buf ) )) > 0 || (Len < 0 && errno == EINTR)) )
+    {
+      if ( Len > 0 )
+        Output.append( Buf, Len );
+    }
+    close( Fds[0] );
+
+    for ( size_t Start = 0, End; (End = Output.find( '\n', Start )) != std::string::npos; Start = End + 1 )
+      AddProblem( Package, "%s", Output.substr( Start, End - Start ).c_str() );
+
+    int Status = 0;
+    if ( Child < 0 || waitpid( Child, &Status, 0 ) != Child )
+      AddProblem( Package, "could not start a process to load it in" );
+    else if ( WIFSIGNALED( Status ) )
+      AddProblem( Package, "loading crashed (signal %i)", WTERMSIG( Status ) );
+
+    Package.LoadTime = USystem::GetSeconds() - StartTime;
+    return;
+  }
+#endif
+
+  std::vector<std::string> Problems;
+  LoadAllExports( Package.Name, Problems );
+  for ( size_t i = 0; i < Problems.size(); i++ )
+    AddProblem( Package, "%s", Problems[i].c_str() );
+  Package.LoadTime = USystem::GetSeconds() - StartTime;
+}
+
+/*-----------------------------------------------------------------------------
+ * verify
+-----------------------------------------------------------------------------*/
+int verify( int argc, char** argv )
+{
+  bool bDeep = false;
+  bool bIsolate = false;
+  char* PackageList = NULL;
+
+  // Argument parsing
+  for ( int i = 0; i < argc; i++ )
+  {
+    if ( argv[i][0] != '-' )
+      goto BadOpt;
+
+    switch ( argv[i][1] )
+    {
+    case 'd':
+      bDeep = true;
+      break;
+    case 'i':
+      bDeep = true;
+      bIsolate = true;
+      break;
+    case 'p':
+      if ( ++i == argc )
+        goto BadOpt;
+      PackageList = argv[i];
+      break;
+    default:
+      GLogf( LOG_WARN, "Bad option '%s'", argv[i] );
+    BadOpt:
+      printf( "verify usage:\n" );
+      printf( "\tlucc [gopts] verify [copts]\n\n" );
+
+      printf( "Command options:\n" );
+      printf( "\t-d                   - (D)eep check, loads every object of every package\n" );
+      printf( "\t-i                   - Deep check with each package (i)solated in its own process\n" );
+      printf( "\t-p \"<Pkg,Pkg,...>\"   - Only checks these (p)ackages\n" );
+      printf( "\n" );
+      return ERR_BAD_ARGS;
+    }
+  }
+
+#ifdef _WIN32
+  if ( bIsolate )
+    GLogf( LOG_WARN, "Process isolation isn't available on Windows; packages are loaded in this process" );
+#endif
+
+  // Opening picks up files that were replaced since the index was written
+  if ( !GPackageIndex.OpenIfNeeded() )
+  {
+    GLogf( LOG_CRIT, "The package index could not be opened" );
+    return ERR_BAD_PATH;
+  }
+
+  double StartTime = USystem::GetSeconds();
+  std::vector<FVerifyPackage> Packages( GPackageIndex.Header->NumPackages );
+  std::unordered_map<std::string, size_t> PackageMap;
+  for ( size_t i = 0; i < Packages.size(); i++ )
+  {
+    FVerifyPackage& Package = Packages[i];
+    Package.Entry = &GPackageIndex.Packages[i];
+    Package.Name = GPackageIndex.GetString( Package.Entry->Name );
+    Package.bPrimary = GPackageIndex.Find( Package.Name ) == Package.Entry;
+    Package.bReadable = false;
+    Package.bTablesOk = false;
+    Package.bLoaded = false;
+    Package.NumProblems = 0;
+    Package.TableTime = 0.0;
+    Package.LoadTime = 0.0;
+    if ( Package.bPrimary )
+      PackageMap[ToLower( Package.Name )] = i;
+  }
+
+  // Every package's tables are needed to resolve imports, even when only
+  // some packages are reported on
+  ParallelFor( (int)Packages.size(), [&]( int i )
+  {
+    CheckTables( Packages[i] );
+  });
+
+  std::vector<bool> bSelected( Packages.size(), true );
+  if ( PackageList != NULL )
+  {
+    std::unordered_set<std::string> Names;
+    char* Copy = strdup( PackageList );
+    for ( char* Name = strtok( Copy, "," ); Name != NULL; Name = strtok( NULL, "," ) )
+      Names.insert( ToLower( Name ) );
+    free( Copy );
+
+    for ( size_t i = 0; i < Packages.size(); i++ )
+      bSelected[i] = Names.count( ToLower( Packages[i].Name ) ) > 0;
+  }
+
+  ParallelFor( (int)Packages.size(), [&]( int i )
+  {
+    if ( bSelected[i] && Packages[i].bReadable )
+      CheckImports( Packages[i], Packages, PackageMap );
+  });
+
+  double TableTime = USystem::GetSeconds() - StartTime;
+  if ( bDeep )
+  {
+    // Only the files the game would actually load, and only ones whose
+    // tables are sound; libunr can't be expected to survive anything else.
+    // Missing imports are left for the loader to report
+    for ( size_t i = 0; i < Packages.size(); i++ )
+    {
+      if ( bSelected[i] && Packages[i].bPrimary && Packages[i].bTablesOk )
+        DeepCheck( Packages[i], bIsolate );
+    }
+  }
+
+  int NumChecked = 0;
+  int NumFailed = 0;
+  for ( size_t i = 0; i < Packages.size(); i++ )
+  {
+    FVerifyPackage& Package = Packages[i];
+    if ( !bSelected[i] )
+      continue;
+
+    NumChecked++;
+    if ( Package.NumProblems > 0 )
+      NumFailed++;
+
+    printf( "  %-4s %-32s tables %7.3fs", (Package.NumProblems > 0) ? "FAIL" : "OK", Package.Name, Package.TableTime );
+    if ( Package.bLoaded )
+      printf( "  load %7.3fs", Package.LoadTime );
+    printf( "  %s\n", GPackageIndex.GetString( Package.Entry->Path ) );
+
+    for ( size_t j = 0; j < Package.Problems.size(); j++ )
+      printf( "         - %s\n", Package.Problems[j].c_str() );
+    if ( Package.NumProblems > MAX_PROBLEMS_LISTED )
+      printf( "         - and %i more\n", Package.NumProblems - MAX_PROBLEMS_LISTED );
+  }
+
+  printf( "%i packages checked, %i failed (tables %.3f seconds, %.3f seconds in total)\n", NumChecked, NumFailed,
+    TableTime, USystem::GetSeconds() - StartTime );
+
+  return (NumFailed > 0) ? ERR_VERIFY_FAILED : 0;
+}
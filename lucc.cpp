@@ -38,7 +38,15 @@ DECLARE_UCC_COMMAND( soundexport );
 DECLARE_UCC_COMMAND( musicexport );
 DECLARE_UCC_COMMAND( meshexport );
 DECLARE_UCC_COMMAND( levelexport );
+DECLARE_UCC_COMMAND( levelstats );
 DECLARE_UCC_COMMAND( missingnativefields );
+DECLARE_UCC_COMMAND( nativelayout );
+DECLARE_UCC_COMMAND( memreport );
+DECLARE_UCC_COMMAND( pkgindex );
+DECLARE_UCC_COMMAND( find );
+DECLARE_UCC_COMMAND( pkggraph );
+DECLARE_UCC_COMMAND( pkgdiff );
+DECLARE_UCC_COMMAND( verify );
 DECLARE_UCC_COMMAND( fullpkgexport );
 DECLARE_UCC_COMMAND( objectexport );
 DECLARE_UCC_COMMAND( playmusic );
@@ -62,7 +70,15 @@ void PrintHelpAndExit()
   printf("\tlucc textureexport\n");
   printf("\tlucc meshexport\n");
   printf("\tlucc levelexport\n");
+  printf("\tlucc levelstats\n");
   printf("\tlucc missingnativefields\n");
+  printf("\tlucc nativelayout\n");
+  printf("\tlucc memreport\n");
+  printf("\tlucc pkgindex\n");
+  printf("\tlucc find\n");
+  printf("\tlucc pkggraph\n");
+  printf("\tlucc pkgdiff\n");
+  printf("\tlucc verify\n");
   printf("\tlucc fullpkgexport\n");
   printf("\tlucc objectexport\n");
   printf("\n");
@@ -75,6 +91,7 @@ void PrintHelpAndExit()
   printf("\t-g \"<GameName>\"   - Selects the specified game automatically\n");
   printf("\t-v                  - Sets log level to highest verbosity\n");
   printf("\t-l \"<loglevel>\"   - Specifies log verbosity\n");
+  printf("\t-j \"<threads>\"    - Sets the number of worker threads to use\n");
   printf("\t   Log Levels:\n");
   printf("\t   \"Dev\"   - Development/Debugging log messages\n");
   printf("\t   \"Info\"  - General runtime information\n");
@@ -193,7 +210,15 @@ CommandHandler GetCommandFunction( char* CmdName )
   APPEND_COMMAND( soundexport );
   APPEND_COMMAND( musicexport );
   APPEND_COMMAND( levelexport );
+  APPEND_COMMAND( levelstats );
   APPEND_COMMAND( missingnativefields );
+  APPEND_COMMAND( nativelayout );
+  APPEND_COMMAND( memreport );
+  APPEND_COMMAND( pkgindex );
+  APPEND_COMMAND( find );
+  APPEND_COMMAND( pkggraph );
+  APPEND_COMMAND( pkgdiff );
+  APPEND_COMMAND( verify );
   APPEND_COMMAND( fullpkgexport );
   APPEND_COMMAND( objectexport );
   APPEND_COMMAND( playmusic );
@@ -254,6 +279,9 @@ int main( int argc, char** argv )
         case 'v':
           LogLevel = LOG_DEV;
           break;
+        case 'j':
+          NumThreads = strtol( argv[++i], NULL, 10 );
+          break;
         default:
           PrintHelpAndExit();
       }
@@ -19,6 +19,10 @@
 /*========================================================================
  * lucc.h - Main lucc header file
  *
+ * Note that TextOverlay.cpp replaces the global operator new and delete for
+ * every lucc command, so the level viewer can count allocations per frame.
+ * Outside of the viewer they only pass through to malloc() and free()
+ *
  * written by Adam 'Xaleros' Smith
  *========================================================================
 */
@@ -31,6 +35,12 @@
   #undef DrawText
 #endif
 
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
 #include <libunr.h>
 
 // Error codes
@@ -42,12 +52,14 @@
 #define ERR_LIBUNR_INIT   6
 #define ERR_BAD_PATH      7
 #define ERR_EXPORT_FAILED 8
+#define ERR_VERIFY_FAILED 9
 
 extern char wd[4096]; // Working directory
 extern char Path[4096];
 extern char* PkgName;
 extern char* SingleObject;
 extern char* ExportType;
+extern int NumThreads;   // Worker thread count, 0 = one per hardware thread
 
 // Command handler function
 typedef int(*CommandHandler)(int, char**);
@@ -61,3 +73,415 @@ struct UccCommand
 #define DECLARE_UCC_COMMAND( name ) \
   int name ( int argc, char** argv ); \
   UccCommand name##Command = { TXT(name), name };
+
+// Threading helpers
+int GetNumThreads();
+void ParallelFor( int Num, const std::function<void(int)>& Func );
+
+// Package file helpers; folders and extensions are in the game's search order
+#define NUM_PACKAGE_DIRS 5
+#define NUM_PACKAGE_EXTS 7
+
+extern const char* const PackageDirs[NUM_PACKAGE_DIRS];
+extern const char* const PackageExts[NUM_PACKAGE_EXTS];
+
+bool FindPackageFile( const char* Name, char* OutPath, size_t OutSize );
+void FindPackageFiles( const char* Dir, const char* Ext, TArray<char*>& OutNames );
+
+// Class loading helpers
+struct FClassEntry
+{
+  const char* PkgName;
+  UClass* Class;
+};
+
+int LoadPackageClasses( const char* PkgName, std::vector<FClassEntry>& OutClasses );
+const char* GetCppPropType( UProperty* Prop, char* Out, size_t OutSize );
+
+/*-----------------------------------------------------------------------------
+ * FMappedFile
+ * A whole file mapped read-only into memory. Only lucc's own readers (the
+ * package index, import tables and LevelBin.h) read through it, libunr
+ * still loads packages through its own archive and buffers
+-----------------------------------------------------------------------------*/
+#define MAPPED_PAGE_SIZE 4096
+
+class FMappedFile
+{
+public:
+  FMappedFile();
+  ~FMappedFile();
+
+  bool Open( const char* FileName );
+  void Close();
+  void Touch();
+
+  const u8* Data;
+  size_t Size;
+
+private:
+#ifdef _WIN32
+  HANDLE File;
+  HANDLE Mapping;
+#endif
+
+  FMappedFile( const FMappedFile& );
+  FMappedFile& operator=( const FMappedFile& );
+};
+
+/*-----------------------------------------------------------------------------
+ * FPackageReader
+ * Reads a package's header, name, import and export tables straight from the
+ * file with positioned reads, without going through libunr. Export data is
+ * only read when asked for. Object references follow the package format:
+ * positive values are export indices + 1, negative values import indices
+-----------------------------------------------------------------------------*/
+#define PACKAGE_TAG 0x9E2A83C1
+
+struct FRawImport
+{
+  int ClassPackage;
+  int ClassName;
+  int Package;
+  int ObjectName;
+};
+
+struct FRawExport
+{
+  int Class;
+  int Super;
+  int Group;
+  int ObjectName;
+  u32 ObjectFlags;
+  int SerialSize;
+  int SerialOffset;
+};
+
+class FPackageReader
+{
+public:
+  FPackageReader();
+  ~FPackageReader();
+
+  bool Open( const char* FileName );
+  void Close();
+
+  bool ReadAt( u64 Offset, void* Buf, size_t Size );
+  bool ReadExportData( int iExport, std::vector<u8>& OutData );
+
+  const char* GetName( int Idx );
+  const char* GetObjectName( int ObjRef );
+  const char* GetClassName( int ObjRef );
+  int GetOuter( int ObjRef );
+  const char* GetObjectPath( int ObjRef, char* Out, size_t OutSize );
+  int FindExport( const char* Name, const char* ClassName = NULL );
+  void GetExportDependencies( int iExport, std::vector<int>& OutExports );
+
+  const char* Error;
+  u16 FileVersion;
+  u16 LicenseeVersion;
+  u32 PackageFlags;
+  u8 Guid[16];
+  u64 FileSize;
+  u32 NameOffset;
+  u32 ImportOffset;
+  u32 ExportOffset;
+
+  std::vector<char> NameData;
+  std::vector<u32> NameStarts;
+  std::vector<FRawImport> Imports;
+  std::vector<FRawExport> Exports;
+
+private:
+#ifdef _WIN32
+  HANDLE File;
+#else
+  int File;
+#endif
+
+  FPackageReader( const FPackageReader& );
+  FPackageReader& operator=( const FPackageReader& );
+};
+
+/*-----------------------------------------------------------------------------
+ * FPackageIndex
+ * Every package of the current game with its path and a summary of its
+ * tables, kept in a file in the game's root folder (or the user's cache
+ * folder if the game can't be written to). The file is used in place
+ * (mapped), so opening it only costs a stat() per package. Packages are
+ * sorted by name and then by search order, so the first match for a name
+ * is the one the game would pick. Strings are offsets into a string block.
+ *
+ * Nothing opens the index up front; commands that need it call Open() or
+ * OpenIfNeeded(), everything else probes the package folders directly
+-----------------------------------------------------------------------------*/
+#define PACKAGE_INDEX_FILE    "../lucc.pkgindex"
+#define PACKAGE_INDEX_MAGIC   0x4950554c // "LUPI"
+#define PACKAGE_INDEX_VERSION 1
+
+// Package flags in the index
+#define INDEX_BadPackage 0x00000001 // Tables could not be read
+
+struct FPackageIndexHeader
+{
+  u32 Magic;
+  u32 Version;
+  u32 NumPackages;
+  u32 NumClassCounts;
+  u32 StringsSize;
+  u32 Pad;
+  i64 DirTimes[NUM_PACKAGE_DIRS];
+};
+
+struct FIndexedPackage
+{
+  u32 Name;
+  u32 Path;
+  u64 FileSize;
+  i64 FileTime;
+  u8 Guid[16];
+  u32 NumExports;
+  u32 NumImports;
+  u32 FirstClassCount;
+  u32 NumClassCounts;
+  u32 SearchOrder;
+  u32 Flags;
+};
+
+// Number of exports of one class in a package
+struct FIndexedClassCount
+{
+  u32 ClassName;
+  u32 Count;
+};
+
+class FPackageIndex
+{
+public:
+  FPackageIndex();
+
+  bool Open( bool bRefresh );
+  bool OpenIfNeeded();
+  bool IsOpen() { return Header != NULL; }
+
+  const FIndexedPackage* Find( const char* Name );
+  const char* GetString( u32 Offset ) { return Strings + Offset; }
+
+  const FPackageIndexHeader* Header;
+  const FIndexedPackage* Packages;
+  const FIndexedClassCount* ClassCounts;
+  const char* Strings;
+
+private:
+  bool MapFile( int Location );
+  bool Attach( const u8* Data, size_t Size );
+  bool IsCurrent();
+  bool Update( bool bReadAll );
+
+  FMappedFile Map;
+  std::vector<u8> Built;
+  bool bTriedOpen;
+
+  FPackageIndex( const FPackageIndex& );
+  FPackageIndex& operator=( const FPackageIndex& );
+};
+
+extern FPackageIndex GPackageIndex;
+
+/*-----------------------------------------------------------------------------
+ * FPackagePrefetcher
+ * Warms the OS file cache with package files on background threads so that
+ * libunr's own reads of them don't wait on the disk. This doesn't change how
+ * libunr reads or buffers them. AddDependencies() also
+ * follows every package's imports, read straight from its tables
+-----------------------------------------------------------------------------*/
+class FPackagePrefetcher
+{
+public:
+  FPackagePrefetcher();
+  ~FPackagePrefetcher();
+
+  void AddPackage( const char* Name );
+  void AddDependencies( const char* Name );
+  void Start( int NumThreads = 1 );
+  void Wait();
+
+  int NumFiles() { return Files.Size(); }
+  bool IsDone() { return bDone; }
+  double GetFinishTime() { return FinishTime; }
+
+private:
+  void Run();
+  void AddFileImports( const char* FilePath );
+
+  TArray<char*> Files;
+  std::mutex FilesLock;
+  std::condition_variable FilesQueued;
+  std::vector<std::thread> Threads;
+  bool bFollowImports;
+  bool bStarted;
+  std::atomic<bool> bCancel;
+  int NextFile;    // Guarded by FilesLock
+  int NumWorking;  // Guarded by FilesLock
+  std::atomic<int> NumRunning;
+  std::atomic<bool> bDone;
+  double StartTime;
+  double FinishTime;
+};
+
+// Starts reading the package's dependencies in the background and loads it.
+// Prefetcher has to outlive everything that loads from those dependencies
+UPackage* LoadPackageWithPrefetch( const char* PkgName, FPackagePrefetcher& Prefetcher );
+
+// Debug text overlay helpers
+u64 GetNumAllocs();
+void SetCountAllocs( bool bEnable );
+int FormatInt( char* Buf, i64 Value );
+int FormatFloat( char* Buf, float Value, int Decimals );
+
+#define OVERLAY_MAX_LINES 16
+#define OVERLAY_LINE_LEN  64
+
+/*-----------------------------------------------------------------------------
+ * FTextOverlay
+ * Lines of debug text that are rebuilt every frame without touching the heap.
+ * Call Begin(), build lines with Line() followed by Text/Int/Float, then Draw()
+-----------------------------------------------------------------------------*/
+class FTextOverlay
+{
+public:
+  FTextOverlay( int InX, int InY, int InLineHeight );
+
+  void Begin();
+  FTextOverlay& Line( const char* Label );
+  FTextOverlay& Text( const char* Str );
+  FTextOverlay& Int( i64 Value );
+  FTextOverlay& Float( float Value, int Decimals );
+  void Draw( UFont* Font );
+
+private:
+  int X;
+  int Y;
+  int LineHeight;
+  int NumLines;
+  int LineLens[OVERLAY_MAX_LINES];
+  char Lines[OVERLAY_MAX_LINES][OVERLAY_LINE_LEN];
+  FString Strings[OVERLAY_MAX_LINES];
+};
+
+/*-----------------------------------------------------------------------------
+ * FTextBuffer
+ * Text output buffer. When given a file, it flushes to it whenever it fills
+ * up; otherwise it grows and keeps everything in memory
+-----------------------------------------------------------------------------*/
+class FTextBuffer
+{
+public:
+  FTextBuffer( FILE* InFile = NULL );
+  ~FTextBuffer();
+
+  void Write( const char* Str, size_t StrLen );
+  void Write( const char* Str );
+  void WriteInt( i64 Value );
+  void WriteFloat( float Value );
+  void WriteJsonString( const char* Str );
+  void Flush();
+
+  FILE* File;
+  char* Data;
+  size_t Len;
+  size_t Capacity;
+
+private:
+  FTextBuffer( const FTextBuffer& );
+  FTextBuffer& operator=( const FTextBuffer& );
+};
+
+/*-----------------------------------------------------------------------------
+ * FActorFilter
+ * Picks which actors of a level get exported. An actor has to match one of
+ * the classes (or a subclass of it) if any are given, and has to be inside
+ * the box if one is given
+-----------------------------------------------------------------------------*/
+struct FActorFilter
+{
+  FActorFilter();
+  bool Matches( AActor* Actor );
+
+  TArray<char*> Classes;
+  bool bUseBox;
+  FVector BoxMin;
+  FVector BoxMax;
+  bool bSkipBrushGeometry;
+};
+
+void FilterActors( ULevel* Level, FActorFilter* Filter, TArray<AActor*>& OutActors );
+
+// T3D export
+void WriteObjectRef( FTextBuffer& Out, UObject* Obj, UPackage* MapPkg );
+bool IsPropertyDefault( UProperty* Prop, u8* Value, u8* Default );
+void WriteActorT3D( FTextBuffer& Out, AActor* Actor, UPackage* MapPkg, bool bWriteBrush );
+bool ExportLevelT3D( ULevel* Level, FActorFilter* Filter, const char* FileName );
+bool CompareT3DFiles( const char* ExpectedFile, const char* ActualFile );
+
+// Binary level export (see LevelBin.h)
+bool ExportLevelBin( ULevel* Level, FActorFilter* Filter, const char* FileName );
+
+/*-----------------------------------------------------------------------------
+ * FGlbWriter
+ * Collects binary data and accessors for a .glb file. Buffer views are
+ * appended straight to the binary chunk; the caller supplies the rest of
+ * the JSON (meshes, nodes, materials) when saving
+-----------------------------------------------------------------------------*/
+#define GLTF_BYTE           5120
+#define GLTF_UNSIGNED_BYTE  5121
+#define GLTF_SHORT          5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT   5125
+#define GLTF_FLOAT          5126
+
+#define GLTF_ARRAY_BUFFER         34962
+#define GLTF_ELEMENT_ARRAY_BUFFER 34963
+
+class FGlbWriter
+{
+public:
+  FGlbWriter();
+
+  u8* AllocBufferView( size_t Size, int Target, int ByteStride, int* OutView );
+  int AddBufferView( const void* Data, size_t Size, int Target, int ByteStride = 0 );
+  int AddAccessor( int View, int ComponentType, int Count, const char* Type,
+    const float* Min = NULL, const float* Max = NULL, int NumComponents = 0, bool bNormalized = false,
+    size_t ByteOffset = 0 );
+  bool Save( const char* FileName, const char* Extra );
+
+private:
+  std::vector<u8> Bin;
+  FTextBuffer BufferViews;
+  FTextBuffer Accessors;
+  int NumBufferViews;
+  int NumAccessors;
+};
+
+// Reorders triangles so that vertices are reused while still in the cache
+void OptimizeVertexCache( u32* Indices, int NumIndices );
+
+// Level geometry export
+bool ExportLevelGeometry( ULevel* Level, const char* FileName, bool bGlb );
+
+// Level stats helpers
+u64 EstimateTextureSize( UTexture* Texture );
+
+// Mesh frame export
+struct FMeshTriangle
+{
+  int iVertex[3];
+  float U[3];
+  float V[3];
+  int Material;
+};
+
+void UnpackMeshVerts( const FMeshVert* Verts, int NumVerts, float* OutX, float* OutY, float* OutZ );
+void GatherMeshTriangles( UMesh* Mesh, std::vector<FMeshTriangle>& OutTris );
+bool ExportMeshFramesObj( UMesh* Mesh, const char* Path, const char* Sequences );
+bool ExportMeshGlb( UMesh* Mesh, const char* Path, bool bQuantize, const char* Sequences );